@@ -0,0 +1,97 @@
+/*
+ * SOD model - binary reading and writing of values
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <stdint.h>
+
+/* Values are written in the native byte order, the files are meant
+ * to be read on the same kind of machine (e.g. a restart of a job).
+ */
+
+template<typename Value>
+void write_value(std::ostream& stream, const Value& value)
+{
+    static_assert(std::is_trivially_copyable<Value>::value,
+                  "Only plain values can be written");
+    stream.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template<typename Value>
+void read_value(std::istream& stream, Value& value)
+{
+    static_assert(std::is_trivially_copyable<Value>::value,
+                  "Only plain values can be read");
+    if (!stream.read(reinterpret_cast<char *>(&value), sizeof(value)))
+        throw std::runtime_error("Unexpected end of binary data");
+}
+
+template<typename Value>
+void write_values(std::ostream& stream, const Value *values, size_t count)
+{
+    stream.write(reinterpret_cast<const char *>(values),
+                 count * sizeof(Value));
+}
+
+template<typename Value>
+void read_values(std::istream& stream, Value *values, size_t count)
+{
+    if (!stream.read(reinterpret_cast<char *>(values),
+                     count * sizeof(Value)))
+        throw std::runtime_error("Unexpected end of binary data");
+}
+
+// vector with its size
+template<typename Value, typename Allocator>
+void write_vector(std::ostream& stream,
+                  const std::vector<Value, Allocator>& values)
+{
+    write_value(stream, uint64_t(values.size()));
+    write_values(stream, values.data(), values.size());
+}
+
+template<typename Value, typename Allocator>
+void read_vector(std::istream& stream, std::vector<Value, Allocator>& values)
+{
+    uint64_t size;
+    read_value(stream, size);
+    values.resize(size);
+    read_values(stream, values.data(), size);
+}
+
+inline void write_string(std::ostream& stream, const std::string& text)
+{
+    write_value(stream, uint64_t(text.size()));
+    stream.write(text.data(), text.size());
+}
+
+inline void read_string(std::istream& stream, std::string& text)
+{
+    uint64_t size;
+    read_value(stream, size);
+    text.resize(size);
+    if (size && !stream.read(&text[0], size))
+        throw std::runtime_error("Unexpected end of binary data");
+}
+
+#endif
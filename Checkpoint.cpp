@@ -0,0 +1,181 @@
+/*
+ * SOD model - checkpoints of the simulation
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Checkpoint.h"
+#include "BinaryIO.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using std::string;
+
+static const size_t buffer_size = 1 << 20;
+
+static const char checkpoint_magic[8] = {'S', 'O', 'D', 'C',
+                                         'H', 'K', 'P', '1'};
+
+DeflateBuffer::DeflateBuffer(const char *filename)
+    : input(buffer_size), output(buffer_size), failed(false)
+{
+    std::memset(&zstream, 0, sizeof(zstream));
+    file = std::fopen(filename, "wb");
+    if (!file)
+        throw std::runtime_error(string("Cannot create file ") + filename);
+    // the state is mostly small numbers and zeros,
+    // so the fastest level compresses it well enough
+    if (deflateInit(&zstream, Z_BEST_SPEED) != Z_OK) {
+        std::fclose(file);
+        throw std::runtime_error("Cannot initialize compression");
+    }
+    setp(input.data(), input.data() + input.size());
+}
+
+DeflateBuffer::~DeflateBuffer()
+{
+    if (file) {
+        deflateEnd(&zstream);
+        std::fclose(file);
+    }
+}
+
+// compress the buffered input and write the output to the file
+bool DeflateBuffer::compress(int flush)
+{
+    zstream.next_in = reinterpret_cast<Bytef *>(pbase());
+    zstream.avail_in = pptr() - pbase();
+    int status;
+    do {
+        zstream.next_out = reinterpret_cast<Bytef *>(output.data());
+        zstream.avail_out = output.size();
+        status = deflate(&zstream, flush);
+        if (status == Z_STREAM_ERROR)
+            return false;
+        size_t size = output.size() - zstream.avail_out;
+        if (std::fwrite(output.data(), 1, size, file) != size)
+            return false;
+    } while (zstream.avail_out == 0
+             || (flush == Z_FINISH && status != Z_STREAM_END));
+    setp(input.data(), input.data() + input.size());
+    return true;
+}
+
+int DeflateBuffer::overflow(int c)
+{
+    if (failed || !compress(Z_NO_FLUSH)) {
+        failed = true;
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+bool DeflateBuffer::finish()
+{
+    bool ok = !failed && compress(Z_FINISH);
+    deflateEnd(&zstream);
+    if (std::fclose(file))
+        ok = false;
+    file = nullptr;
+    return ok;
+}
+
+InflateBuffer::InflateBuffer(const char *filename)
+    : input(buffer_size), output(buffer_size), ended(false)
+{
+    std::memset(&zstream, 0, sizeof(zstream));
+    file = std::fopen(filename, "rb");
+    if (!file)
+        throw std::runtime_error(string("Cannot open file ") + filename);
+    if (inflateInit(&zstream) != Z_OK) {
+        std::fclose(file);
+        throw std::runtime_error("Cannot initialize decompression");
+    }
+    setg(output.data(), output.data(), output.data());
+}
+
+InflateBuffer::~InflateBuffer()
+{
+    inflateEnd(&zstream);
+    std::fclose(file);
+}
+
+int InflateBuffer::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+    while (!ended) {
+        if (zstream.avail_in == 0) {
+            size_t size = std::fread(input.data(), 1, input.size(), file);
+            if (size == 0)
+                return traits_type::eof();
+            zstream.next_in = reinterpret_cast<Bytef *>(input.data());
+            zstream.avail_in = size;
+        }
+        zstream.next_out = reinterpret_cast<Bytef *>(output.data());
+        zstream.avail_out = output.size();
+        int status = inflate(&zstream, Z_NO_FLUSH);
+        if (status == Z_STREAM_END)
+            ended = true;
+        else if (status != Z_OK)
+            return traits_type::eof();
+        size_t size = output.size() - zstream.avail_out;
+        if (size) {
+            setg(output.data(), output.data(), output.data() + size);
+            return traits_type::to_int_type(*gptr());
+        }
+    }
+    return traits_type::eof();
+}
+
+void CompressedOutput::close()
+{
+    flush();
+    if (!buffer.finish() || fail())
+        throw std::runtime_error("Writing compressed file failed");
+}
+
+void write_checkpoint_info(std::ostream& stream, const CheckpointInfo& info)
+{
+    stream.write(checkpoint_magic, sizeof(checkpoint_magic));
+    write_string(stream, info.structure);
+    write_string(stream, info.parameters);
+    write_value(stream, info.seed);
+    write_value(stream, info.week);
+    write_value(stream, info.year);
+    write_value(stream, info.month);
+    write_value(stream, info.day);
+}
+
+CheckpointInfo read_checkpoint_info(std::istream& stream)
+{
+    char magic[sizeof(checkpoint_magic)];
+    if (!stream.read(magic, sizeof(magic))
+            || std::memcmp(magic, checkpoint_magic, sizeof(magic)))
+        throw std::runtime_error("Not a checkpoint file");
+    CheckpointInfo info;
+    read_string(stream, info.structure);
+    read_string(stream, info.parameters);
+    read_value(stream, info.seed);
+    read_value(stream, info.week);
+    read_value(stream, info.year);
+    read_value(stream, info.month);
+    read_value(stream, info.day);
+    return info;
+}
@@ -0,0 +1,117 @@
+/*
+ * SOD model - checkpoints of the simulation
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <zlib.h>
+
+#include <cstdio>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/* Stream buffer which compresses everything written to a file */
+class DeflateBuffer : public std::streambuf
+{
+private:
+    std::FILE *file;
+    z_stream zstream;
+    std::vector<char> input;
+    std::vector<char> output;
+    bool failed;
+    bool compress(int flush);
+protected:
+    int overflow(int c);
+public:
+    explicit DeflateBuffer(const char *filename);
+    ~DeflateBuffer();
+    // compress the rest and close the file, false on error
+    bool finish();
+};
+
+/* Stream buffer which reads a file written by DeflateBuffer */
+class InflateBuffer : public std::streambuf
+{
+private:
+    std::FILE *file;
+    z_stream zstream;
+    std::vector<char> input;
+    std::vector<char> output;
+    bool ended;
+protected:
+    int underflow();
+public:
+    explicit InflateBuffer(const char *filename);
+    ~InflateBuffer();
+};
+
+/* Compressed binary output file */
+class CompressedOutput : public std::ostream
+{
+private:
+    DeflateBuffer buffer;
+public:
+    explicit CompressedOutput(const char *filename)
+        : std::ostream(nullptr), buffer(filename)
+    {
+        rdbuf(&buffer);
+    }
+    // finish the file, throws when anything failed
+    void close();
+};
+
+/* Compressed binary input file */
+class CompressedInput : public std::istream
+{
+private:
+    InflateBuffer buffer;
+public:
+    explicit CompressedInput(const char *filename)
+        : std::istream(nullptr), buffer(filename)
+    {
+        rdbuf(&buffer);
+    }
+};
+
+/* Description of the checkpoint stored before the runs
+ *
+ * The structure (region size, number of runs and how the state is
+ * stored) must be the same to load the runs. The parameters must be the
+ * same to continue exactly as the saved simulation, except when the
+ * simulation is branched to a different scenario.
+ */
+struct CheckpointInfo
+{
+    std::string structure;
+    std::string parameters;
+    // seed of the first run
+    uint32_t seed;
+    // the first week which is not simulated yet and its date
+    uint32_t week;
+    int32_t year;
+    int32_t month;
+    int32_t day;
+};
+
+void write_checkpoint_info(std::ostream& stream, const CheckpointInfo& info);
+// throws when it is not a checkpoint
+CheckpointInfo read_checkpoint_info(std::istream& stream);
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * SOD model - compact raster for host cells
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "CompactImg.h"
+#include "BinaryIO.h"
+
+#include <stdexcept>
+
+HostIndex::HostIndex(const Img& hosts)
+    :
+      width(hosts.getWidth()),
+      height(hosts.getHeight()),
+      w_e_res(hosts.getWEResolution()),
+      n_s_res(hosts.getNSResolution()),
+      num_cells(0)
+{
+    row_runs.reserve(height + 1);
+    for (int row = 0; row < height; row++) {
+        row_runs.push_back(runs.size());
+        int col = 0;
+        while (col < width) {
+            if (hosts(row, col) <= 0) {
+                col++;
+                continue;
+            }
+            Run run;
+            run.first_col = col;
+            run.offset = num_cells;
+            while (col < width && hosts(row, col) > 0)
+                col++;
+            run.end_col = col;
+            num_cells += run.end_col - run.first_col;
+            runs.push_back(run);
+        }
+    }
+    row_runs.push_back(runs.size());
+}
+
+template<typename Number>
+BasicCompactImg<Number>::BasicCompactImg(
+        std::shared_ptr<const HostIndex> index, const Img& image)
+    : cells(index), data(index->size()), outside(0)
+{
+    if (image.getWidth() != cells->getWidth()
+            || image.getHeight() != cells->getHeight())
+        throw std::runtime_error("The height or width of the image does"
+                                 " not match with the host index.");
+    cells->for_each_cell([this, &image](int row, int col, int i)
+                         { data[i] = image(row, col); });
+}
+
+template<typename Number>
+Img BasicCompactImg<Number>::toImg() const
+{
+    Img out(getWidth(), getHeight(), getWEResolution(), getNSResolution());
+    out.zero();
+    cells->for_each_cell([this, &out](int row, int col, int i)
+                         { out(row, col) = data[i]; });
+    return out;
+}
+
+template<typename Number>
+void BasicCompactImg<Number>::write(std::ostream& stream) const
+{
+    write_vector(stream, data);
+}
+
+template<typename Number>
+void BasicCompactImg<Number>::read(std::istream& stream)
+{
+    AlignedVector<Number> stored;
+    read_vector(stream, stored);
+    if (stored.size() != data.size())
+        throw std::runtime_error("The number of stored cells does not"
+                                 " match with the host index.");
+    data.swap(stored);
+}
+
+template class BasicCompactImg<uint8_t>;
+template class BasicCompactImg<uint16_t>;
+template class BasicCompactImg<int>;
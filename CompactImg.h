@@ -0,0 +1,189 @@
+/*
+ * SOD model - compact raster for host cells
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef COMPACTIMG_H
+#define COMPACTIMG_H
+
+#include "Img.h"
+#include "Memory.h"
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+/* Index of cells which contain hosts
+ *
+ * Each row is stored as a list of runs of consecutive host cells
+ * (row run-length encoding), the runs of all rows are in one array
+ * and the rows point to it (like in the CSR sparse matrix format).
+ * The index is built only once and shared by all the runs.
+ */
+class HostIndex
+{
+private:
+    struct Run
+    {
+        int first_col;
+        int end_col;
+        // position of the first cell of the run in the compact storage
+        int offset;
+    };
+    int width;
+    int height;
+    int w_e_res;
+    int n_s_res;
+    // runs of the row i are from row_runs[i] to row_runs[i + 1]
+    std::vector<int> row_runs;
+    std::vector<Run> runs;
+    int num_cells;
+public:
+    // cells with values greater than zero are indexed
+    explicit HostIndex(const Img& hosts);
+
+    int getWidth() const
+    {
+        return width;
+    }
+
+    int getHeight() const
+    {
+        return height;
+    }
+
+    int getWEResolution() const
+    {
+        return w_e_res;
+    }
+
+    int getNSResolution() const
+    {
+        return n_s_res;
+    }
+
+    // number of indexed cells
+    int size() const
+    {
+        return num_cells;
+    }
+
+    // position of the cell in the compact storage, -1 when not indexed
+    int index(unsigned row, unsigned col) const
+    {
+        auto first = runs.begin() + row_runs[row];
+        auto last = runs.begin() + row_runs[row + 1];
+        // first run starting after col, the one before may contain col
+        auto run = std::upper_bound(first, last, int(col),
+                                    [](int c, const Run& r)
+                                    { return c < r.first_col; });
+        if (run == first)
+            return -1;
+        --run;
+        if (int(col) >= run->end_col)
+            return -1;
+        return run->offset + col - run->first_col;
+    }
+
+    template<class Function>
+    void for_each_cell(Function f) const
+    {
+        for (int row = 0; row < height; row++)
+            for (int i = row_runs[row]; i < row_runs[row + 1]; i++)
+                for (int col = runs[i].first_col; col < runs[i].end_col; col++)
+                    f(row, col, runs[i].offset + col - runs[i].first_col);
+    }
+};
+
+/* Raster which stores values only for the cells in the HostIndex
+ *
+ * The cells outside of the index read as zero. Writing to them is not
+ * allowed (all of them share one value), so the code using it must not
+ * write to cells which were zero in the host raster used for the index.
+ *
+ * Like BasicImg, it is instantiated for int, uint8_t and uint16_t.
+ */
+template<typename Number>
+class BasicCompactImg
+{
+private:
+    std::shared_ptr<const HostIndex> cells;
+    AlignedVector<Number> data;
+    // value of all cells outside of the index
+    Number outside;
+public:
+    typedef Number value_type;
+
+    BasicCompactImg(std::shared_ptr<const HostIndex> index,
+                    const Img& image);
+
+    int getWidth() const
+    {
+        return cells->getWidth();
+    }
+
+    int getHeight() const
+    {
+        return cells->getHeight();
+    }
+
+    int getWEResolution() const
+    {
+        return cells->getWEResolution();
+    }
+
+    int getNSResolution() const
+    {
+        return cells->getNSResolution();
+    }
+
+    const HostIndex& index() const
+    {
+        return *cells;
+    }
+
+    // values of the indexed cells in the order of the index
+    const Number *values() const
+    {
+        return data.data();
+    }
+
+    Number operator()(unsigned row, unsigned col) const
+    {
+        int i = cells->index(row, col);
+        if (i < 0)
+            return 0;
+        return data[i];
+    }
+
+    Number& operator()(unsigned row, unsigned col)
+    {
+        int i = cells->index(row, col);
+        if (i < 0)
+            return outside;
+        return data[i];
+    }
+
+    // expand to a full raster
+    Img toImg() const;
+
+    // binary values of the indexed cells (for checkpoints),
+    // the index must be the same when reading
+    void write(std::ostream& stream) const;
+    void read(std::istream& stream);
+};
+
+typedef BasicCompactImg<int> CompactImg;
+
+#endif
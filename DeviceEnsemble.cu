@@ -0,0 +1,664 @@
+/*
+ * SOD model - stochastic runs simulated on a GPU
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "DeviceEnsemble.h"
+#include "Random.h"
+#include "Samplers.h"
+#include "BinaryIO.h"
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+static void check(cudaError_t error, const char *what)
+{
+    if (error != cudaSuccess)
+        throw std::runtime_error(std::string("CUDA failed in ") + what
+                                 + ": " + cudaGetErrorString(error));
+}
+
+/* Array of values in the device memory */
+template<typename Value>
+class DeviceArray
+{
+private:
+    Value *values;
+    size_t count;
+public:
+    DeviceArray()
+        : values(nullptr), count(0)
+    {}
+    ~DeviceArray()
+    {
+        cudaFree(values);
+    }
+    DeviceArray(const DeviceArray&) = delete;
+    DeviceArray& operator=(const DeviceArray&) = delete;
+
+    void allocate(size_t count)
+    {
+        cudaFree(values);
+        values = nullptr;
+        this->count = count;
+        if (count)
+            check(cudaMalloc(&values, count * sizeof(Value)), "allocation");
+    }
+    // allocated with the values from the host
+    void assign(const Value *host, size_t count)
+    {
+        allocate(count);
+        upload(host, count);
+    }
+    void upload(const Value *host, size_t count, size_t offset = 0)
+    {
+        if (count)
+            check(cudaMemcpy(values + offset, host, count * sizeof(Value),
+                             cudaMemcpyHostToDevice), "copy to device");
+    }
+    void download(Value *host, size_t count, size_t offset = 0) const
+    {
+        if (count)
+            check(cudaMemcpy(host, values + offset, count * sizeof(Value),
+                             cudaMemcpyDeviceToHost), "copy from device");
+    }
+    void zero()
+    {
+        if (count)
+            check(cudaMemset(values, 0, count * sizeof(Value)), "memset");
+    }
+    Value *data() const
+    {
+        return values;
+    }
+};
+
+/* Key and counter of the random numbers of a run in a week */
+struct RunStep
+{
+    uint32_t seed;
+    uint32_t step;
+    int active;
+};
+
+/* Weather of a week as used by the kernels (see Weather.h) */
+struct DeviceWeather
+{
+    int spatial;
+    WeatherCode code;
+    double scale;
+    double offset;
+    double value;
+    const void *values;
+    // null for floats on the same grid as the hosts
+    const unsigned *index;
+};
+
+/* Dispersal as used by the kernels */
+struct DeviceKernel
+{
+    Rtype rtype;
+    int wind;
+    double scale1;
+    double scale2;
+    double gamma;
+    double mu;
+    double kappa;
+    int w_e_res;
+    int n_s_res;
+    double max_distance;
+    double escape_share1;
+    // zero when the distributions are sampled
+    unsigned table_size;
+    const int *rows;
+    const int *cols;
+    const double *probability;
+    const unsigned *alias;
+};
+
+// numbers of hosts by run in the totals buffer
+enum DeviceTotal
+{
+    TOTAL_S_UMCA, TOTAL_S_OAKS, TOTAL_I_UMCA, TOTAL_I_OAKS, TOTAL_EXPOSED,
+    NUM_TOTALS
+};
+
+const int block_size = 256;
+// blocks per run which count the hosts
+const int count_blocks = 32;
+
+__device__ inline double weather_at(const DeviceWeather& weather, int cell)
+{
+    if (!weather.spatial)
+        return weather.value;
+    if (!weather.index)
+        return static_cast<const float *>(weather.values)[cell];
+    unsigned i = weather.index[cell];
+    double code;
+    if (weather.code == WEATHER_UINT8)
+        code = static_cast<const uint8_t *>(weather.values)[i];
+    else if (weather.code == WEATHER_UINT16)
+        code = static_cast<const uint16_t *>(weather.values)[i];
+    else
+        code = static_cast<const float *>(weather.values)[i];
+    return weather.offset + weather.scale * code;
+}
+
+// uniform in (0, 1), so it can be used in logarithms
+__device__ inline double uniform(CounterStream& stream)
+{
+    return open_uniform(stream);
+}
+
+// the same sampler as with the fast engines of Sporulation
+__device__ inline int poisson(CounterStream& stream, double mean)
+{
+    return FastPoisson(mean)(stream);
+}
+
+// the same algorithm as von_mises_distribution
+__device__ double von_mises(CounterStream& stream, double mu, double kappa)
+{
+    if (kappa <= 1.e-06)
+        return 2 * PI * uniform(stream);
+
+    double a = 1.0 + sqrt(1.0 + 4.0 * kappa * kappa);
+    double b = (a - sqrt(2.0 * a)) / (2.0 * kappa);
+    double r = (1.0 + b * b) / (2.0 * b);
+    double f;
+    while (true) {
+        double z = cos(PI * uniform(stream));
+        f = (1.0 + r * z) / (r + z);
+        double c = kappa * (r - f);
+        double u2 = uniform(stream);
+        if (u2 <= c * (2.0 - c) || u2 < c * exp(1.0 - c))
+            break;
+    }
+    if (uniform(stream) > 0.5)
+        return fmod(mu + acos(f), 2 * PI);
+    return fmod(mu - acos(f), 2 * PI);
+}
+
+__device__ inline void to_offset(const DeviceKernel& kernel, double dist,
+                                 double theta, int& drow, int& dcol)
+{
+    // avoid integer overflow, it is far outside of any grid anyway
+    dist = fmin(dist, 1e9);
+    drow = -round(dist * cos(theta) / kernel.n_s_res);
+    dcol = round(dist * sin(theta) / kernel.w_e_res);
+}
+
+// the same as DistributionDispersal and DispersalTable
+__device__ void disperse(CounterStream& stream, const DeviceKernel& kernel,
+                         int& drow, int& dcol)
+{
+    if (kernel.table_size) {
+        double x = uniform(stream) * kernel.table_size;
+        unsigned i = min(unsigned(x), kernel.table_size - 1);
+        if (x - i >= kernel.probability[i])
+            i = kernel.alias[i];
+        if (i + 1 < kernel.table_size) {
+            drow = kernel.rows[i];
+            dcol = kernel.cols[i];
+            return;
+        }
+        // inversion of the half-Cauchy distribution limited to the tail
+        double scale = kernel.scale1;
+        if (kernel.rtype == CAUCHY_MIX
+                && uniform(stream) >= kernel.escape_share1)
+            scale = kernel.scale2;
+        double start = 2 / PI * atan(kernel.max_distance / scale);
+        double u = start + (1 - start) * uniform(stream);
+        double theta = von_mises(stream, kernel.mu, kernel.kappa);
+        to_offset(kernel, scale * tan(PI / 2 * u), theta, drow, dcol);
+        return;
+    }
+    double scale = kernel.scale1;
+    if (kernel.rtype == CAUCHY_MIX && !(uniform(stream) < kernel.gamma))
+        scale = kernel.scale2;
+    // absolute value of a Cauchy variate
+    double dist = scale * tan(PI / 2 * uniform(stream));
+    double theta;
+    if (kernel.wind)
+        theta = von_mises(stream, kernel.mu, kernel.kappa);
+    else
+        theta = 2 * PI * uniform(stream);
+    to_offset(kernel, dist, theta, drow, dcol);
+}
+
+// current value of a number changed by other threads
+__device__ inline int load(const int *value)
+{
+    return *static_cast<const volatile int *>(value);
+}
+
+// removes one tree from the cell if there is any left
+__device__ inline bool take(int *trees)
+{
+    int old = load(trees);
+    while (old > 0) {
+        int seen = atomicCAS(trees, old, old - 1);
+        if (seen == old)
+            return true;
+        old = seen;
+    }
+    return false;
+}
+
+// one thread for each cell (x) and run (y)
+__global__ void spore_gen(int cells, const RunStep *runs, const int *I_umca,
+                          int *spores, DeviceWeather weather, double rate)
+{
+    int cell = blockIdx.x * blockDim.x + threadIdx.x;
+    if (cell >= cells)
+        return;
+    const RunStep run = runs[blockIdx.y];
+    size_t index = size_t(blockIdx.y) * cells + cell;
+    int infected = I_umca[index];
+    if (!run.active || infected <= 0) {
+        spores[index] = 0;
+        return;
+    }
+    CounterStream stream(run.seed, run.step, cell, 0);
+    // the sum of the Poisson numbers of the trees is Poisson
+    spores[index] = poisson(stream, infected * rate
+                            * weather_at(weather, cell));
+}
+
+// spores of one cell (x) of one run (y) land and infect the hosts,
+// the probabilities are the same as in Sporulation::SporeSpreadDisp
+__global__ void spread(int width, int height, const RunStep *runs,
+                       const int *spores, int *S_umca, int *S_oaks,
+                       int *I_umca, int *I_oaks, const int *lvtree,
+                       DeviceWeather weather, DeviceKernel kernel)
+{
+    int cells = width * height;
+    int cell = blockIdx.x * blockDim.x + threadIdx.x;
+    if (cell >= cells)
+        return;
+    size_t offset = size_t(blockIdx.y) * cells;
+    int count = spores[offset + cell];
+    if (count <= 0)
+        return;
+    const RunStep run = runs[blockIdx.y];
+    CounterStream stream(run.seed, run.step, cell, 1);
+    int i = cell / width;
+    int j = cell % width;
+    for (int k = 0; k < count; k++) {
+        int drow;
+        int dcol;
+        disperse(stream, kernel, drow, dcol);
+        int row = i + drow;
+        int col = j + dcol;
+        if (row < 0 || row >= height || col < 0 || col >= width)
+            continue;
+        int target = row * width + col;
+        size_t index = offset + target;
+        int umca = load(&S_umca[index]);
+        if (target == cell) {
+            int oaks = load(&S_oaks[index]);
+            if (umca <= 0 && oaks <= 0)
+                continue;
+            double prob = double(umca + oaks) / lvtree[target]
+                    * weather_at(weather, target);
+            if (!(uniform(stream) < prob))
+                continue;
+            if (uniform(stream) < double(umca) / (umca + oaks)) {
+                if (take(&S_umca[index]))
+                    atomicAdd(&I_umca[index], 1);
+            }
+            else if (take(&S_oaks[index])) {
+                atomicAdd(&I_oaks[index], 1);
+            }
+        }
+        else {
+            if (umca <= 0)
+                continue;
+            double prob = double(umca) / lvtree[target]
+                    * weather_at(weather, target);
+            if (uniform(stream) < prob && take(&S_umca[index]))
+                atomicAdd(&I_umca[index], 1);
+        }
+    }
+}
+
+// numbers of hosts of each run (y), the totals must be zero before
+__global__ void count_hosts(int cells, const int *S_umca, const int *S_oaks,
+                            const int *I_umca, const int *I_oaks,
+                            unsigned long long *totals)
+{
+    unsigned long long sums[NUM_TOTALS] = {0, 0, 0, 0, 0};
+    size_t offset = size_t(blockIdx.y) * cells;
+    for (int cell = blockIdx.x * blockDim.x + threadIdx.x; cell < cells;
+         cell += gridDim.x * blockDim.x) {
+        size_t index = offset + cell;
+        sums[TOTAL_S_UMCA] += S_umca[index];
+        sums[TOTAL_S_OAKS] += S_oaks[index];
+        sums[TOTAL_I_UMCA] += I_umca[index];
+        sums[TOTAL_I_OAKS] += I_oaks[index];
+        if (I_umca[index] > 0)
+            sums[TOTAL_EXPOSED] += S_oaks[index];
+    }
+    for (int total = 0; total < NUM_TOTALS; total++)
+        if (sums[total])
+            atomicAdd(&totals[blockIdx.y * NUM_TOTALS + total],
+                      sums[total]);
+}
+
+// sums of the infected oaks over all runs for each cell,
+// the same values as RasterSums::add for each run
+__global__ void sum_runs(int cells, unsigned runs, const int *I_oaks,
+                         long long *sums, long long *squares,
+                         unsigned *positives)
+{
+    int cell = blockIdx.x * blockDim.x + threadIdx.x;
+    if (cell >= cells)
+        return;
+    long long sum = 0;
+    long long square = 0;
+    unsigned positive = 0;
+    for (unsigned run = 0; run < runs; run++) {
+        long long value = I_oaks[size_t(run) * cells + cell];
+        sum += value;
+        square += value * value;
+        if (value > 0)
+            ++positive;
+    }
+    sums[cell] = sum;
+    squares[cell] = square;
+    positives[cell] = positive;
+}
+
+DeviceDispersal::DeviceDispersal(Rtype rtype, double scale1, double scale2,
+                                 double gamma, double kappa,
+                                 Direction wdir, int w_e_res, int n_s_res)
+    :
+      rtype(rtype),
+      wind(wdir != NONE),
+      scale1(scale1),
+      scale2(scale2),
+      gamma(gamma),
+      mu(wdir * PI / 180),
+      kappa(kappa),
+      w_e_res(w_e_res),
+      n_s_res(n_s_res),
+      max_distance(0),
+      escape_share1(1)
+{
+    if (rtype == CAUCHY_MIX && (gamma >= 1 || gamma <= 0))
+        throw std::invalid_argument("The parameter gamma must be"
+                                    " in the range (0~1)");
+}
+
+DeviceDispersal::DeviceDispersal(const DispersalTable& table)
+    :
+      rtype(table.rtype),
+      wind(table.kappa > 0),
+      scale1(table.scale1),
+      scale2(table.scale2),
+      gamma(table.gamma),
+      mu(table.mu),
+      kappa(table.kappa),
+      w_e_res(table.w_e_res),
+      n_s_res(table.n_s_res),
+      max_distance(table.max_distance),
+      escape_share1(table.escape_share1),
+      rows(table.rows),
+      cols(table.cols),
+      probability(table.probability),
+      alias(table.alias)
+{}
+
+struct DeviceEnsemble::Buffers
+{
+    DeviceArray<int> S_umca;
+    DeviceArray<int> S_oaks;
+    DeviceArray<int> I_umca;
+    DeviceArray<int> I_oaks;
+    DeviceArray<int> lvtree;
+    DeviceArray<int> spores;
+    DeviceArray<RunStep> runs;
+    DeviceArray<unsigned char> weather;
+    DeviceArray<unsigned> weather_index;
+    DeviceArray<int> rows;
+    DeviceArray<int> cols;
+    DeviceArray<double> probability;
+    DeviceArray<unsigned> alias;
+    DeviceArray<unsigned long long> totals;
+    DeviceArray<long long> sums;
+    DeviceArray<long long> squares;
+    DeviceArray<unsigned> positives;
+    DeviceKernel kernel;
+};
+
+// the same initial raster for each run
+static void assign_runs(DeviceArray<int>& array, const Img& image,
+                        unsigned runs)
+{
+    size_t cells = size_t(image.getWidth()) * image.getHeight();
+    array.allocate(runs * cells);
+    for (unsigned run = 0; run < runs; run++)
+        array.upload(&image(0, 0), cells, run * cells);
+}
+
+DeviceEnsemble::DeviceEnsemble(unsigned runs, const Img& S_umca,
+                               const Img& S_oaks, const Img& I_umca,
+                               const Img& I_oaks, const Img& lvtree,
+                               const WeatherFormat& weather,
+                               const DeviceDispersal& dispersal,
+                               double spore_rate)
+    :
+      num_runs(runs),
+      width(lvtree.getWidth()),
+      height(lvtree.getHeight()),
+      w_e_res(lvtree.getWEResolution()),
+      n_s_res(lvtree.getNSResolution()),
+      weather_format(weather),
+      weather_bytes(0),
+      spore_rate(spore_rate),
+      steps(runs, 0),
+      buffers(new Buffers)
+{
+    size_t cells = size_t(width) * height;
+    assign_runs(buffers->S_umca, S_umca, runs);
+    assign_runs(buffers->S_oaks, S_oaks, runs);
+    assign_runs(buffers->I_umca, I_umca, runs);
+    assign_runs(buffers->I_oaks, I_oaks, runs);
+    buffers->lvtree.assign(&lvtree(0, 0), cells);
+    buffers->spores.allocate(runs * cells);
+    buffers->runs.allocate(runs);
+    buffers->totals.allocate(runs * NUM_TOTALS);
+    buffers->sums.allocate(cells);
+    buffers->squares.allocate(cells);
+    buffers->positives.allocate(cells);
+
+    if (weather.spatial) {
+        size_t weather_cells = cells;
+        if (weather.index) {
+            const std::vector<unsigned>& index = *weather.index;
+            buffers->weather_index.assign(index.data(), index.size());
+            weather_cells = *std::max_element(index.begin(), index.end())
+                    + size_t(1);
+        }
+        size_t code_size = sizeof(float);
+        if (weather.code == WEATHER_UINT8)
+            code_size = sizeof(uint8_t);
+        else if (weather.code == WEATHER_UINT16)
+            code_size = sizeof(uint16_t);
+        weather_bytes = weather_cells * code_size;
+        buffers->weather.allocate(weather_bytes);
+    }
+
+    DeviceKernel& kernel = buffers->kernel;
+    kernel.rtype = dispersal.rtype;
+    kernel.wind = dispersal.wind;
+    kernel.scale1 = dispersal.scale1;
+    kernel.scale2 = dispersal.scale2;
+    kernel.gamma = dispersal.gamma;
+    kernel.mu = dispersal.mu;
+    kernel.kappa = dispersal.kappa;
+    kernel.w_e_res = dispersal.w_e_res;
+    kernel.n_s_res = dispersal.n_s_res;
+    kernel.max_distance = dispersal.max_distance;
+    kernel.escape_share1 = dispersal.escape_share1;
+    kernel.table_size = dispersal.probability.size();
+    buffers->rows.assign(dispersal.rows.data(), dispersal.rows.size());
+    buffers->cols.assign(dispersal.cols.data(), dispersal.cols.size());
+    buffers->probability.assign(dispersal.probability.data(),
+                                dispersal.probability.size());
+    buffers->alias.assign(dispersal.alias.data(), dispersal.alias.size());
+    kernel.rows = buffers->rows.data();
+    kernel.cols = buffers->cols.data();
+    kernel.probability = buffers->probability.data();
+    kernel.alias = buffers->alias.data();
+}
+
+DeviceEnsemble::~DeviceEnsemble() {}
+
+void DeviceEnsemble::step(const std::vector<unsigned>& seeds,
+                          const std::vector<char>& active,
+                          const void *weather, double weather_value)
+{
+    std::vector<RunStep> runs(num_runs);
+    for (unsigned run = 0; run < num_runs; run++) {
+        runs[run].seed = seeds[run];
+        runs[run].step = steps[run];
+        runs[run].active = active[run];
+        if (active[run])
+            ++steps[run];
+    }
+    buffers->runs.upload(runs.data(), num_runs);
+
+    DeviceWeather week;
+    week.spatial = weather_format.spatial;
+    week.code = weather_format.code;
+    week.scale = weather_format.scale;
+    week.offset = weather_format.offset;
+    week.value = weather_value;
+    week.values = nullptr;
+    week.index = buffers->weather_index.data();
+    if (weather_format.spatial) {
+        buffers->weather.upload(static_cast<const unsigned char *>(weather),
+                                weather_bytes);
+        week.values = buffers->weather.data();
+    }
+
+    int cells = width * height;
+    dim3 grid((cells + block_size - 1) / block_size, num_runs);
+    spore_gen<<<grid, block_size>>>(cells, buffers->runs.data(),
+                                    buffers->I_umca.data(),
+                                    buffers->spores.data(), week,
+                                    spore_rate);
+    check(cudaGetLastError(), "SporeGen");
+    // new infections of the week are not producing spores in it
+    // (as in SporeSpreadDisp), the spores of all cells are known now
+    spread<<<grid, block_size>>>(width, height, buffers->runs.data(),
+                                 buffers->spores.data(),
+                                 buffers->S_umca.data(),
+                                 buffers->S_oaks.data(),
+                                 buffers->I_umca.data(),
+                                 buffers->I_oaks.data(),
+                                 buffers->lvtree.data(), week,
+                                 buffers->kernel);
+    check(cudaGetLastError(), "SporeSpreadDisp");
+}
+
+std::vector<HostTotals> DeviceEnsemble::totals() const
+{
+    int cells = width * height;
+    buffers->totals.zero();
+    dim3 grid(std::min(count_blocks, (cells + block_size - 1) / block_size),
+              num_runs);
+    count_hosts<<<grid, block_size>>>(cells, buffers->S_umca.data(),
+                                      buffers->S_oaks.data(),
+                                      buffers->I_umca.data(),
+                                      buffers->I_oaks.data(),
+                                      buffers->totals.data());
+    check(cudaGetLastError(), "counting hosts");
+    std::vector<unsigned long long> values(num_runs * NUM_TOTALS);
+    buffers->totals.download(values.data(), values.size());
+    std::vector<HostTotals> totals(num_runs);
+    for (unsigned run = 0; run < num_runs; run++) {
+        const unsigned long long *run_values = &values[run * NUM_TOTALS];
+        totals[run].S_umca = run_values[TOTAL_S_UMCA];
+        totals[run].S_oaks = run_values[TOTAL_S_OAKS];
+        totals[run].I_umca = run_values[TOTAL_I_UMCA];
+        totals[run].I_oaks = run_values[TOTAL_I_OAKS];
+        totals[run].exposed_S_oaks = run_values[TOTAL_EXPOSED];
+    }
+    return totals;
+}
+
+void DeviceEnsemble::infected_oaks(RasterSums& sums) const
+{
+    int cells = width * height;
+    sum_runs<<<(cells + block_size - 1) / block_size, block_size>>>(
+            cells, num_runs, buffers->I_oaks.data(), buffers->sums.data(),
+            buffers->squares.data(), buffers->positives.data());
+    check(cudaGetLastError(), "statistics");
+    AlignedVector<int64_t> run_sums(cells);
+    AlignedVector<int64_t> run_squares(cells);
+    AlignedVector<unsigned> run_positives(cells);
+    static_assert(sizeof(int64_t) == sizeof(long long),
+                  "Sums are copied as 64-bit integers");
+    buffers->sums.download(reinterpret_cast<long long *>(run_sums.data()),
+                           cells);
+    buffers->squares.download(
+                reinterpret_cast<long long *>(run_squares.data()), cells);
+    buffers->positives.download(run_positives.data(), cells);
+    sums.assign(width, height, num_runs, std::move(run_sums),
+                std::move(run_squares), std::move(run_positives));
+}
+
+void DeviceEnsemble::infected(unsigned run, std::vector<int>& I_umca,
+                              std::vector<int>& I_oaks) const
+{
+    size_t cells = size_t(width) * height;
+    I_umca.resize(cells);
+    I_oaks.resize(cells);
+    buffers->I_umca.download(I_umca.data(), cells, run * cells);
+    buffers->I_oaks.download(I_oaks.data(), cells, run * cells);
+}
+
+void DeviceEnsemble::write(unsigned run, std::ostream& stream) const
+{
+    size_t cells = size_t(width) * height;
+    std::vector<int> layer(cells);
+    for (const DeviceArray<int> *array : {&buffers->S_umca, &buffers->S_oaks,
+                                          &buffers->I_umca,
+                                          &buffers->I_oaks}) {
+        array->download(layer.data(), cells, run * cells);
+        write_vector(stream, layer);
+    }
+    write_value(stream, steps[run]);
+}
+
+void DeviceEnsemble::read(unsigned run, std::istream& stream)
+{
+    size_t cells = size_t(width) * height;
+    std::vector<int> layer;
+    for (DeviceArray<int> *array : {&buffers->S_umca, &buffers->S_oaks,
+                                    &buffers->I_umca, &buffers->I_oaks}) {
+        read_vector(stream, layer);
+        if (layer.size() != cells)
+            throw std::runtime_error("The state of a run does not match"
+                                     " the size of the rasters");
+        array->upload(layer.data(), cells, run * cells);
+    }
+    read_value(stream, steps[run]);
+}
@@ -0,0 +1,135 @@
+/*
+ * SOD model - stochastic runs simulated on a GPU
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef DEVICE_ENSEMBLE_H
+#define DEVICE_ENSEMBLE_H
+
+#include "Img.h"
+#include "Dispersal.h"
+#include "Weather.h"
+#include "Spore.h"
+#include "Statistics.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+/* Dispersal kernel in the form which is copied to the device
+ *
+ * Either the parameters of the distributions or the kernel table
+ * (the table is empty when the distributions are sampled).
+ */
+struct DeviceDispersal
+{
+    Rtype rtype;
+    bool wind;
+    double scale1;
+    double scale2;
+    double gamma;
+    double mu;
+    double kappa;
+    int w_e_res;
+    int n_s_res;
+    // tail of the distributions beyond the table
+    double max_distance;
+    double escape_share1;
+    std::vector<int> rows;
+    std::vector<int> cols;
+    std::vector<double> probability;
+    std::vector<unsigned> alias;
+
+    // throws invalid_argument for invalid parameters
+    // (as DistributionDispersal)
+    DeviceDispersal(Rtype rtype, double scale1, double scale2,
+                    double gamma, double kappa, Direction wdir,
+                    int w_e_res, int n_s_res);
+    explicit DeviceDispersal(const DispersalTable& table);
+};
+
+/* State of all runs of an ensemble in the memory of a GPU
+ *
+ * The S and I rasters of each run stay on the device for the whole
+ * simulation, only the weather coefficients of each week go there
+ * and only the numbers of hosts of each run (a few numbers) and
+ * the sums of infected oaks over the runs (for the statistics) come
+ * back. In each week, all runs are computed at once:
+ *
+ * - SporeGen: the spores of each cell, one thread per cell and run,
+ * - SporeSpreadDisp: dispersal and infection of the spores of a cell
+ *   by one thread, the susceptible trees are taken atomically,
+ * - the numbers of hosts of each run.
+ *
+ * The random numbers are from counter-based streams (Philox) for each
+ * run, week, cell and kernel, so they do not depend on the order of
+ * the threads. The model is the same as in Sporulation, which stays
+ * the reference implementation, but the random numbers are not, so
+ * the runs are not the same as with the CPU backend. When spores from
+ * several cells hit the same cell together, the order of their
+ * infections depends on the scheduling of the threads.
+ *
+ * The spores of a cell are always dispersed one by one (sampling the
+ * table if provided); this has the same distribution as BinnedDispersal.
+ */
+class DeviceEnsemble
+{
+public:
+    // the rasters are the initial state of each run,
+    // throws runtime_error when the device fails
+    DeviceEnsemble(unsigned runs, const Img& S_umca, const Img& S_oaks,
+                   const Img& I_umca, const Img& I_oaks, const Img& lvtree,
+                   const WeatherFormat& weather,
+                   const DeviceDispersal& dispersal, double spore_rate);
+    ~DeviceEnsemble();
+    DeviceEnsemble(const DeviceEnsemble&) = delete;
+    DeviceEnsemble& operator=(const DeviceEnsemble&) = delete;
+
+    // simulate one week of the runs with active set to true, the seeds
+    // are the keys of the random numbers of each run, the weather is
+    // the same as for Ensemble::step
+    void step(const std::vector<unsigned>& seeds,
+              const std::vector<char>& active, const void *weather,
+              double weather_value);
+    // numbers of hosts in each run
+    std::vector<HostTotals> totals() const;
+    // sums of infected oaks over all runs
+    void infected_oaks(RasterSums& sums) const;
+    // infected trees in the cells of one run
+    void infected(unsigned run, std::vector<int>& I_umca,
+                  std::vector<int>& I_oaks) const;
+
+    // binary state of one run (for checkpoints)
+    void write(unsigned run, std::ostream& stream) const;
+    void read(unsigned run, std::istream& stream);
+
+private:
+    struct Buffers;
+    unsigned num_runs;
+    int width;
+    int height;
+    int w_e_res;
+    int n_s_res;
+    WeatherFormat weather_format;
+    // stored weather coefficients of a week
+    size_t weather_bytes;
+    double spore_rate;
+    // weeks simulated by each run (counter of its random numbers)
+    std::vector<uint32_t> steps;
+    std::unique_ptr<Buffers> buffers;
+};
+
+#endif
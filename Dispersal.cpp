@@ -0,0 +1,177 @@
+/*
+ * SOD model - spore dispersal
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Dispersal.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+// directions per cell at the radius for the integration
+static const int oversampling = 10;
+
+DispersalTable::DispersalTable(Rtype rtype, double scale1, double scale2,
+                               double gamma, double kappa, Direction wdir,
+                               int w_e_res, int n_s_res, int radius)
+    :
+      rtype(rtype),
+      scale1(scale1),
+      scale2(scale2),
+      gamma(gamma),
+      mu(wdir * PI / 180),
+      kappa(wdir == NONE ? 0 : kappa),
+      w_e_res(w_e_res),
+      n_s_res(n_s_res),
+      max_distance(radius * std::min(w_e_res, n_s_res)),
+      escape_share1(1),
+      directions(mu, this->kappa)
+{
+    if (rtype == CAUCHY_MIX && (gamma >= 1 || gamma <= 0))
+        throw std::invalid_argument("The parameter gamma must be"
+                                    " in the range (0~1)");
+    if (radius < 1)
+        throw std::invalid_argument("The radius of the dispersal table"
+                                    " must be at least one cell");
+
+    // direction probabilities (the same for all distances)
+    int angular_bins = std::max(3600, int(std::ceil(2 * PI * radius
+                                                    * oversampling)));
+    double angle_step = 2 * PI / angular_bins;
+    std::vector<double> angle_mass(angular_bins);
+    double angle_sum = 0;
+    for (int k = 0; k < angular_bins; k++) {
+        double theta = (k + 0.5) * angle_step;
+        angle_mass[k] = std::exp(this->kappa * (std::cos(theta - mu) - 1));
+        angle_sum += angle_mass[k];
+    }
+
+    // follow each direction through the cells, the distance
+    // probability between the cell borders is known exactly
+    int side = 2 * radius + 1;
+    std::vector<double> cell_mass(side * side, 0);
+    std::vector<double> borders;
+    for (int k = 0; k < angular_bins; k++) {
+        double theta = (k + 0.5) * angle_step;
+        double c = std::cos(theta);
+        double s = std::sin(theta);
+        // the cell changes when distance * cos / res crosses half
+        borders.clear();
+        for (int m = 0; std::abs(c) > 0; m++) {
+            double dist = (m + 0.5) * n_s_res / std::abs(c);
+            if (dist >= max_distance)
+                break;
+            borders.push_back(dist);
+        }
+        for (int m = 0; std::abs(s) > 0; m++) {
+            double dist = (m + 0.5) * w_e_res / std::abs(s);
+            if (dist >= max_distance)
+                break;
+            borders.push_back(dist);
+        }
+        borders.push_back(max_distance);
+        std::sort(borders.begin(), borders.end());
+        double weight = angle_mass[k] / angle_sum;
+        double previous = 0;
+        for (auto border : borders) {
+            double dist = (previous + border) / 2;
+            int drow = -round(dist * c / n_s_res);
+            int dcol = round(dist * s / w_e_res);
+            cell_mass[(drow + radius) * side + dcol + radius]
+                    += weight * (radial_cdf(border) - radial_cdf(previous));
+            previous = border;
+        }
+    }
+    escape = 1 - radial_cdf(max_distance);
+    if (rtype == CAUCHY_MIX && escape > 0)
+        escape_share1 = gamma * (1 - 2 / PI * std::atan(max_distance / scale1))
+                / escape;
+
+    std::vector<double> masses;
+    for (int drow = -radius; drow <= radius; drow++) {
+        for (int dcol = -radius; dcol <= radius; dcol++) {
+            double mass = cell_mass[(drow + radius) * side + dcol + radius];
+            if (mass > 0) {
+                rows.push_back(drow);
+                cols.push_back(dcol);
+                masses.push_back(mass);
+            }
+        }
+    }
+    masses.push_back(escape);
+
+    // the most probable items first, so that split usually ends
+    // after a few of them
+    by_probability.resize(masses.size());
+    for (unsigned i = 0; i < masses.size(); i++)
+        by_probability[i] = i;
+    std::stable_sort(by_probability.begin(), by_probability.end(),
+                     [&masses](unsigned a, unsigned b) {
+                         return masses[a] > masses[b];
+                     });
+    conditional.resize(masses.size());
+    double rest = 0;
+    for (size_t k = masses.size(); k-- > 0; ) {
+        double mass = masses[by_probability[k]];
+        rest += mass;
+        conditional[k] = rest > 0 ? std::min(1.0, mass / rest) : 1;
+    }
+    conditional.back() = 1;
+    split_threshold = std::max(16, int(masses.size()) / 4);
+
+    // alias table (Vose's method)
+    unsigned n = masses.size();
+    double total = 0;
+    for (auto mass : masses)
+        total += mass;
+    std::vector<double> scaled(n);
+    std::vector<unsigned> small;
+    std::vector<unsigned> large;
+    for (unsigned i = 0; i < n; i++) {
+        scaled[i] = masses[i] * n / total;
+        if (scaled[i] < 1)
+            small.push_back(i);
+        else
+            large.push_back(i);
+    }
+    probability.assign(n, 1);
+    alias.resize(n);
+    for (unsigned i = 0; i < n; i++)
+        alias[i] = i;
+    while (!small.empty() && !large.empty()) {
+        unsigned less = small.back();
+        small.pop_back();
+        unsigned more = large.back();
+        large.pop_back();
+        probability[less] = scaled[less];
+        alias[less] = more;
+        scaled[more] = scaled[more] + scaled[less] - 1;
+        if (scaled[more] < 1)
+            small.push_back(more);
+        else
+            large.push_back(more);
+    }
+    // the rest is 1 up to rounding errors
+}
+
+double DispersalTable::radial_cdf(double distance) const
+{
+    // CDF of the absolute value of Cauchy is 2 / pi * atan(x / scale)
+    double first = 2 / PI * std::atan(distance / scale1);
+    if (rtype == CAUCHY)
+        return first;
+    double second = 2 / PI * std::atan(distance / scale2);
+    return gamma * first + (1 - gamma) * second;
+}
@@ -0,0 +1,358 @@
+/*
+ * SOD model - spore dispersal
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef DISPERSAL_H
+#define DISPERSAL_H
+
+#include "Img.h"
+#include "Samplers.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+// PI is used in the code and M_PI is not guaranteed
+// fix it, but prefer the system definition
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+#ifndef PI
+    #define PI M_PI
+#endif
+
+
+/*
+Von Mises Distribution(Circular data distribution)
+
+mu is the mean angle, expressed in radians between 0 and 2*pi,
+and kappa is the concentration parameter, which must be greater
+than or equal to zero. If kappa is equal to zero, this distribution
+reduces to a uniform random angle over the range 0 to 2*pi
+*/
+class von_mises_distribution
+{
+public:
+    von_mises_distribution(double mu, double kappa)
+        : mu(mu), kappa(kappa), distribution(0.0, 1.0)
+    {}
+    template<class Generator>
+    double operator ()(Generator& generator)
+    {
+        double a, b, c, f, r, theta, u1, u2, u3, z;
+
+        if (kappa <= 1.e-06)
+            return 2 * PI * distribution(generator);
+
+        a = 1.0 + sqrt(1.0 + 4.0 * kappa * kappa);
+        b = (a - sqrt(2.0 * a)) / (2.0 * kappa);
+        r = (1.0 + b * b) / (2.0 * b);
+
+        while (true) {
+            u1 = distribution(generator);
+            z = cos(PI * u1);
+            f = (1.0 + r * z) / (r + z);
+            c = kappa * (r - f);
+            u2 = distribution(generator);
+            if (u2 <= c * (2.0 - c) || u2 < c * exp(1.0 - c))
+                break;
+        }
+
+        u3 = distribution(generator);
+        if (u3 > 0.5) {
+            theta = fmod(mu + acos(f), 2 * PI);
+        }
+        else {
+            theta = fmod(mu - acos(f), 2 * PI);
+        }
+        return theta;
+    }
+private:
+    double mu;
+    double kappa;
+    std::uniform_real_distribution<double> distribution;
+};
+
+enum Rtype
+{
+    CAUCHY, CAUCHY_MIX          // NO means that there is no wind
+};
+
+/* Dispersal sampled from the continuous distributions
+ *
+ * The radial type and the presence of wind are template parameters,
+ * so the sampling for one spore has no branches on them. The parameters
+ * are checked once in the constructor. The object has no state and can
+ * be used from multiple threads (as DispersalTable).
+ */
+template<Rtype rtype, bool wind>
+class DistributionDispersal
+{
+private:
+    double scale1;
+    double scale2;
+    double gamma;
+    double mu;
+    double kappa;
+    int w_e_res;
+    int n_s_res;
+    // directions for the fast samplers
+    VonMisesTable directions;
+public:
+    DistributionDispersal(double scale1, double scale2, double gamma,
+                          double kappa, Direction wdir,
+                          int w_e_res, int n_s_res)
+        :
+          scale1(scale1),
+          scale2(scale2),
+          gamma(gamma),
+          mu(wdir * PI / 180),
+          kappa(kappa),
+          w_e_res(w_e_res),
+          n_s_res(n_s_res),
+          directions(wind ? VonMisesTable(mu, kappa) : VonMisesTable())
+    {
+        if (rtype == CAUCHY_MIX && (gamma >= 1 || gamma <= 0))
+            throw std::invalid_argument("The parameter gamma must be"
+                                        " in the range (0~1)");
+        if (wind && wdir == NONE)
+            throw std::invalid_argument("Wind direction required"
+                                        " for dispersal with wind");
+    }
+
+    // sample an offset from the source cell
+    template<class Generator>
+    void operator()(Generator& generator, int& drow, int& dcol) const
+    {
+        typedef Samplers<Generator> Sampling;
+        double dist;
+        // use bernoulli distribution to act as the sampling with prob(gamma,1-gamma)
+        if (rtype == CAUCHY_MIX
+                && !typename Sampling::Bernoulli(gamma)(generator))
+            dist = typename Sampling::HalfCauchy(scale2)(generator);
+        else
+            dist = typename Sampling::HalfCauchy(scale1)(generator);
+        double theta;
+        if (wind) {
+            if (Sampling::is_fast)
+                theta = directions(open_uniform(generator));
+            else
+                theta = von_mises_distribution(mu, kappa)(generator);
+        }
+        else {
+            // von Mises distribution with zero kappa
+            typename Sampling::Uniform distribution(0.0, 1.0);
+            theta = 2 * PI * distribution(generator);
+        }
+        drow = -round(dist * cos(theta) / n_s_res);
+        dcol = round(dist * sin(theta) / w_e_res);
+    }
+};
+
+struct DeviceDispersal;
+
+/* Discretized dispersal kernel
+ *
+ * Probabilities of landing at each cell offset (drow, dcol) from
+ * the source cell up to the given radius (in cells) sampled using
+ * the alias method, i.e., using one uniform random number per spore.
+ * Spores which go farther than the radius (the escape probability)
+ * get their distance from the tail of the radial distribution
+ * and their direction from the von Mises distribution.
+ *
+ * The probabilities are integrated exactly in distance (the cell
+ * borders are found along each direction) and numerically in direction
+ * with at least 3600 directions and ten directions per cell at the
+ * radius. With this, the difference from sampling the continuous
+ * distributions is in the order of 1e-4 or less for each cell.
+ */
+class DispersalTable
+{
+private:
+    // the table is copied to the device by the CUDA backend
+    friend struct DeviceDispersal;
+    Rtype rtype;
+    double scale1;
+    double scale2;
+    double gamma;
+    double mu;
+    double kappa;
+    int w_e_res;
+    int n_s_res;
+    double max_distance;
+    double escape;
+    // probability of the first Cauchy distribution for escaped spores
+    double escape_share1;
+    // offsets of the table items, the last item is for the escape
+    std::vector<int> rows;
+    std::vector<int> cols;
+    std::vector<double> probability;
+    std::vector<unsigned> alias;
+    // items by decreasing probability and the probability of each
+    // given that the spore is not in the previous ones (for split)
+    std::vector<unsigned> by_probability;
+    std::vector<double> conditional;
+    // fewer spores are sampled one by one in split
+    int split_threshold;
+    // directions of the escaped spores for the fast samplers
+    VonMisesTable directions;
+    double radial_cdf(double distance) const;
+    template<class Generator>
+    void escaped(Generator& generator, int& drow, int& dcol) const;
+public:
+    DispersalTable(Rtype rtype, double scale1, double scale2,
+                   double gamma, double kappa, Direction wdir,
+                   int w_e_res, int n_s_res, int radius);
+
+    // number of items in the table including the escape item
+    unsigned size() const
+    {
+        return probability.size();
+    }
+
+    double escape_probability() const
+    {
+        return escape;
+    }
+
+    // sample an offset from the source cell
+    template<class Generator>
+    void operator()(Generator& generator, int& drow, int& dcol) const
+    {
+        typename Samplers<Generator>::Uniform distribution(0.0, 1.0);
+        double x = distribution(generator) * probability.size();
+        unsigned i = std::min(unsigned(x), unsigned(probability.size() - 1));
+        if (x - i >= probability[i])
+            i = alias[i];
+        if (i + 1 == probability.size()) {
+            escaped(generator, drow, dcol);
+            return;
+        }
+        drow = rows[i];
+        dcol = cols[i];
+    }
+
+    // numbers of the given spores which land at each offset
+    // (multinomial distribution), calls landed(drow, dcol, spores)
+    // for each offset with at least one spore, escaped spores
+    // and small numbers of spores are sampled one by one
+    template<class Generator, class Function>
+    void split(Generator& generator, int spores, Function landed) const;
+};
+
+/* Dispersal of all spores from a cell at once
+ *
+ * The spores are split between the offsets of the table instead of
+ * being sampled one by one, and Sporulation draws the infections
+ * in each destination cell for the spores together, so the random
+ * numbers scale with the number of destinations and infections
+ * rather than with the number of spores. The distribution of the
+ * result is the same as with the table used for each spore.
+ */
+class BinnedDispersal
+{
+private:
+    std::shared_ptr<const DispersalTable> table;
+public:
+    explicit BinnedDispersal(std::shared_ptr<const DispersalTable> table)
+        : table(table)
+    {}
+
+    // sample an offset for one spore (used in the tiled mode)
+    template<class Generator>
+    void operator()(Generator& generator, int& drow, int& dcol) const
+    {
+        (*table)(generator, drow, dcol);
+    }
+
+    // all spores of a cell, see DispersalTable::split()
+    template<class Generator, class Function>
+    void split(Generator& generator, int spores, Function landed) const
+    {
+        table->split(generator, spores, landed);
+    }
+};
+
+template<class Generator, class Function>
+void DispersalTable::split(Generator& generator, int spores,
+                           Function landed) const
+{
+    int drow;
+    int dcol;
+    if (spores < split_threshold) {
+        for (int k = 0; k < spores; k++) {
+            (*this)(generator, drow, dcol);
+            landed(drow, dcol, 1);
+        }
+        return;
+    }
+    // binomial draw for each item from the spores left by the previous
+    for (size_t k = 0; k < by_probability.size() && spores > 0; k++) {
+        int count = spores;
+        if (conditional[k] < 1)
+            count = std::binomial_distribution<int>(
+                        spores, conditional[k])(generator);
+        if (!count)
+            continue;
+        spores -= count;
+        unsigned i = by_probability[k];
+        if (i + 1 == probability.size()) {
+            for (int e = 0; e < count; e++) {
+                escaped(generator, drow, dcol);
+                landed(drow, dcol, 1);
+            }
+        }
+        else {
+            landed(rows[i], cols[i], count);
+        }
+    }
+}
+
+template<class Generator>
+void DispersalTable::escaped(Generator& generator, int& drow,
+                             int& dcol) const
+{
+    typedef Samplers<Generator> Sampling;
+    typename Sampling::Uniform distribution(0.0, 1.0);
+    double scale = scale1;
+    if (rtype == CAUCHY_MIX && distribution(generator) >= escape_share1)
+        scale = scale2;
+    // inversion of the half-Cauchy distribution limited to the tail
+    double start = 2 / PI * std::atan(max_distance / scale);
+    double u = start + (1 - start) * distribution(generator);
+    double dist;
+    if (Sampling::is_fast)
+        dist = scale * tan_half_pi(u);
+    else
+        dist = scale * std::tan(PI / 2 * u);
+    // avoid integer overflow, it is far outside of any grid anyway
+    dist = std::min(dist, 1e9);
+    double theta;
+    if (Sampling::is_fast) {
+        theta = directions(open_uniform(generator));
+    }
+    else {
+        von_mises_distribution vonmisesvariate(mu, kappa);
+        theta = vonmisesvariate(generator);
+    }
+    drow = -round(dist * cos(theta) / n_s_res);
+    dcol = round(dist * sin(theta) / w_e_res);
+}
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * SOD model - runs of the ensemble distributed over processes
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Distributed.h"
+
+#include <algorithm>
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+
+#include <cstdio>
+
+// MPI counts are int, large rasters are sent in parts
+static const size_t max_count = size_t(1) << 26;
+
+template<typename Number>
+static void reduce_sum(Number *values, size_t count, MPI_Datatype type,
+                       bool root)
+{
+    for (size_t start = 0; start < count; start += max_count) {
+        int part = std::min(max_count, count - start);
+        if (root)
+            MPI_Reduce(MPI_IN_PLACE, values + start, part, type, MPI_SUM, 0,
+                       MPI_COMM_WORLD);
+        else
+            MPI_Reduce(values + start, nullptr, part, type, MPI_SUM, 0,
+                       MPI_COMM_WORLD);
+    }
+}
+
+Distributed::Distributed(int *argc, char ***argv)
+{
+    int provided;
+    MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+    // GRASS is not initialized yet, so the error cannot go through it
+    if (provided < MPI_THREAD_FUNNELED) {
+        std::fprintf(stderr, "ERROR: MPI does not support threads\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Comm_rank(MPI_COMM_WORLD, &process);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+}
+
+Distributed::~Distributed()
+{
+    MPI_Finalize();
+}
+
+void Distributed::broadcast(unsigned& value) const
+{
+    MPI_Bcast(&value, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+}
+
+void Distributed::broadcast(int& value) const
+{
+    MPI_Bcast(&value, 1, MPI_INT, 0, MPI_COMM_WORLD);
+}
+
+void Distributed::broadcast(std::string& data) const
+{
+    unsigned long long size = data.size();
+    MPI_Bcast(&size, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+    data.resize(size);
+    for (size_t start = 0; start < size; start += max_count) {
+        int part = std::min(max_count, size_t(size) - start);
+        MPI_Bcast(&data[start], part, MPI_CHAR, 0, MPI_COMM_WORLD);
+    }
+}
+
+void Distributed::broadcast(float *values, size_t count) const
+{
+    for (size_t start = 0; start < count; start += max_count) {
+        int part = std::min(max_count, count - start);
+        MPI_Bcast(values + start, part, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    }
+}
+
+void Distributed::sum_to_root(int64_t *values, size_t count) const
+{
+    reduce_sum(values, count, MPI_INT64_T, root());
+}
+
+void Distributed::sum_to_root(unsigned *values, size_t count) const
+{
+    reduce_sum(values, count, MPI_UNSIGNED, root());
+}
+
+void Distributed::sum_to_root(unsigned& value) const
+{
+    reduce_sum(&value, 1, MPI_UNSIGNED, root());
+}
+
+bool Distributed::all(bool value) const
+{
+    int local = value;
+    int result;
+    MPI_Allreduce(&local, &result, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    return result;
+}
+
+void Distributed::barrier() const
+{
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+#else
+
+Distributed::Distributed(int *, char ***)
+    : process(0), processes(1)
+{}
+
+Distributed::~Distributed() {}
+
+void Distributed::broadcast(unsigned&) const {}
+void Distributed::broadcast(int&) const {}
+void Distributed::broadcast(std::string&) const {}
+void Distributed::broadcast(float *, size_t) const {}
+void Distributed::sum_to_root(int64_t *, size_t) const {}
+void Distributed::sum_to_root(unsigned *, size_t) const {}
+void Distributed::sum_to_root(unsigned&) const {}
+bool Distributed::all(bool value) const
+{
+    return value;
+}
+void Distributed::barrier() const {}
+
+#endif
+
+void Distributed::sum_to_root(std::vector<int64_t>& values) const
+{
+    sum_to_root(values.data(), values.size());
+}
+
+void Distributed::sum_to_root(std::vector<unsigned>& values) const
+{
+    sum_to_root(values.data(), values.size());
+}
+
+unsigned Distributed::first_run(unsigned runs) const
+{
+    unsigned part = runs / processes;
+    unsigned rest = runs % processes;
+    return process * part + std::min<unsigned>(process, rest);
+}
+
+unsigned Distributed::local_runs(unsigned runs) const
+{
+    unsigned part = runs / processes;
+    unsigned rest = runs % processes;
+    return part + (unsigned(process) < rest);
+}
@@ -0,0 +1,86 @@
+/*
+ * SOD model - runs of the ensemble distributed over processes
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/* Processes (MPI ranks) which simulate parts of the ensemble
+ *
+ * Each process simulates a contiguous range of the runs. The run with
+ * the global index i always gets the seed + i, so the results do not
+ * depend on the number of processes. The root process reads the inputs
+ * and sends them to the others, and it gets the sums of the statistics
+ * from all the processes to write the outputs.
+ *
+ * Without HAVE_MPI, there is only one process and all the operations
+ * do nothing. MPI is used only from the main thread, the background
+ * threads and OpenMP threads never communicate.
+ */
+class Distributed
+{
+private:
+    int process;
+    int processes;
+public:
+    // initializes MPI, must be created before any other use of arguments
+    Distributed(int *argc, char ***argv);
+    ~Distributed();
+    Distributed(const Distributed&) = delete;
+    Distributed& operator=(const Distributed&) = delete;
+
+    int rank() const
+    {
+        return process;
+    }
+    int size() const
+    {
+        return processes;
+    }
+    bool root() const
+    {
+        return process == 0;
+    }
+
+    // runs are split as evenly as possible, the first processes
+    // get one more run when the runs cannot be split evenly
+    unsigned first_run(unsigned runs) const;
+    unsigned local_runs(unsigned runs) const;
+
+    // send the value of the root process to the others
+    void broadcast(unsigned& value) const;
+    void broadcast(int& value) const;
+    void broadcast(std::string& data) const;
+    // root sends the values, the others need space for them
+    void broadcast(float *values, size_t count) const;
+
+    // sum of the values from all processes, the result is only in root
+    void sum_to_root(std::vector<int64_t>& values) const;
+    void sum_to_root(std::vector<unsigned>& values) const;
+    void sum_to_root(int64_t *values, size_t count) const;
+    void sum_to_root(unsigned *values, size_t count) const;
+    void sum_to_root(unsigned& value) const;
+    // true in all processes when the value is true in all of them
+    bool all(bool value) const;
+
+    void barrier() const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * SOD model - raster files written by GDAL
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "GdalOutput.h"
+
+#include <gdal/gdal.h>
+#include <gdal/gdal_priv.h>
+
+#include <stdexcept>
+
+using std::string;
+
+GdalOutput::GdalOutput(const char *reference, GdalFormat format,
+                       const string& compression, unsigned threads)
+    :
+      file_format(format),
+      compression(compression),
+      threads(threads ? threads : 1)
+{
+    GDALAllRegister();
+    GDALDataset *dataset = (GDALDataset *) GDALOpen(reference, GA_ReadOnly);
+    if (!dataset)
+        throw std::runtime_error(string("Cannot open reference raster ")
+                                 + reference + ": " + CPLGetLastErrorMsg());
+    if (dataset->GetGeoTransform(transform) != CE_None) {
+        GDALClose((GDALDatasetH) dataset);
+        throw std::runtime_error(string("Reference raster ") + reference
+                                 + " has no geotransform");
+    }
+    projection_wkt = dataset->GetProjectionRef();
+    reference_width = dataset->GetRasterXSize();
+    reference_height = dataset->GetRasterYSize();
+    GDALClose((GDALDatasetH) dataset);
+}
+
+std::vector<string> GdalOutput::options(bool floating) const
+{
+    std::vector<string> options;
+    options.push_back("COMPRESS=" + compression);
+    if (compression != "NONE") {
+        // COG chooses the predictor for the type itself
+        if (file_format == GDAL_COG)
+            options.push_back("PREDICTOR=YES");
+        else
+            options.push_back(floating ? "PREDICTOR=3" : "PREDICTOR=2");
+    }
+    options.push_back("NUM_THREADS=" + std::to_string(threads));
+    options.push_back("BIGTIFF=IF_SAFER");
+    if (file_format == GDAL_COG) {
+        options.push_back("BLOCKSIZE=256");
+    }
+    else {
+        options.push_back("TILED=YES");
+        options.push_back("BLOCKXSIZE=256");
+        options.push_back("BLOCKYSIZE=256");
+    }
+    return options;
+}
@@ -0,0 +1,82 @@
+/*
+ * SOD model - raster files written by GDAL
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef GDALOUTPUT_H
+#define GDALOUTPUT_H
+
+#include <string>
+#include <vector>
+
+/* Kind of the GeoTIFF files */
+enum GdalFormat
+{
+    GDAL_GTIFF, GDAL_COG
+};
+
+/* Georeferencing and creation options of the output files
+ *
+ * The geotransform and projection are read from the reference raster
+ * only once and used for every file written (e.g. for each year of
+ * a series). GeoTIFFs are tiled (256 x 256) and compressed with
+ * the predictor for the type of values. Cloud optimized GeoTIFFs (COG)
+ * are created from an in-memory copy of the raster, the COG driver
+ * adds the overviews. Blocks are compressed by the given number of
+ * GDAL threads. Floating point values are stored as 32-bit floats,
+ * integers with their type (e.g. Int32).
+ */
+class GdalOutput
+{
+public:
+    // compression is a GDAL name (e.g. DEFLATE, ZSTD, LZW or NONE),
+    // throws runtime_error when the reference cannot be read
+    GdalOutput(const char *reference, GdalFormat format,
+               const std::string& compression, unsigned threads);
+
+    GdalFormat format() const
+    {
+        return file_format;
+    }
+    const double *geotransform() const
+    {
+        return transform;
+    }
+    const std::string& projection() const
+    {
+        return projection_wkt;
+    }
+    int width() const
+    {
+        return reference_width;
+    }
+    int height() const
+    {
+        return reference_height;
+    }
+    // NAME=VALUE creation options for integers or floats
+    std::vector<std::string> options(bool floating) const;
+
+private:
+    GdalFormat file_format;
+    std::string compression;
+    unsigned threads;
+    double transform[6];
+    std::string projection_wkt;
+    int reference_width;
+    int reference_height;
+};
+
+#endif
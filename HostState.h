@@ -0,0 +1,213 @@
+/*
+ * SOD model - interleaved host state
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef HOSTSTATE_H
+#define HOSTSTATE_H
+
+#include "Img.h"
+#include "Memory.h"
+#include "BinaryIO.h"
+
+#include <vector>
+#include <type_traits>
+#include <stdexcept>
+
+/* State of all hosts in one record per cell
+ *
+ * A spore landing in a cell reads and writes susceptible and infected
+ * UMCA and oaks and reads the number of living trees. With separate
+ * rasters, it is five memory locations far from each other, here all
+ * of them are next to each other (one cache line).
+ *
+ * The layers are accessed through lightweight views which have the same
+ * operator() interface as Img, so the kernels work with them directly.
+ * The conversion to Img is done only for input and output.
+ */
+template<typename Number>
+class HostState
+{
+public:
+    typedef Number value_type;
+
+    struct Cell
+    {
+        Number S_umca;
+        Number S_oaks;
+        Number I_umca;
+        Number I_oaks;
+        Number lvtree;
+    };
+
+    // one member of all cells accessed as a raster,
+    // Value is Number or const Number
+    template<typename Value>
+    class Layer
+    {
+    private:
+        typedef typename std::conditional<std::is_const<Value>::value,
+                                          const Cell, Cell>::type CellType;
+        CellType *cells;
+        Number Cell::*member;
+        int width;
+        int height;
+    public:
+        Layer(CellType *cells, Number Cell::*member, int width, int height)
+            : cells(cells), member(member), width(width), height(height)
+        {}
+
+        int getWidth() const
+        {
+            return width;
+        }
+
+        int getHeight() const
+        {
+            return height;
+        }
+
+        Value& operator()(unsigned row, unsigned col) const
+        {
+            return cells[row * width + col].*member;
+        }
+    };
+
+    HostState(const Img& S_umca, const Img& S_oaks, const Img& I_umca,
+              const Img& I_oaks, const Img& lvtree)
+        :
+          width(lvtree.getWidth()),
+          height(lvtree.getHeight()),
+          w_e_res(lvtree.getWEResolution()),
+          n_s_res(lvtree.getNSResolution()),
+          cells(width * height)
+    {
+        for (const Img *image : {&S_umca, &S_oaks, &I_umca, &I_oaks})
+            if (image->getWidth() != width || image->getHeight() != height)
+                throw std::runtime_error("The height or width of one image"
+                                         " do not match with that of"
+                                         " the other one.");
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                Cell& cell = cells[i * width + j];
+                cell.S_umca = S_umca(i, j);
+                cell.S_oaks = S_oaks(i, j);
+                cell.I_umca = I_umca(i, j);
+                cell.I_oaks = I_oaks(i, j);
+                cell.lvtree = lvtree(i, j);
+            }
+        }
+    }
+
+    int getWidth() const
+    {
+        return width;
+    }
+
+    int getHeight() const
+    {
+        return height;
+    }
+
+    Layer<Number> S_umca()
+    {
+        return Layer<Number>(cells.data(), &Cell::S_umca, width, height);
+    }
+
+    Layer<const Number> S_umca() const
+    {
+        return Layer<const Number>(cells.data(), &Cell::S_umca,
+                                   width, height);
+    }
+
+    Layer<Number> S_oaks()
+    {
+        return Layer<Number>(cells.data(), &Cell::S_oaks, width, height);
+    }
+
+    Layer<const Number> S_oaks() const
+    {
+        return Layer<const Number>(cells.data(), &Cell::S_oaks,
+                                   width, height);
+    }
+
+    Layer<Number> I_umca()
+    {
+        return Layer<Number>(cells.data(), &Cell::I_umca, width, height);
+    }
+
+    Layer<const Number> I_umca() const
+    {
+        return Layer<const Number>(cells.data(), &Cell::I_umca,
+                                   width, height);
+    }
+
+    Layer<Number> I_oaks()
+    {
+        return Layer<Number>(cells.data(), &Cell::I_oaks, width, height);
+    }
+
+    Layer<const Number> I_oaks() const
+    {
+        return Layer<const Number>(cells.data(), &Cell::I_oaks,
+                                   width, height);
+    }
+
+    Layer<Number> lvtree()
+    {
+        return Layer<Number>(cells.data(), &Cell::lvtree, width, height);
+    }
+
+    Layer<const Number> lvtree() const
+    {
+        return Layer<const Number>(cells.data(), &Cell::lvtree,
+                                   width, height);
+    }
+
+    // binary records of all cells (for checkpoints)
+    void write(std::ostream& stream) const
+    {
+        write_vector(stream, cells);
+    }
+
+    void read(std::istream& stream)
+    {
+        AlignedVector<Cell> stored;
+        read_vector(stream, stored);
+        if (stored.size() != cells.size())
+            throw std::runtime_error("The number of stored cells does not"
+                                     " match with the state.");
+        cells.swap(stored);
+    }
+
+    // copy one member of all cells to a raster
+    Img toImg(Number Cell::*member) const
+    {
+        Img out(width, height, w_e_res, n_s_res);
+        for (int i = 0; i < height; i++)
+            for (int j = 0; j < width; j++)
+                out(i, j) = cells[i * width + j].*member;
+        return out;
+    }
+
+private:
+    int width;
+    int height;
+    int w_e_res;
+    int n_s_res;
+    AlignedVector<Cell> cells;
+};
+
+#endif
@@ -16,34 +16,279 @@
 
 
 #include "Img.h"
+#include "BinaryIO.h"
+#include "Memory.h"
+#include "GdalOutput.h"
+#include "Simd.h"
 
 extern "C" {
 #include <grass/gis.h>
 #include <grass/glocale.h>
 #include <grass/raster.h>
+#include <grass/version.h>
 }
 
 #include <gdal/gdal.h>
 #include <gdal/gdal_priv.h>
 
 #include <algorithm>
+#include <vector>
+#include <type_traits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using std::string;
 using std::cerr;
 using std::endl;
 
-/* Iterate over two ranges and apply a binary function which modifies
- * the first parameter.
+/* Element-wise loops over the cells, the output can be an input
+ *
+ * The overloads for int use the vector instructions (see Simd.h),
+ * the values are converted in the same way by both.
  */
-template<class InputIt1, class InputIt2, class BinaryOperation>
-BinaryOperation for_each_zip(InputIt1 first1, InputIt1 last1, InputIt2 first2, BinaryOperation f) {
-    for (; first1 != last1; ++first1, ++first2) {
-        f(*first1, *first2);
-    }
-    return f;
+template<typename Number>
+static void add_cells(Number *out, const Number *a, const Number *b,
+                      size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] + b[i];
+}
+
+template<typename Number>
+static void subtract_cells(Number *out, const Number *a, const Number *b,
+                           size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] - b[i];
+}
+
+template<typename Number>
+static void multiply_cells(Number *out, const Number *a, const Number *b,
+                           size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] * b[i];
+}
+
+template<typename Number>
+static void divide_cells(Number *out, const Number *a, const Number *b,
+                         size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] / b[i];
+}
+
+template<typename Number>
+static void add_to_cells(Number *out, const Number *a, Number value,
+                         size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] + value;
+}
+
+template<typename Number>
+static void subtract_from_cells(Number *out, const Number *a, Number value,
+                                size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] - value;
+}
+
+template<typename Number>
+static void multiply_cells(Number *out, const Number *a, double value,
+                           size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] * value;
+}
+
+template<typename Number>
+static void divide_cells(Number *out, const Number *a, double value,
+                         size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] / value;
+}
+
+static void add_cells(int *out, const int *a, const int *b, size_t count)
+{
+    simd_add(out, a, b, count);
+}
+
+static void subtract_cells(int *out, const int *a, const int *b,
+                           size_t count)
+{
+    simd_subtract(out, a, b, count);
+}
+
+static void multiply_cells(int *out, const int *a, const int *b,
+                           size_t count)
+{
+    simd_multiply(out, a, b, count);
+}
+
+static void divide_cells(int *out, const int *a, const int *b, size_t count)
+{
+    simd_divide(out, a, b, count);
+}
+
+static void add_to_cells(int *out, const int *a, int value, size_t count)
+{
+    simd_add_value(out, a, value, count);
+}
+
+// wraps around as the subtraction would
+static void subtract_from_cells(int *out, const int *a, int value,
+                                size_t count)
+{
+    simd_add_value(out, a, int(0u - unsigned(value)), count);
+}
+
+static void multiply_cells(int *out, const int *a, double value,
+                           size_t count)
+{
+    simd_multiply_value(out, a, value, count);
+}
+
+static void divide_cells(int *out, const int *a, double value, size_t count)
+{
+    simd_divide_value(out, a, value, count);
+}
+
+template<typename Number>
+static typename BasicImg<Number>::sum_type sum_cells(const Number *values,
+                                                     size_t count)
+{
+    typename BasicImg<Number>::sum_type sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += values[i];
+    return sum;
+}
+
+template<typename Number>
+static size_t count_nonzero_cells(const Number *values, size_t count)
+{
+    size_t nonzero = 0;
+    for (size_t i = 0; i < count; i++)
+        if (values[i])
+            ++nonzero;
+    return nonzero;
+}
+
+template<typename Number>
+static bool any_positive_cell(const Number *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if (values[i] > 0)
+            return true;
+    return false;
+}
+
+static int64_t sum_cells(const int *values, size_t count)
+{
+    return simd_sum(values, count);
+}
+
+static size_t count_nonzero_cells(const int *values, size_t count)
+{
+    return simd_count_nonzero(values, count);
+}
+
+static bool any_positive_cell(const int *values, size_t count)
+{
+    return simd_any_positive(values, count);
+}
+
+/* GRASS raster type used to store the image type */
+template<typename Number>
+struct GrassCell
+{
+    typedef CELL type;
+    static const RASTER_MAP_TYPE map_type = CELL_TYPE;
+};
+
+template<>
+struct GrassCell<float>
+{
+    typedef FCELL type;
+    static const RASTER_MAP_TYPE map_type = FCELL_TYPE;
+};
+
+template<>
+struct GrassCell<double>
+{
+    typedef DCELL type;
+    static const RASTER_MAP_TYPE map_type = DCELL_TYPE;
+};
+
+static void get_grass_row(int fd, CELL *buffer, int row)
+{
+    Rast_get_c_row(fd, buffer, row);
+}
+
+static void get_grass_row(int fd, FCELL *buffer, int row)
+{
+    Rast_get_f_row(fd, buffer, row);
+}
+
+static void get_grass_row(int fd, DCELL *buffer, int row)
+{
+    Rast_get_d_row(fd, buffer, row);
+}
+
+static void put_grass_row(int fd, const CELL *buffer)
+{
+    Rast_put_c_row(fd, buffer);
+}
+
+static void put_grass_row(int fd, const FCELL *buffer)
+{
+    Rast_put_f_row(fd, buffer);
+}
+
+static void put_grass_row(int fd, const DCELL *buffer)
+{
+    Rast_put_d_row(fd, buffer);
 }
 
-Img::Img()
+/* GDAL type of the buffer for the image type */
+template<typename Number>
+GDALDataType gdal_type();
+
+template<>
+GDALDataType gdal_type<uint8_t>()
+{
+    return GDT_Byte;
+}
+
+template<>
+GDALDataType gdal_type<uint16_t>()
+{
+    return GDT_UInt16;
+}
+
+template<>
+GDALDataType gdal_type<int>()
+{
+    return GDT_Int32;
+}
+
+template<>
+GDALDataType gdal_type<float>()
+{
+    return GDT_Float32;
+}
+
+template<>
+GDALDataType gdal_type<double>()
+{
+    return GDT_Float64;
+}
+
+template<typename Number>
+BasicImg<Number>::BasicImg()
 {
     width = 0;
     height = 0;
@@ -52,17 +297,19 @@ Img::Img()
     data = NULL;
 }
 
-Img::Img(const Img& other)
+template<typename Number>
+BasicImg<Number>::BasicImg(const BasicImg& other)
 {
     width = other.width;
     height = other.height;
     w_e_res = other.w_e_res;
     n_s_res = other.n_s_res;
-    data = new int[width * height];
+    data = allocate_values<Number>(width * height);
     std::copy(other.data, other.data + (width * height), data);
 }
 
-Img::Img(Img&& other)
+template<typename Number>
+BasicImg<Number>::BasicImg(BasicImg&& other)
 {
     width = other.width;
     height = other.height;
@@ -72,25 +319,30 @@ Img::Img(Img&& other)
     other.data = nullptr;
 }
 
-Img::Img(int width, int height, int w_e_res, int n_s_res)
+template<typename Number>
+BasicImg<Number>::BasicImg(int width, int height, int w_e_res, int n_s_res)
 {
     this->width = width;
     this->height = height;
     this->w_e_res = w_e_res;
     this->n_s_res = n_s_res;
-    this->data = new int[width * height];
+    this->data = allocate_values<Number>(width * height);
 }
 
-Img::Img(int width, int height, int w_e_res, int n_s_res, int value)
+template<typename Number>
+BasicImg<Number>::BasicImg(int width, int height, int w_e_res, int n_s_res,
+                           Number value)
 {
     this->width = width;
     this->height = height;
     this->w_e_res = w_e_res;
     this->n_s_res = n_s_res;
-    this->data = new int[width * height]{value};
+    this->data = allocate_values<Number>(width * height);
+    std::fill(data, data + (width * height), value);
 }
 
-Img::Img(const char *fileName)
+template<typename Number>
+BasicImg<Number>::BasicImg(const char *fileName, unsigned threads)
 {
     GDALDataset *dataset;
     GDALRasterBand *dataBand;
@@ -115,26 +367,96 @@ Img::Img(const char *fileName)
         //cout << w_e_res << "X" << n_s_res << endl;
 
         dataBand = dataset->GetRasterBand(1);
-        data = new int[width * height];
-
-        CPLErr error = dataBand->RasterIO(GF_Read, 0, 0, width, height,
-                                          data, width, height,
-                                          GDT_Int32, 0, 0);
-        if (error == CE_Failure)
+        data = allocate_values<Number>(width * height);
+
+        // whole rows of blocks are read at once,
+        // so each block is decompressed only once
+        int block_width, block_height;
+        dataBand->GetBlockSize(&block_width, &block_height);
+        if (block_height < 1)
+            block_height = 1;
+        int strips = (height + block_height - 1) / block_height;
+        string message;
+        #pragma omp parallel num_threads(threads) if(threads > 1 && strips > 1)
+        {
+            // a dataset cannot be used by several threads
+            GDALDataset *own = dataset;
+#ifdef _OPENMP
+            if (omp_get_thread_num() > 0)
+                own = (GDALDataset *) GDALOpen(fileName, GA_ReadOnly);
+#endif
+            #pragma omp for schedule(dynamic)
+            for (int strip = 0; strip < strips; strip++) {
+                int row = strip * block_height;
+                int rows = std::min(block_height, height - row);
+                CPLErr error = CE_Failure;
+                if (own)
+                    error = own->GetRasterBand(1)->RasterIO(
+                                GF_Read, 0, row, width, rows,
+                                data + size_t(row) * width, width, rows,
+                                gdal_type<Number>(), 0, 0);
+                if (error == CE_Failure) {
+                    #pragma omp critical(gdal_read_error)
+                    if (message.empty())
+                        message = CPLGetLastErrorMsg();
+                }
+            }
+            if (own && own != dataset)
+                GDALClose((GDALDatasetH) own);
+        }
+        GDALClose((GDALDatasetH) dataset);
+        if (!message.empty()) {
+            free_aligned(data);
             throw std::runtime_error(string("Reading raster failed"
                                             " in GDAL RasterIO: ")
-                                     + CPLGetLastErrorMsg());
-        GDALClose((GDALDatasetH) dataset);
+                                     + message);
+        }
     }
 }
 
 
 // TODO: add move constuctor
-Img Img::fromGrassRaster(const char *name)
+template<typename Number>
+BasicImg<Number> BasicImg<Number>::fromGrassRaster(const char *name)
 {
     int fd = Rast_open_old(name, "");
+    BasicImg img = fromGrassFile(fd);
+    Rast_close(fd);
+    return img;
+}
+
+template<typename Number>
+std::vector<BasicImg<Number> >
+BasicImg<Number>::fromGrassRasters(const std::vector<const char *>& names,
+                                   unsigned threads)
+{
+    // opening and closing changes the table of the open rasters,
+    // only the rows are read in parallel
+    std::vector<int> fds;
+    for (const char *name : names)
+        fds.push_back(Rast_open_old(name, ""));
+#if GRASS_VERSION_MAJOR > 8 \
+    || (GRASS_VERSION_MAJOR == 8 && GRASS_VERSION_MINOR >= 3)
+    // the mask is read through one file shared by all rasters
+    threads = Rast_disable_omp_on_mask(threads);
+#else
+    // older raster libraries cannot read in parallel
+    threads = 1;
+#endif
+    std::vector<BasicImg> images(names.size());
+    #pragma omp parallel for schedule(dynamic) num_threads(threads) \
+        if(threads > 1)
+    for (int i = 0; i < int(fds.size()); i++)
+        images[i] = fromGrassFile(fds[i]);
+    for (int fd : fds)
+        Rast_close(fd);
+    return images;
+}
 
-    Img img;
+template<typename Number>
+BasicImg<Number> BasicImg<Number>::fromGrassFile(int fd)
+{
+    BasicImg img;
 
     img.width = Rast_window_cols();
     img.height = Rast_window_rows();
@@ -144,13 +466,22 @@ Img Img::fromGrassRaster(const char *name)
     img.w_e_res = region.ew_res;
     img.n_s_res = region.ns_res;
 
-    img.data = new int[img.height * img.width];
+    img.data = allocate_values<Number>(img.height * img.width);
 
+    typedef typename GrassCell<Number>::type Cell;
+    // rows of the type of the image are read directly into it
+    if (std::is_same<Cell, Number>::value) {
+        for (int row = 0; row < img.height; row++)
+            get_grass_row(fd, reinterpret_cast<Cell *>(
+                              img.data + (row * img.width)), row);
+        return img;
+    }
+    std::vector<Cell> buffer(img.width);
     for (int row = 0; row < img.height; row++) {
-        Rast_get_c_row(fd, img.data + (row * img.width), row);
+        get_grass_row(fd, buffer.data(), row);
+        std::copy(buffer.begin(), buffer.end(),
+                  img.data + (row * img.width));
     }
-
-    Rast_close(fd);
     return img;
 }
 
@@ -160,28 +491,30 @@ Img Img::fromGrassRaster(const char *name)
    }
  */
 
-Img& Img::operator=(const Img& other)
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator=(const BasicImg& other)
 {
     if (this != &other)
     {
         if (data)
-            delete[] data;
+            free_aligned(data);
         width = other.width;
         height = other.height;
         w_e_res = other.w_e_res;
         n_s_res = other.n_s_res;
-        data = new int[width * height];
+        data = allocate_values<Number>(width * height);
         std::copy(other.data, other.data + (width * height), data);
     }
     return *this;
 }
 
-Img& Img::operator=(Img&& other)
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator=(BasicImg&& other)
 {
     if (this != &other)
     {
         if (data)
-            delete[] data;
+            free_aligned(data);
         width = other.width;
         height = other.height;
         w_e_res = other.w_e_res;
@@ -192,198 +525,245 @@ Img& Img::operator=(Img&& other)
     return *this;
 }
 
-Img Img::operator+(const Img& image) const
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator+=(Number value)
 {
-    if (this->width != image.getWidth() || this->height != image.getHeight()) {
-        cerr << "The height or width of one image do not match with that of the other one!" << endl;
-        return Img();
-    }
-    else {
-        auto re_width = this->width;
-        auto re_height = this->height;
-        auto out = Img(re_width, re_height, this->w_e_res, this->n_s_res);
-
-        for (int i = 0; i < re_height; i++) {
-            for (int j = 0; j < re_width; j++) {
-                out.data[i * width + j] = this->data[i * width + j] + image.data[i * width + j];
-            }
-        }
-        return out;
-    }
+    add_to_cells(data, data, value, size_t(width) * height);
+    return *this;
 }
 
-Img Img::operator-(const Img& image) const
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator-=(Number value)
 {
-    if (this->width != image.getWidth() || this->height != image.getHeight()) {
-        cerr << "The height or width of one image do not match with that of the other one!" << endl;
-        return Img();
-    }
-    else {
-        auto re_width = this->width;
-        auto re_height = this->height;
-        auto out = Img(re_width, re_height, this->w_e_res, this->n_s_res);
-
-        for (int i = 0; i < re_height; i++) {
-            for (int j = 0; j < re_width; j++) {
-                out.data[i * width + j] = this->data[i * width + j] - image.data[i * width + j];
-            }
-        }
-        return out;
-    }
+    subtract_from_cells(data, data, value, size_t(width) * height);
+    return *this;
 }
 
-Img Img::operator*(const Img& image) const
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator*=(double value)
 {
-    if (width != image.getWidth() || height != image.getHeight()) {
-        throw std::runtime_error("The height or width of one image do"
-                                 " not match with that of the other one.");
-    }
-    auto out = Img(width, height, w_e_res, n_s_res);
-
-    std::transform(data, data + (width * height), image.data, out.data,
-                   [](const int& a, const int& b) { return a * b; });
-    return out;
+    multiply_cells(data, data, value, size_t(width) * height);
+    return *this;
 }
 
-Img Img::operator/(const Img& image) const
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator/=(double value)
 {
-    if (width != image.getWidth() || height != image.getHeight()) {
-        throw std::runtime_error("The height or width of one image do"
-                                 " not match with that of the other one.");
-    }
-    auto out = Img(width, height, w_e_res, n_s_res);
+    divide_cells(data, data, value, size_t(width) * height);
+    return *this;
+}
 
-    std::transform(data, data + (width * height), image.data, out.data,
-                   [](const int& a, const int& b) { return a / b; });
-    return out;
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator+=(const BasicImg& image)
+{
+    add_cells(data, data, image.data, size_t(width) * height);
+    return *this;
 }
 
-Img Img::operator*(double factor) const
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator-=(const BasicImg& image)
 {
-    auto re_width = this->width;
-    auto re_height = this->height;
-    auto out = Img(re_width, re_height, this->w_e_res, this->n_s_res);
+    subtract_cells(data, data, image.data, size_t(width) * height);
+    return *this;
+}
 
-    for (int i = 0; i < re_height; i++) {
-        for (int j = 0; j < re_width; j++) {
-            out.data[i * width + j] = this->data[i * width + j] * factor;
-        }
-    }
-    return out;
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator*=(const BasicImg& image)
+{
+    multiply_cells(data, data, image.data, size_t(width) * height);
+    return *this;
 }
 
-Img Img::operator/(double value) const
+template<typename Number>
+BasicImg<Number>& BasicImg<Number>::operator/=(const BasicImg& image)
 {
-    auto out = Img(width, height, w_e_res, n_s_res);
+    divide_cells(data, data, image.data, size_t(width) * height);
+    return *this;
+}
 
-    std::transform(data, data + (width * height), out.data,
-                   [&value](const int& a) { return a / value; });
-    return out;
+template<typename Number>
+void BasicImg<Number>::evaluate(
+        const ImgBinary<ImgAdd, BasicImg, BasicImg>& expression)
+{
+    add_cells(data, expression.getLeft().data, expression.getRight().data,
+              size_t(width) * height);
 }
 
-Img& Img::operator+=(int value)
+template<typename Number>
+void BasicImg<Number>::evaluate(
+        const ImgBinary<ImgSubtract, BasicImg, BasicImg>& expression)
 {
-    std::for_each(data, data + (width * height),
-                  [&value](int& a) { a += value; });
-    return *this;
+    subtract_cells(data, expression.getLeft().data,
+                   expression.getRight().data, size_t(width) * height);
 }
 
-Img& Img::operator-=(int value)
+template<typename Number>
+void BasicImg<Number>::evaluate(
+        const ImgBinary<ImgMultiply, BasicImg, BasicImg>& expression)
 {
-    std::for_each(data, data + (width * height),
-                  [&value](int& a) { a -= value; });
-    return *this;
+    multiply_cells(data, expression.getLeft().data,
+                   expression.getRight().data, size_t(width) * height);
 }
 
-Img& Img::operator*=(double value)
+template<typename Number>
+void BasicImg<Number>::evaluate(
+        const ImgBinary<ImgDivide, BasicImg, BasicImg>& expression)
 {
-    std::for_each(data, data + (width * height),
-                  [&value](int& a) { a *= value; });
-    return *this;
+    divide_cells(data, expression.getLeft().data,
+                 expression.getRight().data, size_t(width) * height);
 }
 
-Img& Img::operator/=(double value)
+template<typename Number>
+void BasicImg<Number>::evaluate(
+        const ImgBinary<ImgMultiply, BasicImg, ImgScalar<double> >&
+        expression)
 {
-    std::for_each(data, data + (width * height),
-                  [&value](int& a) { a /= value; });
-    return *this;
+    multiply_cells(data, expression.getLeft().data,
+                   expression.getRight().getValue(), size_t(width) * height);
 }
 
-Img& Img::operator+=(const Img& image)
+template<typename Number>
+void BasicImg<Number>::evaluate(
+        const ImgBinary<ImgDivide, BasicImg, ImgScalar<double> >& expression)
 {
-    for_each_zip(data, data + (width * height), image.data,
-                 [](int& a, int& b) { a += b; });
-    return *this;
+    divide_cells(data, expression.getLeft().data,
+                 expression.getRight().getValue(), size_t(width) * height);
 }
 
-Img& Img::operator-=(const Img& image)
+template<typename Number>
+typename BasicImg<Number>::sum_type BasicImg<Number>::sum() const
 {
-    for_each_zip(data, data + (width * height), image.data,
-                 [](int& a, int& b) { a -= b; });
-    return *this;
+    return sum_cells(data, size_t(width) * height);
 }
 
-Img& Img::operator*=(const Img& image)
+template<typename Number>
+size_t BasicImg<Number>::count_nonzero() const
 {
-    for_each_zip(data, data + (width * height), image.data,
-                 [](int& a, int& b) { a *= b; });
-    return *this;
+    return count_nonzero_cells(data, size_t(width) * height);
 }
 
-Img& Img::operator/=(const Img& image)
+template<typename Number>
+bool BasicImg<Number>::any_positive() const
 {
-    for_each_zip(data, data + (width * height), image.data,
-                 [](int& a, int& b) { a /= b; });
-    return *this;
+    return any_positive_cell(data, size_t(width) * height);
 }
 
-Img::~Img()
+template<typename Number>
+BasicImg<Number>::~BasicImg()
 {
     if (data) {
-        delete[] data;
+        free_aligned(data);
     }
 }
 
-void Img::toGrassRaster(const char *name)
+template<typename Number>
+void BasicImg<Number>::toGrassRaster(const char *name)
 {
-    int fd = Rast_open_new(name, CELL_TYPE);
-    for (int i = 0; i < height; i++)
-        Rast_put_c_row(fd, data + (i * width));
+    int fd = Rast_open_new(name, GrassCell<Number>::map_type);
+    std::vector<typename GrassCell<Number>::type> buffer(width);
+    for (int i = 0; i < height; i++) {
+        std::copy(data + (i * width), data + ((i + 1) * width),
+                  buffer.begin());
+        put_grass_row(fd, buffer.data());
+    }
     Rast_close(fd);
 }
 
+// floating point values are stored with single precision
+template<typename Number>
+GDALDataType gdal_file_type()
+{
+    GDALDataType type = gdal_type<Number>();
+    return type == GDT_Float64 ? GDT_Float32 : type;
+}
+
 // ref_name file is used to retrieve transformation and projection
 // information from the known (input) file
-void Img::toGdal(const char *name, const char *ref_name)
+template<typename Number>
+void BasicImg<Number>::toGdal(const char *name, const char *ref_name) const
 {
-    const char *format = "GTiff";
-
-    GDALAllRegister();
+    toGdal(name, GdalOutput(ref_name, GDAL_GTIFF, "DEFLATE", 1));
+}
 
-    // obtain information for output Geotiff images
-    GDALDataset *inputDataset = (GDALDataset *) GDALOpen(ref_name,
-                                                         GA_ReadOnly);
-    double inputAdfGeoTransform[6];
-    inputDataset->GetGeoTransform(inputAdfGeoTransform);
-
-    // setup driver
-    GDALDriver *gdalDriver = GetGDALDriverManager()->GetDriverByName(format);
-
-    // set output Dataset and create output geotiff
-    char **papszOptions = NULL;
-    GDALDataset *outDataset = gdalDriver->Create(name, width, height, 1,
-                                                 GDT_Byte, papszOptions);
-    outDataset->SetGeoTransform(inputAdfGeoTransform);
-    outDataset->SetProjection(inputDataset->GetProjectionRef());
-    GDALRasterBand *outBand = outDataset->GetRasterBand(1);
-    CPLErr error = outBand->RasterIO(GF_Write, 0, 0, width, height,
-                                     data, width, height,
-                                     GDT_Int32, 0, 0);
-    if (error == CE_Failure)
-        throw std::runtime_error(string("Writing raster failed"
-                                        " in GDAL RasterIO: ")
+template<typename Number>
+void BasicImg<Number>::toGdal(const char *name,
+                              const GdalOutput& output) const
+{
+    if (output.width() != width || output.height() != height)
+        throw std::runtime_error(string("The size of ") + name
+                                 + " does not match the reference raster");
+    GDALDataType type = gdal_file_type<Number>();
+    char **options = nullptr;
+    for (const string& option : output.options(type == GDT_Float32))
+        options = CSLAddString(options, option.c_str());
+
+    // the COG driver creates the file only as a copy of a whole dataset
+    bool copy = output.format() == GDAL_COG;
+    GDALDriver *driver = GetGDALDriverManager()->GetDriverByName(
+                copy ? "MEM" : "GTiff");
+    GDALDataset *dataset = nullptr;
+    if (driver)
+        dataset = driver->Create(copy ? "" : name, width, height, 1, type,
+                                 copy ? nullptr : options);
+    if (!dataset) {
+        CSLDestroy(options);
+        throw std::runtime_error(string("Cannot create ") + name + ": "
                                  + CPLGetLastErrorMsg());
-    GDALClose((GDALDatasetH) outDataset);
-    GDALClose((GDALDatasetH) inputDataset);
-    CSLDestroy(papszOptions);
+    }
+    double geotransform[6];
+    std::copy(output.geotransform(), output.geotransform() + 6,
+              geotransform);
+    dataset->SetGeoTransform(geotransform);
+    dataset->SetProjection(output.projection().c_str());
+    CPLErr error = dataset->GetRasterBand(1)->RasterIO(
+                GF_Write, 0, 0, width, height, data, width, height,
+                gdal_type<Number>(), 0, 0);
+    string message;
+    if (error == CE_Failure)
+        message = string("Writing raster failed in GDAL RasterIO: ")
+                + CPLGetLastErrorMsg();
+    else if (copy) {
+        GDALDriver *cog = GetGDALDriverManager()->GetDriverByName("COG");
+        GDALDataset *file = nullptr;
+        if (cog)
+            file = cog->CreateCopy(name, dataset, FALSE, options,
+                                   nullptr, nullptr);
+        if (file)
+            GDALClose((GDALDatasetH) file);
+        else
+            message = string("Cannot create ") + name + " as COG: "
+                    + CPLGetLastErrorMsg();
+    }
+    // the last tiles are compressed and written when closed
+    GDALClose((GDALDatasetH) dataset);
+    CSLDestroy(options);
+    if (!message.empty())
+        throw std::runtime_error(message);
 }
+
+template<typename Number>
+void BasicImg<Number>::write(std::ostream& stream) const
+{
+    write_value(stream, int32_t(width));
+    write_value(stream, int32_t(height));
+    write_values(stream, data, size_t(width) * height);
+}
+
+template<typename Number>
+void BasicImg<Number>::read(std::istream& stream)
+{
+    int32_t stored_width;
+    int32_t stored_height;
+    read_value(stream, stored_width);
+    read_value(stream, stored_height);
+    if (stored_width != width || stored_height != height)
+        throw std::runtime_error("The height or width of the stored image"
+                                 " does not match with this image.");
+    read_values(stream, data, size_t(width) * height);
+}
+
+template class BasicImg<uint8_t>;
+template class BasicImg<uint16_t>;
+template class BasicImg<int>;
+template class BasicImg<float>;
+template class BasicImg<double>;
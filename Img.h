@@ -18,19 +18,42 @@
 #ifndef IMG_H
 #define IMG_H
 
+#include "ImgExpression.h"
+
 #include <iostream>
 #include <string>
+#include <vector>
 #include <cmath>
 #include <algorithm>
+#include <type_traits>
 #include <stdlib.h>
+#include <stdint.h>
+
 
+class GdalOutput;
 
 enum Direction
 {
     N = 0, NE = 45, E = 90, SE = 135, S = 180, SW = 225, W = 270, NW = 315, NONE  // NO means that there is no wind
 };
 
-class Img
+/* Raster image with values of the given type
+ *
+ * Img (int values) is used for the inputs and outputs. Narrower types
+ * such as uint16_t can be used for the state of the runs to reduce
+ * memory; the values are read as the type and promoted to int when used
+ * in computations with int.
+ *
+ * The class is instantiated in Img.cpp for int, uint8_t, uint16_t,
+ * float and double. The arithmetic operators are lazy expressions
+ * (see ImgExpression.h) evaluated when assigned to an image.
+ * The values are aligned to a cache line (see Memory.h). Single
+ * operations on int images (e.g. a + b, a * 0.5, a += b) and the sums
+ * use the vector instructions of the processor (see Simd.h), other
+ * expressions are evaluated in one plain loop.
+ */
+template<typename Number>
+class BasicImg : public ImgExpression<BasicImg<Number> >
 {
 private:
     int width;
@@ -39,17 +62,58 @@ private:
     int w_e_res;
     // the north-south resolution of the pixel
     int n_s_res;
-    int *data;
+    Number *data;
 public:
-    Img();
-    Img(Img&& other);
-    Img(const Img& other);
-    //Img(int width,int height);
-    Img(const char *fileName);
-    Img(int width, int height, int w_e_res, int n_s_res);
-    Img(int width, int height, int w_e_res, int n_s_res, int value);
-    Img& operator=(Img&& other);
-    Img& operator=(const Img& other);
+    typedef Number value_type;
+    // integers are summed in 64 bits
+    typedef typename std::conditional<std::is_integral<Number>::value,
+                                      int64_t, double>::type sum_type;
+
+    BasicImg();
+    BasicImg(BasicImg&& other);
+    BasicImg(const BasicImg& other);
+    // convert values from an image of another type
+    template<typename Other>
+    explicit BasicImg(const BasicImg<Other>& other)
+        : BasicImg(other.getWidth(), other.getHeight(),
+                   other.getWEResolution(), other.getNSResolution())
+    {
+        for (int i = 0; i < height; i++)
+            for (int j = 0; j < width; j++)
+                data[i * width + j] = other(i, j);
+    }
+    // evaluate an expression of images (e.g. Img a = b - c)
+    template<class Operation, class Left, class Right>
+    BasicImg(const ImgBinary<Operation, Left, Right>& expression)
+        : BasicImg(expression.getWidth(), expression.getHeight(),
+                   expression.getWEResolution(),
+                   expression.getNSResolution())
+    {
+        evaluate(expression);
+    }
+    //BasicImg(int width,int height);
+    // strips of whole blocks of the file are read by the threads,
+    // each through its own GDAL dataset
+    BasicImg(const char *fileName, unsigned threads = 1);
+    BasicImg(int width, int height, int w_e_res, int n_s_res);
+    BasicImg(int width, int height, int w_e_res, int n_s_res, Number value);
+    BasicImg& operator=(BasicImg&& other);
+    BasicImg& operator=(const BasicImg& other);
+    // the image is reused when it has the size of the expression,
+    // the expression can contain the image itself (e.g. a = a - b)
+    template<class Operation, class Left, class Right>
+    BasicImg& operator=(const ImgBinary<Operation, Left, Right>& expression)
+    {
+        if (!data || width != expression.getWidth()
+                || height != expression.getHeight())
+            *this = BasicImg(expression);
+        else {
+            w_e_res = expression.getWEResolution();
+            n_s_res = expression.getNSResolution();
+            evaluate(expression);
+        }
+        return *this;
+    }
 
     int getWidth() const
     {
@@ -71,7 +135,7 @@ public:
         return n_s_res;
     }
 
-    void fill(int value)
+    void fill(Number value)
     {
         std::fill(data, data + (width * height), value);
     }
@@ -87,36 +151,86 @@ public:
         std::for_each(data, data + (width * height), op);
     }
 
-    const int& operator()(unsigned row, unsigned col) const
+    const Number& operator()(unsigned row, unsigned col) const
     {
         return data[row * width + col];
     }
 
-    int& operator()(unsigned row, unsigned col)
+    Number& operator()(unsigned row, unsigned col)
     {
         return data[row * width + col];
     }
 
-    Img operator+(const Img& image) const;
-    Img operator-(const Img& image) const;
-    Img operator*(const Img& image) const;
-    Img operator/(const Img& image) const;
-    Img operator*(double factor) const;
-    Img operator/(double value) const;
-    Img& operator+=(int value);
-    Img& operator-=(int value);
-    Img& operator*=(double value);
-    Img& operator/=(double value);
-    Img& operator+=(const Img& image);
-    Img& operator-=(const Img& image);
-    Img& operator*=(const Img& image);
-    Img& operator/=(const Img& image);
-    ~Img();
+    // value with index row * width + col (used by expressions)
+    const Number& cell(size_t index) const
+    {
+        return data[index];
+    }
+
+    // all the values row by row
+    const Number *values() const
+    {
+        return data;
+    }
+
+    sum_type sum() const;
+    size_t count_nonzero() const;
+    bool any_positive() const;
+
+    BasicImg& operator+=(Number value);
+    BasicImg& operator-=(Number value);
+    BasicImg& operator*=(double value);
+    BasicImg& operator/=(double value);
+    BasicImg& operator+=(const BasicImg& image);
+    BasicImg& operator-=(const BasicImg& image);
+    BasicImg& operator*=(const BasicImg& image);
+    BasicImg& operator/=(const BasicImg& image);
+    ~BasicImg();
 
     void toGrassRaster(const char *name);
-    void toGdal(const char *name, const char *ref_name);
+    // GeoTIFF with georeferencing from the reference raster
+    // (which is read each time), throws runtime_error
+    void toGdal(const char *name, const char *ref_name) const;
+    // file in the format given by the output, the size must match
+    // the reference of the output, throws runtime_error
+    void toGdal(const char *name, const GdalOutput& output) const;
+
+    // binary values (for checkpoints), the size must match when reading
+    void write(std::ostream& stream) const;
+    void read(std::istream& stream);
+
+    static BasicImg fromGrassRaster(const char *name);
+    // rasters in the order of the names, read at the same time
+    // by up to the given number of threads (one for each raster)
+    static std::vector<BasicImg>
+    fromGrassRasters(const std::vector<const char *>& names,
+                     unsigned threads);
 
-    static Img fromGrassRaster(const char *name);
+private:
+    static BasicImg fromGrassFile(int fd);
+    template<class Expression>
+    void evaluate(const Expression& expression)
+    {
+        Number *out = data;
+        size_t cells = size_t(width) * height;
+        for (size_t i = 0; i < cells; i++)
+            out[i] = expression.cell(i);
+    }
+    // single operations with the same results as the loop above,
+    // vectorized for int
+    void evaluate(const ImgBinary<ImgAdd, BasicImg, BasicImg>& expression);
+    void evaluate(const ImgBinary<ImgSubtract, BasicImg, BasicImg>&
+                  expression);
+    void evaluate(const ImgBinary<ImgMultiply, BasicImg, BasicImg>&
+                  expression);
+    void evaluate(const ImgBinary<ImgDivide, BasicImg, BasicImg>&
+                  expression);
+    void evaluate(const ImgBinary<ImgMultiply, BasicImg, ImgScalar<double> >&
+                  expression);
+    void evaluate(const ImgBinary<ImgDivide, BasicImg, ImgScalar<double> >&
+                  expression);
 };
 
+typedef BasicImg<int> Img;
+
 #endif
@@ -0,0 +1,239 @@
+/*
+ * SOD model - lazy element-wise operations on rasters
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef IMG_EXPRESSION_H
+#define IMG_EXPRESSION_H
+
+#include <stdexcept>
+#include <cstddef>
+
+template<typename Number>
+class BasicImg;
+
+/* Base of images and of expressions on them
+ *
+ * The operators +, -, *, / on images do not compute anything, they
+ * return an ImgBinary which holds the operands. The expression is
+ * evaluated in a single loop over the cells when it is assigned to an
+ * image or used to construct one, so e.g. a - b + c creates no
+ * temporary image for a - b.
+ *
+ * Each operation gives the value type of its left operand, the same as
+ * the operators which returned an image, i.e. (a * 0.5) + b is
+ * truncated after the multiplication for integer images.
+ */
+template<class Expression>
+class ImgExpression
+{
+public:
+    const Expression& expression() const
+    {
+        return static_cast<const Expression&>(*this);
+    }
+};
+
+/* Number used as an operand of an expression */
+template<typename Number>
+class ImgScalar
+{
+private:
+    Number value;
+public:
+    typedef Number value_type;
+
+    explicit ImgScalar(Number value)
+        : value(value)
+    {}
+    Number getValue() const
+    {
+        return value;
+    }
+    Number cell(size_t) const
+    {
+        return value;
+    }
+};
+
+// images are kept as references, expressions (which are small and
+// often temporaries) and scalars by value
+template<class Operand>
+struct ImgOperand
+{
+    typedef const Operand type;
+};
+
+template<typename Number>
+struct ImgOperand<BasicImg<Number> >
+{
+    typedef const BasicImg<Number>& type;
+};
+
+struct ImgAdd
+{
+    template<typename A, typename B>
+    static auto apply(A a, B b) -> decltype(a + b)
+    {
+        return a + b;
+    }
+};
+
+struct ImgSubtract
+{
+    template<typename A, typename B>
+    static auto apply(A a, B b) -> decltype(a - b)
+    {
+        return a - b;
+    }
+};
+
+struct ImgMultiply
+{
+    template<typename A, typename B>
+    static auto apply(A a, B b) -> decltype(a * b)
+    {
+        return a * b;
+    }
+};
+
+struct ImgDivide
+{
+    template<typename A, typename B>
+    static auto apply(A a, B b) -> decltype(a / b)
+    {
+        return a / b;
+    }
+};
+
+/* Operation on each pair of cells (or a cell and a number)
+ *
+ * Throws runtime_error when the sizes of the images do not match.
+ */
+template<class Operation, class Left, class Right>
+class ImgBinary : public ImgExpression<ImgBinary<Operation, Left, Right> >
+{
+private:
+    typename ImgOperand<Left>::type left;
+    typename ImgOperand<Right>::type right;
+
+    template<class Other>
+    static bool same_size(const Left& left, const Other& right)
+    {
+        return left.getWidth() == right.getWidth()
+                && left.getHeight() == right.getHeight();
+    }
+    template<typename Number>
+    static bool same_size(const Left&, const ImgScalar<Number>&)
+    {
+        return true;
+    }
+public:
+    typedef typename Left::value_type value_type;
+
+    ImgBinary(const Left& left, const Right& right)
+        : left(left), right(right)
+    {
+        if (!same_size(left, right))
+            throw std::runtime_error("The height or width of one image do"
+                                     " not match with that of the other one.");
+    }
+
+    const Left& getLeft() const
+    {
+        return left;
+    }
+
+    const Right& getRight() const
+    {
+        return right;
+    }
+
+    int getWidth() const
+    {
+        return left.getWidth();
+    }
+
+    int getHeight() const
+    {
+        return left.getHeight();
+    }
+
+    int getWEResolution() const
+    {
+        return left.getWEResolution();
+    }
+
+    int getNSResolution() const
+    {
+        return left.getNSResolution();
+    }
+
+    // value of the cell with index row * width + col
+    value_type cell(size_t index) const
+    {
+        return Operation::apply(left.cell(index), right.cell(index));
+    }
+};
+
+template<class Left, class Right>
+ImgBinary<ImgAdd, Left, Right>
+operator+(const ImgExpression<Left>& left, const ImgExpression<Right>& right)
+{
+    return ImgBinary<ImgAdd, Left, Right>(left.expression(),
+                                          right.expression());
+}
+
+template<class Left, class Right>
+ImgBinary<ImgSubtract, Left, Right>
+operator-(const ImgExpression<Left>& left, const ImgExpression<Right>& right)
+{
+    return ImgBinary<ImgSubtract, Left, Right>(left.expression(),
+                                               right.expression());
+}
+
+template<class Left, class Right>
+ImgBinary<ImgMultiply, Left, Right>
+operator*(const ImgExpression<Left>& left, const ImgExpression<Right>& right)
+{
+    return ImgBinary<ImgMultiply, Left, Right>(left.expression(),
+                                               right.expression());
+}
+
+template<class Left, class Right>
+ImgBinary<ImgDivide, Left, Right>
+operator/(const ImgExpression<Left>& left, const ImgExpression<Right>& right)
+{
+    return ImgBinary<ImgDivide, Left, Right>(left.expression(),
+                                             right.expression());
+}
+
+template<class Left>
+ImgBinary<ImgMultiply, Left, ImgScalar<double> >
+operator*(const ImgExpression<Left>& left, double factor)
+{
+    return ImgBinary<ImgMultiply, Left, ImgScalar<double> >(
+                left.expression(), ImgScalar<double>(factor));
+}
+
+template<class Left>
+ImgBinary<ImgDivide, Left, ImgScalar<double> >
+operator/(const ImgExpression<Left>& left, double value)
+{
+    return ImgBinary<ImgDivide, Left, ImgScalar<double> >(
+                left.expression(), ImgScalar<double>(value));
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * SOD model - timings and counters of the simulation
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Instrumentation.h"
+
+#include <fstream>
+#include <stdexcept>
+
+using std::string;
+
+static const char *phase_names[NUM_PHASES] = {
+    "weather", "simulation", "statistics", "output", "checkpoint"
+};
+
+RunCounters& RunCounters::operator+=(const RunCounters& other)
+{
+    spore_gen_time += other.spore_gen_time;
+    spread_time += other.spread_time;
+    statistics_time += other.statistics_time;
+    spores += other.spores;
+    outside += other.outside;
+    no_hosts += other.no_hosts;
+    infected_umca += other.infected_umca;
+    infected_oaks += other.infected_oaks;
+    return *this;
+}
+
+static void write_counters(std::ostream& stream, const RunCounters& counters)
+{
+    stream << "\"spore_gen_s\": " << counters.spore_gen_time
+           << ", \"spread_s\": " << counters.spread_time
+           << ", \"statistics_s\": " << counters.statistics_time
+           << ", \"spores\": " << counters.spores
+           << ", \"outside\": " << counters.outside
+           << ", \"no_hosts\": " << counters.no_hosts
+           << ", \"infected_umca\": " << counters.infected_umca
+           << ", \"infected_oaks\": " << counters.infected_oaks;
+}
+
+static void write_phases(std::ostream& stream, const double *phases)
+{
+    stream << "{";
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+        stream << (phase ? ", \"" : "\"") << phase_names[phase] << "_s\": "
+               << phases[phase];
+    stream << "}";
+}
+
+InstrumentationReport::InstrumentationReport(unsigned first_run,
+                                             unsigned runs,
+                                             unsigned threads)
+    : first_run(first_run), runs(runs), threads(threads)
+{}
+
+InstrumentationReport::Year&
+InstrumentationReport::add_year(const string& date, unsigned weeks)
+{
+    Year year;
+    year.date = date;
+    year.weeks = weeks;
+    for (int phase = 0; phase < NUM_PHASES; phase++)
+        year.phases[phase] = 0;
+    year.runs.resize(runs);
+    years.push_back(year);
+    return years.back();
+}
+
+void InstrumentationReport::write(const char *filename,
+                                  double output_write_time) const
+{
+    std::ofstream stream(filename);
+    if (!stream)
+        throw std::runtime_error(string("Cannot create report ") + filename);
+    double totals[NUM_PHASES] = {0};
+    std::vector<RunCounters> run_totals(runs);
+    stream << "{\n  \"runs\": " << runs << ",\n  \"first_run\": "
+           << first_run << ",\n  \"threads\": " << threads
+           << ",\n  \"years\": [";
+    for (size_t y = 0; y < years.size(); y++) {
+        const Year& year = years[y];
+        stream << (y ? ",\n" : "\n") << "    {\"date\": \"" << year.date
+               << "\", \"weeks\": " << year.weeks << ", \"phases\": ";
+        write_phases(stream, year.phases);
+        stream << ",\n     \"runs\": [";
+        for (unsigned run = 0; run < runs; run++) {
+            stream << (run ? ",\n" : "\n") << "       {\"run\": "
+                   << first_run + run << ", ";
+            write_counters(stream, year.runs[run]);
+            stream << "}";
+            run_totals[run] += year.runs[run];
+        }
+        stream << "]}";
+        for (int phase = 0; phase < NUM_PHASES; phase++)
+            totals[phase] += year.phases[phase];
+    }
+    RunCounters total;
+    for (const auto& counters : run_totals)
+        total += counters;
+    stream << "\n  ],\n  \"totals\": {\"phases\": ";
+    write_phases(stream, totals);
+    // the rasters are written in a background thread
+    stream << ", \"output_write_s\": " << output_write_time << ", ";
+    write_counters(stream, total);
+    stream << "}\n}" << std::endl;
+    if (!stream)
+        throw std::runtime_error(string("Cannot write report ") + filename);
+}
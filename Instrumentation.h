@@ -0,0 +1,103 @@
+/*
+ * SOD model - timings and counters of the simulation
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/* The code in SOD_INSTRUMENT(...) is compiled only with
+ * SOD_INSTRUMENTATION defined (make INSTRUMENTATION=1), so the counting
+ * in the kernels costs nothing in the default build.
+ */
+#ifdef SOD_INSTRUMENTATION
+#define SOD_INSTRUMENT(...) __VA_ARGS__
+#else
+#define SOD_INSTRUMENT(...)
+#endif
+
+/* What happened in the kernels of one run
+ *
+ * Each run has its own counters (in its Sporulation), tiles count
+ * separately and are added at the end of the kernel, so the counting
+ * needs no synchronization.
+ */
+struct RunCounters
+{
+    double spore_gen_time;
+    double spread_time;
+    // adding the run to the statistics
+    double statistics_time;
+    uint64_t spores;
+    // spores which landed outside of the grid
+    uint64_t outside;
+    // spores which landed in a cell without susceptible hosts
+    uint64_t no_hosts;
+    uint64_t infected_umca;
+    uint64_t infected_oaks;
+
+    RunCounters()
+        :
+          spore_gen_time(0), spread_time(0), statistics_time(0),
+          spores(0), outside(0), no_hosts(0),
+          infected_umca(0), infected_oaks(0)
+    {}
+    RunCounters& operator+=(const RunCounters& other);
+};
+
+/* Parts of the simulation timed in the main thread */
+enum Phase
+{
+    PHASE_WEATHER, PHASE_SIMULATION, PHASE_STATISTICS, PHASE_OUTPUT,
+    PHASE_CHECKPOINT, NUM_PHASES
+};
+
+/* Timings and counters by year and run written as JSON */
+class InstrumentationReport
+{
+public:
+    struct Year
+    {
+        std::string date;
+        unsigned weeks;
+        double phases[NUM_PHASES];
+        std::vector<RunCounters> runs;
+    };
+
+    // first_run is the global index of the first run (of this process)
+    InstrumentationReport(unsigned first_run, unsigned runs,
+                          unsigned threads);
+    // the new year is used until the next call
+    Year& add_year(const std::string& date, unsigned weeks);
+    // the last year or nullptr (the phases after the end are added to it)
+    Year *last_year()
+    {
+        return years.empty() ? nullptr : &years.back();
+    }
+    // throws when the file cannot be written
+    void write(const char *filename, double output_write_time) const;
+
+private:
+    unsigned first_run;
+    unsigned runs;
+    unsigned threads;
+    std::vector<Year> years;
+};
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * SOD model - memory for rasters and the state of the runs
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Memory.h"
+
+#include <new>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+void *allocate_aligned(size_t bytes)
+{
+    // unique pointer also for empty buffers
+    if (!bytes)
+        bytes = 1;
+    size_t alignment = bytes >= huge_page_size ? huge_page_size
+                                               : cache_line_size;
+    void *pointer = nullptr;
+    if (posix_memalign(&pointer, alignment, bytes))
+        throw std::bad_alloc();
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    // only a hint, the memory is used with normal pages when it fails
+    if (alignment == huge_page_size)
+        madvise(pointer, bytes - bytes % huge_page_size, MADV_HUGEPAGE);
+#endif
+    return pointer;
+}
+
+void free_aligned(void *pointer)
+{
+    free(pointer);
+}
@@ -0,0 +1,83 @@
+/*
+ * SOD model - memory for rasters and the state of the runs
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstddef>
+#include <vector>
+
+// all buffers start at a cache line, so the state of different runs
+// (written by different threads) never shares a line
+const size_t cache_line_size = 64;
+// larger buffers are aligned to the huge page and use huge pages
+// where the system supports it (fewer TLB misses for random cells)
+const size_t huge_page_size = 2 * 1024 * 1024;
+
+/* Aligned memory which is not initialized
+ *
+ * The pages are not touched by the allocation, so on a NUMA system
+ * they are placed on the node of the thread which writes them first.
+ * Throws bad_alloc.
+ */
+void *allocate_aligned(size_t bytes);
+void free_aligned(void *pointer);
+
+template<typename Value>
+Value *allocate_values(size_t count)
+{
+    return static_cast<Value *>(allocate_aligned(count * sizeof(Value)));
+}
+
+/* Allocator for std::vector using allocate_aligned */
+template<typename Value>
+class AlignedAllocator
+{
+public:
+    typedef Value value_type;
+
+    AlignedAllocator() {}
+    template<typename Other>
+    AlignedAllocator(const AlignedAllocator<Other>&) {}
+
+    Value *allocate(size_t count)
+    {
+        return allocate_values<Value>(count);
+    }
+
+    void deallocate(Value *pointer, size_t)
+    {
+        free_aligned(pointer);
+    }
+};
+
+template<typename A, typename B>
+bool operator==(const AlignedAllocator<A>&, const AlignedAllocator<B>&)
+{
+    return true;
+}
+
+template<typename A, typename B>
+bool operator!=(const AlignedAllocator<A>&, const AlignedAllocator<B>&)
+{
+    return false;
+}
+
+template<typename Value>
+using AlignedVector = std::vector<Value, AlignedAllocator<Value> >;
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * SOD model - weather coefficients from NetCDF files
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "NetcdfWeather.h"
+
+#include <iostream>
+#include <cstdlib>
+
+using std::cerr;
+using std::endl;
+
+void get_spatial_weather(NcVar *mcf_nc, NcVar *ccf_nc, double* mcf, double* ccf, float* weather, int width, int height, int step)
+{
+    // read the weather information
+    if (!mcf_nc->set_cur(step, 0, 0)) {
+        cerr << "Can not read the coefficients from the mcf_nc pointer to mcf array " << step << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!ccf_nc->set_cur(step, 0, 0)) {
+        cerr << "Can not read the coefficients from the ccf_nc pointer to ccf array "<< step << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!mcf_nc->get(mcf, 1, height, width)) {
+        cerr << "Can not get the record from mcf_nc " << step << endl;
+        exit(EXIT_FAILURE);
+    }
+    if (!ccf_nc->get(ccf, 1, height, width)) {
+        cerr << "Can not get the record from ccf_nc " << step << endl;
+        exit(EXIT_FAILURE);
+    }
+    for (int j = 0; j < height; j++) {
+        for (int k = 0; k < width; k++) {
+            weather[j * width + k] = mcf[j * width + k] * ccf[j * width + k];
+        }
+    }
+}
@@ -0,0 +1,27 @@
+/*
+ * SOD model - weather coefficients from NetCDF files
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef NETCDFWEATHER_H
+#define NETCDFWEATHER_H
+
+#include <netcdfcpp.h>
+
+// multiplied moisture and temperature coefficients of one week,
+// mcf and ccf are buffers of the size of the weather grid
+void get_spatial_weather(NcVar *mcf_nc, NcVar *ccf_nc, double* mcf, double* ccf, float* weather, int width, int height, int step);
+
+#endif
@@ -0,0 +1,359 @@
+/*
+ * SOD model - random number generators
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+#include <iostream>
+
+// the generator is used also in device code (CUDA backend)
+#ifdef __CUDACC__
+#define SOD_HOST_DEVICE __host__ __device__
+#else
+#define SOD_HOST_DEVICE
+#endif
+
+/* Philox4x32-10 counter-based random number generator
+ *
+ * Maps a 128-bit counter and a 64-bit key to 128 random bits
+ * (Salmon et al. 2011, Parallel random numbers: as easy as 1, 2, 3).
+ * There is no state, so any number in any stream can be computed
+ * independently of the others.
+ */
+SOD_HOST_DEVICE
+inline void philox4x32(const uint32_t counter[4], const uint32_t key[2],
+                       uint32_t out[4])
+{
+    const uint32_t M0 = 0xD2511F53;
+    const uint32_t M1 = 0xCD9E8D57;
+    const uint32_t W0 = 0x9E3779B9;
+    const uint32_t W1 = 0xBB67AE85;
+
+    uint32_t c0 = counter[0], c1 = counter[1];
+    uint32_t c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = uint64_t(M0) * c0;
+        uint64_t p1 = uint64_t(M1) * c2;
+        uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+        c1 = uint32_t(p1);
+        c3 = uint32_t(p0);
+        c0 = n0;
+        c2 = n2;
+        k0 += W0;
+        k1 += W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+/* Stream of random numbers given by a key and three counter words
+ *
+ * The last counter word is the position in the stream. The class can be
+ * used as a generator for the standard library distributions.
+ */
+class CounterStream
+{
+public:
+    typedef uint32_t result_type;
+
+    SOD_HOST_DEVICE
+    CounterStream(uint32_t key, uint32_t a, uint32_t b, uint32_t c)
+        : position(4)
+    {
+        this->key[0] = key;
+        this->key[1] = 0;
+        counter[0] = a;
+        counter[1] = b;
+        counter[2] = c;
+        counter[3] = 0;
+    }
+
+    SOD_HOST_DEVICE result_type operator()()
+    {
+        if (position == 4) {
+            philox4x32(counter, key, block);
+            ++counter[3];
+            position = 0;
+        }
+        return block[position++];
+    }
+
+    SOD_HOST_DEVICE static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    SOD_HOST_DEVICE static constexpr result_type max()
+    {
+        return UINT32_MAX;
+    }
+
+private:
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t block[4];
+    unsigned position;
+};
+
+/* Engine of the sequential random numbers of a run
+ *
+ * The standard engine (std::default_random_engine) is used with
+ * the distributions of the standard library, the others with the
+ * samplers in Samplers.h.
+ */
+enum RandomEngine
+{
+    ENGINE_STD, ENGINE_XOSHIRO, ENGINE_PCG, ENGINE_PHILOX
+};
+
+// 64 bits of the seed state for the engines below (SplitMix64)
+inline uint64_t splitmix64(uint64_t& state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+/* xoshiro256++ generator (Blackman and Vigna 2018)
+ *
+ * 256 bits of state, period 2^256 - 1 and four additions, shifts and
+ * rotations per 64-bit number. The state is seeded by SplitMix64.
+ */
+class Xoshiro256pp
+{
+public:
+    typedef uint64_t result_type;
+
+    explicit Xoshiro256pp(unsigned seed_value = 1)
+    {
+        seed(seed_value);
+    }
+
+    void seed(unsigned seed_value)
+    {
+        uint64_t state = seed_value;
+        for (int i = 0; i < 4; i++)
+            s[i] = splitmix64(state);
+    }
+
+    result_type operator()()
+    {
+        uint64_t result = rotate(s[0] + s[3], 23) + s[0];
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotate(s[3], 45);
+        return result;
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return UINT64_MAX;
+    }
+
+    friend std::ostream& operator<<(std::ostream& stream,
+                                    const Xoshiro256pp& engine)
+    {
+        return stream << engine.s[0] << " " << engine.s[1] << " "
+                      << engine.s[2] << " " << engine.s[3];
+    }
+
+    friend std::istream& operator>>(std::istream& stream,
+                                    Xoshiro256pp& engine)
+    {
+        return stream >> engine.s[0] >> engine.s[1] >> engine.s[2]
+                      >> engine.s[3];
+    }
+
+private:
+    uint64_t s[4];
+
+    static uint64_t rotate(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+/* PCG64 generator (O'Neill 2014, PCG XSL RR 128/64)
+ *
+ * 128-bit linear congruential state with a permutation of its bits
+ * (xor of the halves rotated by the top six bits) as the output.
+ * The 128-bit arithmetic is done in 64-bit halves.
+ */
+class Pcg64
+{
+public:
+    typedef uint64_t result_type;
+
+    explicit Pcg64(unsigned seed_value = 1)
+    {
+        seed(seed_value);
+    }
+
+    // as pcg64 seeded with a number and its default stream
+    void seed(unsigned seed_value)
+    {
+        high = 0;
+        low = 0;
+        advance();
+        add(0, seed_value);
+        advance();
+    }
+
+    result_type operator()()
+    {
+        advance();
+        uint64_t value = high ^ low;
+        unsigned rotation = high >> 58;
+        return (value >> rotation) | (value << ((64 - rotation) & 63));
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return UINT64_MAX;
+    }
+
+    friend std::ostream& operator<<(std::ostream& stream,
+                                    const Pcg64& engine)
+    {
+        return stream << engine.high << " " << engine.low;
+    }
+
+    friend std::istream& operator>>(std::istream& stream, Pcg64& engine)
+    {
+        return stream >> engine.high >> engine.low;
+    }
+
+private:
+    uint64_t high;
+    uint64_t low;
+
+    void add(uint64_t add_high, uint64_t add_low)
+    {
+        low += add_low;
+        high += add_high + (low < add_low);
+    }
+
+    // state = state * multiplier + increment (mod 2^128)
+    void advance()
+    {
+        const uint64_t mul_high = 2549297995355413924ULL;
+        const uint64_t mul_low = 4865540595714422341ULL;
+        uint64_t a = low & 0xFFFFFFFF, b = low >> 32;
+        uint64_t c = mul_low & 0xFFFFFFFF, d = mul_low >> 32;
+        uint64_t ac = a * c, ad = a * d, bc = b * c, bd = b * d;
+        uint64_t middle = (ac >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF);
+        uint64_t product_high = bd + (ad >> 32) + (bc >> 32) + (middle >> 32);
+        high = product_high + high * mul_low + low * mul_high;
+        low = low * mul_low;
+        add(6364136223846793005ULL, 1442695040888963407ULL);
+    }
+};
+
+/* Philox4x32-10 as a sequential generator
+ *
+ * The key is the seed and the 64-bit counter is the position in the
+ * sequence (in blocks of four numbers).
+ */
+class PhiloxEngine
+{
+public:
+    typedef uint32_t result_type;
+
+    explicit PhiloxEngine(unsigned seed_value = 1)
+    {
+        seed(seed_value);
+    }
+
+    void seed(unsigned seed_value)
+    {
+        key[0] = seed_value;
+        key[1] = 0;
+        blocks = 0;
+        position = 4;
+    }
+
+    result_type operator()()
+    {
+        if (position == 4) {
+            uint32_t counter[4] = {0, 0, uint32_t(blocks),
+                                   uint32_t(blocks >> 32)};
+            philox4x32(counter, key, block);
+            ++blocks;
+            position = 0;
+        }
+        return block[position++];
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return UINT32_MAX;
+    }
+
+    // the current block is computed again when read
+    friend std::ostream& operator<<(std::ostream& stream,
+                                    const PhiloxEngine& engine)
+    {
+        return stream << engine.key[0] << " " << engine.blocks << " "
+                      << engine.position;
+    }
+
+    friend std::istream& operator>>(std::istream& stream,
+                                    PhiloxEngine& engine)
+    {
+        stream >> engine.key[0] >> engine.blocks >> engine.position;
+        engine.key[1] = 0;
+        if (engine.position < 4) {
+            uint64_t current = engine.blocks - 1;
+            uint32_t counter[4] = {0, 0, uint32_t(current),
+                                   uint32_t(current >> 32)};
+            philox4x32(counter, engine.key, engine.block);
+        }
+        return stream;
+    }
+
+private:
+    uint32_t key[2];
+    uint64_t blocks;
+    uint32_t block[4];
+    unsigned position;
+};
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * SOD model - writing of output rasters in a background thread
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "RasterWriter.h"
+#include "Tasks.h"
+
+#include <utility>
+
+RasterWriter::RasterWriter(unsigned max_queued,
+                           std::shared_ptr<const GdalOutput> gdal)
+    :
+      max_queued(max_queued ? max_queued : 1),
+      gdal(gdal),
+      writing(false),
+      stop(false),
+      wait_time(0),
+      written_time(0)
+{
+    if (gdal)
+        thread = std::thread(&RasterWriter::run, this);
+}
+
+RasterWriter::~RasterWriter()
+{
+    if (!gdal) {
+        write_queued();
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]{ return queue.empty() && !writing; });
+        stop = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
+
+void RasterWriter::write(BasicImg<double>&& image, const std::string& name)
+{
+    double start = wall_time();
+    if (!gdal) {
+        // only this thread uses the queue
+        while (queue.size() >= max_queued) {
+            Item item = std::move(queue.front());
+            queue.pop_front();
+            write_grass(item);
+        }
+        wait_time += wall_time() - start;
+        queue.push_back(Item{std::move(image), name});
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]{ return queue.size() < max_queued; });
+    wait_time += wall_time() - start;
+    check_error();
+    queue.push_back(Item{std::move(image), name});
+    lock.unlock();
+    changed.notify_all();
+}
+
+void RasterWriter::write_queued()
+{
+    if (gdal)
+        return;
+    while (!queue.empty()) {
+        Item item = std::move(queue.front());
+        queue.pop_front();
+        write_grass(item);
+    }
+}
+
+void RasterWriter::flush()
+{
+    if (!gdal) {
+        write_queued();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]{ return queue.empty() && !writing; });
+    check_error();
+}
+
+void RasterWriter::write_grass(Item& item)
+{
+    double start = wall_time();
+    item.image.toGrassRaster(item.name.c_str());
+    written_time += wall_time() - start;
+}
+
+// called with the lock held
+void RasterWriter::check_error()
+{
+    if (error) {
+        std::exception_ptr current = error;
+        error = nullptr;
+        std::rethrow_exception(current);
+    }
+}
+
+void RasterWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this]{ return stop || !queue.empty(); });
+        if (queue.empty())
+            return;
+        Item item = std::move(queue.front());
+        queue.pop_front();
+        writing = true;
+        // there is space in the queue now
+        changed.notify_all();
+        lock.unlock();
+        std::exception_ptr write_error;
+        double start = wall_time();
+        try {
+            item.image.toGdal(item.name.c_str(), *gdal);
+        }
+        catch (...) {
+            write_error = std::current_exception();
+        }
+        double time = wall_time() - start;
+        lock.lock();
+        written_time += time;
+        if (write_error && !error)
+            error = write_error;
+        writing = false;
+        changed.notify_all();
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * SOD model - writing of output rasters in a background thread
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef RASTERWRITER_H
+#define RASTERWRITER_H
+
+#include "Img.h"
+#include "GdalOutput.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/* Queue of raster files written in the background
+ *
+ * The rasters are moved into the queue, so the simulation can continue
+ * while they are written. At most the given number of rasters waits in
+ * the queue, write() blocks when the queue is full.
+ *
+ * GDAL rasters are written by a separate thread. GRASS rasters are
+ * written only by the thread which uses the writer (the main thread)
+ * because the GRASS library is not thread-safe and it ends the program
+ * from the thread which fails. They wait in the queue until
+ * write_queued() is called (e.g. while the other threads simulate),
+ * when the queue is full, write() writes the oldest one.
+ */
+class RasterWriter
+{
+public:
+    // with GDAL output, the names are file names and the rasters
+    // are written by a separate thread
+    explicit RasterWriter(unsigned max_queued,
+                          std::shared_ptr<const GdalOutput> gdal = nullptr);
+    // waits until all rasters are written (writes the GRASS rasters)
+    ~RasterWriter();
+    RasterWriter(const RasterWriter&) = delete;
+    RasterWriter& operator=(const RasterWriter&) = delete;
+
+    void write(BasicImg<double>&& image, const std::string& name);
+    // writes the queued GRASS rasters in the calling thread
+    // (nothing to do with GDAL)
+    void write_queued();
+    // waits until all rasters are written
+    void flush();
+    // time spent in write() waiting for space in the queue
+    // (or writing the oldest GRASS raster, in seconds)
+    double waited() const
+    {
+        return wait_time;
+    }
+    // time spent writing the rasters (in the writer thread with GDAL),
+    // complete after flush()
+    double write_time() const
+    {
+        return written_time;
+    }
+
+private:
+    struct Item
+    {
+        BasicImg<double> image;
+        std::string name;
+    };
+    unsigned max_queued;
+    std::shared_ptr<const GdalOutput> gdal;
+    std::deque<Item> queue;
+    // an item is being written
+    bool writing;
+    bool stop;
+    std::exception_ptr error;
+    double wait_time;
+    double written_time;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+
+    void run();
+    void write_grass(Item& item);
+    void check_error();
+};
+
+#endif
@@ -0,0 +1,450 @@
+/*
+ * SOD model - samplers of random variates
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef SAMPLERS_H
+#define SAMPLERS_H
+
+#include "Random.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <type_traits>
+
+#ifndef M_PI
+    #define M_PI 3.14159265358979323846
+#endif
+
+/* Counter-based stream used with the samplers below
+ *
+ * The tiled mode uses CounterStream with the standard distributions
+ * unless a different engine than the standard one is selected.
+ */
+class SampledStream : public CounterStream
+{
+public:
+    SampledStream(uint32_t key, uint32_t a, uint32_t b, uint32_t c)
+        : CounterStream(key, a, b, c)
+    {}
+};
+
+/* The generators sampled by the samplers below
+ *
+ * Their numbers use the whole range of the result type, so the samplers
+ * can convert them directly. Other generators (the standard engines
+ * and CounterStream) use the distributions of the standard library.
+ */
+template<class Generator>
+struct fast_sampling : std::false_type
+{};
+
+template<>
+struct fast_sampling<Xoshiro256pp> : std::true_type
+{};
+
+template<>
+struct fast_sampling<Pcg64> : std::true_type
+{};
+
+template<>
+struct fast_sampling<PhiloxEngine> : std::true_type
+{};
+
+template<>
+struct fast_sampling<SampledStream> : std::true_type
+{};
+
+/* Uniform number in (0, 1), so it can be used in logarithms
+ *
+ * From the top 53 bits of a 64-bit number or from a 32-bit number
+ * (the numbers are 2^-53 or 2^-32 apart, zero and one are never
+ * returned).
+ */
+template<class Generator>
+SOD_HOST_DEVICE inline double open_uniform(Generator& generator)
+{
+    if (sizeof(typename Generator::result_type) == 8)
+        return ((uint64_t(generator()) >> 11) + 0.5)
+                * (1.0 / 9007199254740992.0);
+    return (uint32_t(generator()) + 0.5) * (1.0 / 4294967296.0);
+}
+
+/* Tangent of pi / 2 * u for u in (0, 1)
+ *
+ * Rational approximation on (0, pi / 4] (Cephes tan) and cotangent of
+ * the complement for the rest, without the general argument reduction
+ * of std::tan. The relative error is below 5e-16.
+ */
+inline double tan_half_pi(double u)
+{
+    // 1 - u is exact for u >= 0.5
+    bool complement = u > 0.5;
+    double x = M_PI / 2 * (complement ? 1 - u : u);
+    double z = x * x;
+    double p = (-1.30936939181383777646e4 * z + 1.15351664838587416140e6)
+            * z - 1.79565251976484877988e7;
+    double q = (((z + 1.36812963470692954678e4) * z
+                 - 1.32089234440210967447e6) * z
+                + 2.50083801823357915839e7) * z - 5.38695755929454629881e7;
+    double tangent = x + x * z * p / q;
+    return complement ? 1 / tangent : tangent;
+}
+
+/* Uniform distribution over (a, b) from open_uniform() */
+class FastUniform
+{
+public:
+    explicit FastUniform(double a = 0.0, double b = 1.0)
+        : a(a), width(b - a)
+    {}
+    template<class Generator>
+    double operator()(Generator& generator) const
+    {
+        return a + width * open_uniform(generator);
+    }
+private:
+    double a;
+    double width;
+};
+
+/* True with the given probability, one uniform number */
+class FastBernoulli
+{
+public:
+    explicit FastBernoulli(double p)
+        : p(p)
+    {}
+    template<class Generator>
+    bool operator()(Generator& generator) const
+    {
+        return open_uniform(generator) < p;
+    }
+private:
+    double p;
+};
+
+/* Number of failures before the first success by inversion
+ *
+ * One uniform number and one logarithm, exact up to rounding
+ * (as the standard distribution, which uses the same inversion).
+ */
+class FastGeometric
+{
+public:
+    explicit FastGeometric(double p)
+        : log_failure(std::log1p(-p))
+    {}
+    template<class Generator>
+    long operator()(Generator& generator) const
+    {
+        double k = std::floor(std::log(open_uniform(generator))
+                              / log_failure);
+        // far beyond any number of spores
+        return k < 1e18 ? long(k) : long(1e18);
+    }
+private:
+    double log_failure;
+};
+
+/* Logarithm of k! on the host
+ *
+ * For k below 256, the value comes from a table. The table is filled
+ * on the first call; the initialization of the local static is
+ * thread-safe. Larger k use the Stirling series, whose error there is
+ * below 1e-20. Unlike lgamma, this does not write the global signgam,
+ * so the runs can call it in parallel.
+ */
+inline double host_log_factorial(double k)
+{
+    struct Table
+    {
+        double values[256];
+        Table()
+        {
+            values[0] = 0;
+            for (int i = 1; i < 256; i++)
+                values[i] = values[i - 1] + std::log(double(i));
+        }
+    };
+    static const Table table;
+    if (k < 256)
+        return table.values[int(k)];
+    double inverse = 1 / k;
+    double square = inverse * inverse;
+    return (k + 0.5) * std::log(k) - k + 0.5 * std::log(2 * M_PI)
+            + inverse * (1.0 / 12 - square * (1.0 / 360
+                                              - square * (1.0 / 1260)));
+}
+
+// lgamma of the device, which has no global state, in the CUDA kernels
+SOD_HOST_DEVICE inline double log_factorial(double k)
+{
+#ifdef __CUDA_ARCH__
+    return lgamma(k + 1);
+#else
+    return host_log_factorial(k);
+#endif
+}
+
+/* Poisson distribution
+ *
+ * Multiplication of uniforms for small means and transformed rejection
+ * with squeeze (PTRS, Hormann 1993) for the others. Both are exact
+ * methods, the distribution differs from the Poisson distribution only
+ * by rounding and the 32-bit or 53-bit resolution of the uniforms.
+ * PTRS needs about 1.15 pairs of uniforms per number for any mean
+ * (the squeeze accepts about 86% of the pairs without logarithms).
+ * The logarithms of the mean are computed only for the pairs which
+ * get to the rejection test, as most distributions are used for only
+ * one number (the spores of a cell).
+ * The CUDA backend uses the same sampler.
+ */
+class FastPoisson
+{
+public:
+    SOD_HOST_DEVICE explicit FastPoisson(double mean)
+        : mean(mean), limit(0), a(0), b(0), vr(0)
+    {
+        if (mean < 10) {
+            limit = exp(-mean);
+            return;
+        }
+        b = 0.931 + 2.53 * sqrt(mean);
+        a = -0.059 + 0.02483 * b;
+        vr = 0.9277 - 3.6224 / (b - 2);
+    }
+    template<class Generator>
+    SOD_HOST_DEVICE int operator()(Generator& generator) const
+    {
+        if (mean <= 0)
+            return 0;
+        if (mean < 10) {
+            double product = open_uniform(generator);
+            int k = 0;
+            while (product > limit) {
+                ++k;
+                product *= open_uniform(generator);
+            }
+            return k;
+        }
+        while (true) {
+            double u = open_uniform(generator) - 0.5;
+            double v = open_uniform(generator);
+            double us = 0.5 - fabs(u);
+            double k = floor((2 * a / us + b) * u + mean + 0.43);
+            if (us >= 0.07 && v <= vr)
+                return int(k);
+            if (k < 0 || (us < 0.013 && v > us))
+                continue;
+            double log_inv_alpha = log(1.1239 + 1.1328 / (b - 3.4));
+            if (log(v) + log_inv_alpha - log(a / (us * us) + b)
+                    <= -mean + k * log(mean) - log_factorial(k))
+                return int(k);
+        }
+    }
+private:
+    double mean;
+    double limit;
+    double a;
+    double b;
+    double vr;
+};
+
+/* Absolute value of a Cauchy variate (distance of the spores)
+ *
+ * The standard one takes the absolute value of std::cauchy_distribution
+ * (a tangent of pi times a uniform number), the fast one is the inverse
+ * of the half-Cauchy distribution with tan_half_pi().
+ */
+class StdHalfCauchy
+{
+public:
+    explicit StdHalfCauchy(double scale)
+        : distribution(0.0, scale)
+    {}
+    template<class Generator>
+    double operator()(Generator& generator)
+    {
+        return std::abs(distribution(generator));
+    }
+private:
+    std::cauchy_distribution<double> distribution;
+};
+
+class FastHalfCauchy
+{
+public:
+    explicit FastHalfCauchy(double scale)
+        : scale(scale)
+    {}
+    template<class Generator>
+    double operator()(Generator& generator) const
+    {
+        return scale * tan_half_pi(open_uniform(generator));
+    }
+private:
+    double scale;
+};
+
+/* Von Mises distribution from a table of its inverse
+ *
+ * The distribution function is integrated numerically (65536 intervals)
+ * and its inverse is stored for 4096 equal steps of probability, the
+ * first and the last step again in 4096 steps (the density changes most
+ * there when kappa is large). An angle is interpolated linearly between
+ * the two nearest values, so it needs one uniform number, no rejection
+ * and no trigonometric function. As measured for kappa from 0.001
+ * to 300, the distribution function of the angles differs from the
+ * exact one by less than 2.5e-5 (less than 1e-6 for kappa up to 2).
+ * Kappa close to zero is the uniform distribution as in
+ * von_mises_distribution.
+ */
+class VonMisesTable
+{
+public:
+    VonMisesTable()
+        : mu(0), uniform(true)
+    {}
+    VonMisesTable(double mu, double kappa)
+        : mu(mu), uniform(kappa <= 1.e-06)
+    {
+        if (uniform)
+            return;
+        // distribution function from -pi, the density is relative
+        // to its maximum to avoid overflow
+        std::vector<double> cumulative(intervals + 1, 0.0);
+        double h = 2 * M_PI / intervals;
+        double previous = std::exp(kappa * (std::cos(-M_PI) - 1));
+        for (int i = 1; i <= intervals; i++) {
+            double a = -M_PI + (i - 0.5) * h;
+            double b = -M_PI + i * h;
+            double middle = std::exp(kappa * (std::cos(a) - 1));
+            double end = std::exp(kappa * (std::cos(b) - 1));
+            // Simpson's rule on each interval
+            cumulative[i] = cumulative[i - 1]
+                    + h / 6 * (previous + 4 * middle + end);
+            previous = end;
+        }
+        for (double& value : cumulative)
+            value /= cumulative[intervals];
+        quantiles(cumulative, 0, 1, angles);
+        quantiles(cumulative, 0, 1.0 / steps, lower_tail);
+        quantiles(cumulative, 1 - 1.0 / steps, 1, upper_tail);
+    }
+
+    // angle for a uniform number in (0, 1)
+    double operator()(double u) const
+    {
+        if (uniform)
+            return 2 * M_PI * u;
+        double x = u * steps;
+        if (x < 1)
+            return mu + interpolate(lower_tail, x * steps);
+        if (x >= steps - 1)
+            return mu + interpolate(upper_tail, (x - (steps - 1)) * steps);
+        return mu + interpolate(angles, x);
+    }
+
+private:
+    static const int steps = 4096;
+    static const int intervals = 16 * steps;
+    double mu;
+    bool uniform;
+    std::vector<double> angles;
+    std::vector<double> lower_tail;
+    std::vector<double> upper_tail;
+
+    // angles for equal steps of probability from one value to another
+    static void quantiles(const std::vector<double>& cumulative,
+                          double from, double to, std::vector<double>& out)
+    {
+        double h = 2 * M_PI / intervals;
+        out.resize(steps + 1);
+        int i = 0;
+        for (int k = 0; k <= steps; k++) {
+            double target = from + (to - from) * k / steps;
+            while (i + 1 < intervals && cumulative[i + 1] < target)
+                ++i;
+            // the density is nearly linear in such a short interval
+            double share = 0;
+            if (cumulative[i + 1] > cumulative[i])
+                share = (target - cumulative[i])
+                        / (cumulative[i + 1] - cumulative[i]);
+            out[k] = -M_PI + (i + std::min(std::max(share, 0.0), 1.0)) * h;
+        }
+    }
+
+    static double interpolate(const std::vector<double>& values, double x)
+    {
+        int i = std::min(int(x), steps - 1);
+        double share = x - i;
+        return values[i] + share * (values[i + 1] - values[i]);
+    }
+};
+
+/* Distributions for the given generator
+ *
+ * The types are the standard distributions for the standard engines
+ * (so the results stay the same) and the samplers above for the others.
+ * The binomial distribution is always the standard one.
+ *
+ * The spores of a cell are the sum of the Poisson numbers of its trees.
+ * The sum has the Poisson distribution with the mean of the trees
+ * together, so the fast samplers draw only one number for a cell
+ * (as the CUDA backend), the standard one draws a number for each tree.
+ * So spores() gets both means (computed for blocks of cells by
+ * simd_spore_means).
+ */
+template<class Generator, bool fast = fast_sampling<Generator>::value>
+struct Samplers
+{
+    static const bool is_fast = false;
+    typedef std::uniform_real_distribution<double> Uniform;
+    typedef std::bernoulli_distribution Bernoulli;
+    typedef std::geometric_distribution<long> Geometric;
+    typedef std::poisson_distribution<int> Poisson;
+    typedef StdHalfCauchy HalfCauchy;
+
+    // spores of a cell from the mean of one tree and of all of them
+    static int spores(Generator& generator, int trees, double tree_mean,
+                      double)
+    {
+        Poisson distribution(tree_mean);
+        int sum = 0;
+        for (int k = 0; k < trees; k++)
+            sum += distribution(generator);
+        return sum;
+    }
+};
+
+template<class Generator>
+struct Samplers<Generator, true>
+{
+    static const bool is_fast = true;
+    typedef FastUniform Uniform;
+    typedef FastBernoulli Bernoulli;
+    typedef FastGeometric Geometric;
+    typedef FastPoisson Poisson;
+    typedef FastHalfCauchy HalfCauchy;
+
+    static int spores(Generator& generator, int, double,
+                      double cell_mean)
+    {
+        return Poisson(cell_mean)(generator);
+    }
+};
+
+#endif
@@ -0,0 +1,1066 @@
+/*
+ * SOD model - vectorized loops over raster values
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOD_SIMD_X86
+#ifndef __clang__
+// GCC 12 warns about the undefined upper halves in its own intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#ifndef __clang__
+#pragma GCC diagnostic pop
+#endif
+// the functions use the instructions, the rest of the module does not
+#define SOD_TARGET(instructions) __attribute__((target(instructions)))
+#elif defined(__aarch64__)
+#define SOD_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/* Plain loops, also used for the cells after the last whole vector */
+
+static void scalar_add(int *out, const int *a, const int *b, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] + b[i];
+}
+
+static void scalar_subtract(int *out, const int *a, const int *b,
+                            size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] - b[i];
+}
+
+static void scalar_multiply(int *out, const int *a, const int *b,
+                            size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] * b[i];
+}
+
+static void scalar_divide(int *out, const int *a, const int *b,
+                          size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] / b[i];
+}
+
+static void scalar_add_value(int *out, const int *a, int value,
+                             size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] + value;
+}
+
+static void scalar_multiply_value(int *out, const int *a, double value,
+                                  size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] * value;
+}
+
+static void scalar_divide_value(int *out, const int *a, double value,
+                                size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] / value;
+}
+
+static int64_t scalar_sum(const int *values, size_t count)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+        sum += values[i];
+    return sum;
+}
+
+static int64_t scalar_sum_where_positive(const int *values,
+                                         const int *condition, size_t count)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < count; i++)
+        if (condition[i] > 0)
+            sum += values[i];
+    return sum;
+}
+
+static size_t scalar_count_nonzero(const int *values, size_t count)
+{
+    size_t nonzero = 0;
+    for (size_t i = 0; i < count; i++)
+        if (values[i])
+            ++nonzero;
+    return nonzero;
+}
+
+static bool scalar_any_positive(const int *values, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if (values[i] > 0)
+            return true;
+    return false;
+}
+
+static void scalar_accumulate(const int *values, size_t count,
+                              int64_t *sums, int64_t *squares,
+                              unsigned *positives)
+{
+    for (size_t i = 0; i < count; i++) {
+        int64_t value = values[i];
+        sums[i] += value;
+        squares[i] += value * value;
+        if (value > 0)
+            positives[i] += 1;
+    }
+}
+
+static void scalar_add_sums(int64_t *a, const int64_t *b, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        a[i] += b[i];
+}
+
+static void scalar_add_counts(unsigned *a, const unsigned *b, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        a[i] += b[i];
+}
+
+// positive values are checked in blocks of this many cells
+static void scalar_spore_means(double *tree_means, double *cell_means,
+                               const int *trees, const double *weather,
+                               double rate, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        tree_means[i] = rate * weather[i];
+        cell_means[i] = trees[i] * tree_means[i];
+    }
+}
+
+static const size_t any_block = 64;
+
+#ifdef SOD_SIMD_X86
+
+/* AVX2, 8 cells in a vector */
+
+SOD_TARGET("avx2")
+static inline __m256i avx2_load(const int *values)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values));
+}
+
+SOD_TARGET("avx2")
+static inline void avx2_store(int *values, __m256i vector)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(values), vector);
+}
+
+SOD_TARGET("avx2")
+static void avx2_add(int *out, const int *a, const int *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx2_store(out + i, _mm256_add_epi32(avx2_load(a + i),
+                                             avx2_load(b + i)));
+    scalar_add(out + i, a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static void avx2_subtract(int *out, const int *a, const int *b,
+                          size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx2_store(out + i, _mm256_sub_epi32(avx2_load(a + i),
+                                             avx2_load(b + i)));
+    scalar_subtract(out + i, a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static void avx2_multiply(int *out, const int *a, const int *b,
+                          size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx2_store(out + i, _mm256_mullo_epi32(avx2_load(a + i),
+                                               avx2_load(b + i)));
+    scalar_multiply(out + i, a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static inline __m128i avx2_load_half(const int *values)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(values));
+}
+
+SOD_TARGET("avx2")
+static inline void avx2_store_half(int *values, __m128i vector)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(values), vector);
+}
+
+SOD_TARGET("avx2")
+static void avx2_divide(int *out, const int *a, const int *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d x = _mm256_cvtepi32_pd(avx2_load_half(a + i));
+        __m256d y = _mm256_cvtepi32_pd(avx2_load_half(b + i));
+        avx2_store_half(out + i, _mm256_cvttpd_epi32(_mm256_div_pd(x, y)));
+    }
+    scalar_divide(out + i, a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static void avx2_add_value(int *out, const int *a, int value, size_t count)
+{
+    __m256i added = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx2_store(out + i, _mm256_add_epi32(avx2_load(a + i), added));
+    scalar_add_value(out + i, a + i, value, count - i);
+}
+
+SOD_TARGET("avx2")
+static void avx2_multiply_value(int *out, const int *a, double value,
+                                size_t count)
+{
+    __m256d factor = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d x = _mm256_cvtepi32_pd(avx2_load_half(a + i));
+        avx2_store_half(out + i,
+                        _mm256_cvttpd_epi32(_mm256_mul_pd(x, factor)));
+    }
+    scalar_multiply_value(out + i, a + i, value, count - i);
+}
+
+SOD_TARGET("avx2")
+static void avx2_divide_value(int *out, const int *a, double value,
+                              size_t count)
+{
+    __m256d divisor = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d x = _mm256_cvtepi32_pd(avx2_load_half(a + i));
+        avx2_store_half(out + i,
+                        _mm256_cvttpd_epi32(_mm256_div_pd(x, divisor)));
+    }
+    scalar_divide_value(out + i, a + i, value, count - i);
+}
+
+SOD_TARGET("avx2")
+static inline int64_t avx2_total(__m256i sums)
+{
+    int64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), sums);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// adds the 8 values to the 4 sums of 64 bits
+SOD_TARGET("avx2")
+static inline __m256i avx2_add_wide(__m256i sums, __m256i values)
+{
+    sums = _mm256_add_epi64(
+                sums, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(values)));
+    return _mm256_add_epi64(
+                sums, _mm256_cvtepi32_epi64(
+                    _mm256_extracti128_si256(values, 1)));
+}
+
+SOD_TARGET("avx2")
+static int64_t avx2_sum(const int *values, size_t count)
+{
+    __m256i sums = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        sums = avx2_add_wide(sums, avx2_load(values + i));
+    return avx2_total(sums) + scalar_sum(values + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static int64_t avx2_sum_where_positive(const int *values,
+                                       const int *condition, size_t count)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i sums = zero;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i positive = _mm256_cmpgt_epi32(avx2_load(condition + i),
+                                              zero);
+        sums = avx2_add_wide(sums, _mm256_and_si256(avx2_load(values + i),
+                                                    positive));
+    }
+    return avx2_total(sums)
+            + scalar_sum_where_positive(values + i, condition + i,
+                                        count - i);
+}
+
+SOD_TARGET("avx2")
+static size_t avx2_count_nonzero(const int *values, size_t count)
+{
+    // minus the number of zeros in each lane (fits, count is below 2^34)
+    __m256i zero = _mm256_setzero_si256();
+    __m256i zeros = zero;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        zeros = _mm256_add_epi32(
+                    zeros, _mm256_cmpeq_epi32(avx2_load(values + i), zero));
+    int lanes[8];
+    avx2_store(lanes, zeros);
+    int64_t total = 0;
+    for (int lane : lanes)
+        total -= lane;
+    return i - total + scalar_count_nonzero(values + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static bool avx2_any_positive(const int *values, size_t count)
+{
+    __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + any_block <= count; i += any_block) {
+        __m256i positive = zero;
+        for (size_t j = i; j < i + any_block; j += 8)
+            positive = _mm256_or_si256(
+                        positive, _mm256_cmpgt_epi32(avx2_load(values + j),
+                                                     zero));
+        if (!_mm256_testz_si256(positive, positive))
+            return true;
+    }
+    return scalar_any_positive(values + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static inline __m256i avx2_load_wide(const int64_t *values)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values));
+}
+
+SOD_TARGET("avx2")
+static inline void avx2_store_wide(int64_t *values, __m256i vector)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(values), vector);
+}
+
+SOD_TARGET("avx2")
+static void avx2_accumulate(const int *values, size_t count, int64_t *sums,
+                            int64_t *squares, unsigned *positives)
+{
+    __m256i zero = _mm256_setzero_si256();
+    int *counts = reinterpret_cast<int *>(positives);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i value = avx2_load(values + i);
+        __m256i low = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(value));
+        __m256i high = _mm256_cvtepi32_epi64(
+                    _mm256_extracti128_si256(value, 1));
+        avx2_store_wide(sums + i, _mm256_add_epi64(avx2_load_wide(sums + i),
+                                                   low));
+        avx2_store_wide(sums + i + 4,
+                        _mm256_add_epi64(avx2_load_wide(sums + i + 4),
+                                         high));
+        // signed products of the low 32 bits of the lanes
+        avx2_store_wide(squares + i,
+                        _mm256_add_epi64(avx2_load_wide(squares + i),
+                                         _mm256_mul_epi32(low, low)));
+        avx2_store_wide(squares + i + 4,
+                        _mm256_add_epi64(avx2_load_wide(squares + i + 4),
+                                         _mm256_mul_epi32(high, high)));
+        // the comparison gives -1 for the positive values
+        avx2_store(counts + i,
+                   _mm256_sub_epi32(avx2_load(counts + i),
+                                    _mm256_cmpgt_epi32(value, zero)));
+    }
+    scalar_accumulate(values + i, count - i, sums + i, squares + i,
+                      positives + i);
+}
+
+SOD_TARGET("avx2")
+static void avx2_add_sums(int64_t *a, const int64_t *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        avx2_store_wide(a + i, _mm256_add_epi64(avx2_load_wide(a + i),
+                                                avx2_load_wide(b + i)));
+    scalar_add_sums(a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static void avx2_add_counts(unsigned *a, const unsigned *b, size_t count)
+{
+    int *out = reinterpret_cast<int *>(a);
+    const int *in = reinterpret_cast<const int *>(b);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx2_store(out + i, _mm256_add_epi32(avx2_load(out + i),
+                                             avx2_load(in + i)));
+    scalar_add_counts(a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx2")
+static void avx2_spore_means(double *tree_means, double *cell_means,
+                             const int *trees, const double *weather,
+                             double rate, size_t count)
+{
+    __m256d factor = _mm256_set1_pd(rate);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d tree = _mm256_mul_pd(factor, _mm256_loadu_pd(weather + i));
+        _mm256_storeu_pd(tree_means + i, tree);
+        _mm256_storeu_pd(cell_means + i,
+                         _mm256_mul_pd(_mm256_cvtepi32_pd(
+                                           avx2_load_half(trees + i)),
+                                       tree));
+    }
+    scalar_spore_means(tree_means + i, cell_means + i, trees + i,
+                       weather + i, rate, count - i);
+}
+
+/* AVX-512 (only the foundation), 16 cells in a vector */
+
+SOD_TARGET("avx512f")
+static inline __m512i avx512_load(const void *values)
+{
+    return _mm512_loadu_si512(values);
+}
+
+SOD_TARGET("avx512f")
+static inline void avx512_store(void *values, __m512i vector)
+{
+    _mm512_storeu_si512(values, vector);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_add(int *out, const int *a, const int *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        avx512_store(out + i, _mm512_add_epi32(avx512_load(a + i),
+                                               avx512_load(b + i)));
+    scalar_add(out + i, a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_subtract(int *out, const int *a, const int *b,
+                            size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        avx512_store(out + i, _mm512_sub_epi32(avx512_load(a + i),
+                                               avx512_load(b + i)));
+    scalar_subtract(out + i, a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_multiply(int *out, const int *a, const int *b,
+                            size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        avx512_store(out + i, _mm512_mullo_epi32(avx512_load(a + i),
+                                                 avx512_load(b + i)));
+    scalar_multiply(out + i, a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static inline __m512d avx512_load_doubles(const int *values)
+{
+    return _mm512_cvtepi32_pd(_mm256_loadu_si256(
+                                  reinterpret_cast<const __m256i *>(values)));
+}
+
+SOD_TARGET("avx512f")
+static inline void avx512_store_truncated(int *values, __m512d vector)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(values),
+                        _mm512_cvttpd_epi32(vector));
+}
+
+SOD_TARGET("avx512f")
+static void avx512_divide(int *out, const int *a, const int *b,
+                          size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx512_store_truncated(out + i,
+                               _mm512_div_pd(avx512_load_doubles(a + i),
+                                             avx512_load_doubles(b + i)));
+    scalar_divide(out + i, a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_add_value(int *out, const int *a, int value,
+                             size_t count)
+{
+    __m512i added = _mm512_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        avx512_store(out + i, _mm512_add_epi32(avx512_load(a + i), added));
+    scalar_add_value(out + i, a + i, value, count - i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_multiply_value(int *out, const int *a, double value,
+                                  size_t count)
+{
+    __m512d factor = _mm512_set1_pd(value);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx512_store_truncated(out + i,
+                               _mm512_mul_pd(avx512_load_doubles(a + i),
+                                             factor));
+    scalar_multiply_value(out + i, a + i, value, count - i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_divide_value(int *out, const int *a, double value,
+                                size_t count)
+{
+    __m512d divisor = _mm512_set1_pd(value);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx512_store_truncated(out + i,
+                               _mm512_div_pd(avx512_load_doubles(a + i),
+                                             divisor));
+    scalar_divide_value(out + i, a + i, value, count - i);
+}
+
+// adds the 16 values to the 8 sums of 64 bits
+SOD_TARGET("avx512f")
+static inline __m512i avx512_add_wide(__m512i sums, __m512i values)
+{
+    sums = _mm512_add_epi64(
+                sums, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(values)));
+    return _mm512_add_epi64(
+                sums, _mm512_cvtepi32_epi64(
+                    _mm512_extracti64x4_epi64(values, 1)));
+}
+
+SOD_TARGET("avx512f")
+static int64_t avx512_sum(const int *values, size_t count)
+{
+    __m512i sums = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        sums = avx512_add_wide(sums, avx512_load(values + i));
+    return _mm512_reduce_add_epi64(sums) + scalar_sum(values + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static int64_t avx512_sum_where_positive(const int *values,
+                                         const int *condition, size_t count)
+{
+    __m512i zero = _mm512_setzero_si512();
+    __m512i sums = zero;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __mmask16 positive = _mm512_cmpgt_epi32_mask(
+                    avx512_load(condition + i), zero);
+        sums = avx512_add_wide(sums, _mm512_maskz_mov_epi32(
+                                   positive, avx512_load(values + i)));
+    }
+    return _mm512_reduce_add_epi64(sums)
+            + scalar_sum_where_positive(values + i, condition + i,
+                                        count - i);
+}
+
+SOD_TARGET("avx512f")
+static size_t avx512_count_nonzero(const int *values, size_t count)
+{
+    __m512i zero = _mm512_setzero_si512();
+    size_t nonzero = 0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        nonzero += __builtin_popcount(
+                    _mm512_cmpneq_epi32_mask(avx512_load(values + i), zero));
+    return nonzero + scalar_count_nonzero(values + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static bool avx512_any_positive(const int *values, size_t count)
+{
+    __m512i zero = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + any_block <= count; i += any_block) {
+        __mmask16 positive = 0;
+        for (size_t j = i; j < i + any_block; j += 16)
+            positive |= _mm512_cmpgt_epi32_mask(avx512_load(values + j),
+                                                zero);
+        if (positive)
+            return true;
+    }
+    return scalar_any_positive(values + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_accumulate(const int *values, size_t count,
+                              int64_t *sums, int64_t *squares,
+                              unsigned *positives)
+{
+    __m512i zero = _mm512_setzero_si512();
+    __m512i one = _mm512_set1_epi32(1);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512i value = avx512_load(values + i);
+        __m512i low = _mm512_cvtepi32_epi64(_mm512_castsi512_si256(value));
+        __m512i high = _mm512_cvtepi32_epi64(
+                    _mm512_extracti64x4_epi64(value, 1));
+        avx512_store(sums + i, _mm512_add_epi64(avx512_load(sums + i), low));
+        avx512_store(sums + i + 8,
+                     _mm512_add_epi64(avx512_load(sums + i + 8), high));
+        // signed products of the low 32 bits of the lanes
+        avx512_store(squares + i,
+                     _mm512_add_epi64(avx512_load(squares + i),
+                                      _mm512_mul_epi32(low, low)));
+        avx512_store(squares + i + 8,
+                     _mm512_add_epi64(avx512_load(squares + i + 8),
+                                      _mm512_mul_epi32(high, high)));
+        __m512i counts = avx512_load(positives + i);
+        avx512_store(positives + i, _mm512_mask_add_epi32(
+                         counts, _mm512_cmpgt_epi32_mask(value, zero),
+                         counts, one));
+    }
+    scalar_accumulate(values + i, count - i, sums + i, squares + i,
+                      positives + i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_add_sums(int64_t *a, const int64_t *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        avx512_store(a + i, _mm512_add_epi64(avx512_load(a + i),
+                                             avx512_load(b + i)));
+    scalar_add_sums(a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_add_counts(unsigned *a, const unsigned *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        avx512_store(a + i, _mm512_add_epi32(avx512_load(a + i),
+                                             avx512_load(b + i)));
+    scalar_add_counts(a + i, b + i, count - i);
+}
+
+SOD_TARGET("avx512f")
+static void avx512_spore_means(double *tree_means, double *cell_means,
+                               const int *trees, const double *weather,
+                               double rate, size_t count)
+{
+    __m512d factor = _mm512_set1_pd(rate);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m512d tree = _mm512_mul_pd(factor, _mm512_loadu_pd(weather + i));
+        _mm512_storeu_pd(tree_means + i, tree);
+        _mm512_storeu_pd(cell_means + i,
+                         _mm512_mul_pd(avx512_load_doubles(trees + i),
+                                       tree));
+    }
+    scalar_spore_means(tree_means + i, cell_means + i, trees + i,
+                       weather + i, rate, count - i);
+}
+
+#endif
+
+#ifdef SOD_SIMD_NEON
+
+/* NEON, 4 cells in a vector */
+
+static void neon_add(int *out, const int *a, const int *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_s32(out + i, vaddq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    scalar_add(out + i, a + i, b + i, count - i);
+}
+
+static void neon_subtract(int *out, const int *a, const int *b,
+                          size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_s32(out + i, vsubq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    scalar_subtract(out + i, a + i, b + i, count - i);
+}
+
+static void neon_multiply(int *out, const int *a, const int *b,
+                          size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_s32(out + i, vmulq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    scalar_multiply(out + i, a + i, b + i, count - i);
+}
+
+static inline float64x2_t neon_load_doubles(const int *values)
+{
+    return vcvtq_f64_s64(vmovl_s32(vld1_s32(values)));
+}
+
+// truncated as the conversion to int
+static inline void neon_store_truncated(int *values, float64x2_t vector)
+{
+    vst1_s32(values, vmovn_s64(vcvtq_s64_f64(vector)));
+}
+
+static void neon_divide(int *out, const int *a, const int *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+        neon_store_truncated(out + i, vdivq_f64(neon_load_doubles(a + i),
+                                                neon_load_doubles(b + i)));
+    scalar_divide(out + i, a + i, b + i, count - i);
+}
+
+static void neon_add_value(int *out, const int *a, int value, size_t count)
+{
+    int32x4_t added = vdupq_n_s32(value);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_s32(out + i, vaddq_s32(vld1q_s32(a + i), added));
+    scalar_add_value(out + i, a + i, value, count - i);
+}
+
+static void neon_multiply_value(int *out, const int *a, double value,
+                                size_t count)
+{
+    float64x2_t factor = vdupq_n_f64(value);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+        neon_store_truncated(out + i, vmulq_f64(neon_load_doubles(a + i),
+                                                factor));
+    scalar_multiply_value(out + i, a + i, value, count - i);
+}
+
+static void neon_divide_value(int *out, const int *a, double value,
+                              size_t count)
+{
+    float64x2_t divisor = vdupq_n_f64(value);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+        neon_store_truncated(out + i, vdivq_f64(neon_load_doubles(a + i),
+                                                divisor));
+    scalar_divide_value(out + i, a + i, value, count - i);
+}
+
+static int64_t neon_sum(const int *values, size_t count)
+{
+    int64x2_t sums = vdupq_n_s64(0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        sums = vpadalq_s32(sums, vld1q_s32(values + i));
+    return vaddvq_s64(sums) + scalar_sum(values + i, count - i);
+}
+
+static int64_t neon_sum_where_positive(const int *values,
+                                       const int *condition, size_t count)
+{
+    int32x4_t zero = vdupq_n_s32(0);
+    int64x2_t sums = vdupq_n_s64(0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t positive = vcgtq_s32(vld1q_s32(condition + i), zero);
+        sums = vpadalq_s32(sums, vandq_s32(vld1q_s32(values + i),
+                                           vreinterpretq_s32_u32(positive)));
+    }
+    return vaddvq_s64(sums)
+            + scalar_sum_where_positive(values + i, condition + i,
+                                        count - i);
+}
+
+static size_t neon_count_nonzero(const int *values, size_t count)
+{
+    // the test gives all bits (i.e. minus one) for the nonzero values
+    uint32x4_t nonzero = vdupq_n_u32(0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32x4_t value = vld1q_s32(values + i);
+        nonzero = vsubq_u32(nonzero, vtstq_s32(value, value));
+    }
+    return vaddlvq_u32(nonzero)
+            + scalar_count_nonzero(values + i, count - i);
+}
+
+static bool neon_any_positive(const int *values, size_t count)
+{
+    size_t i = 0;
+    for (; i + any_block <= count; i += any_block) {
+        int32x4_t largest = vld1q_s32(values + i);
+        for (size_t j = i + 4; j < i + any_block; j += 4)
+            largest = vmaxq_s32(largest, vld1q_s32(values + j));
+        if (vmaxvq_s32(largest) > 0)
+            return true;
+    }
+    return scalar_any_positive(values + i, count - i);
+}
+
+static void neon_accumulate(const int *values, size_t count, int64_t *sums,
+                            int64_t *squares, unsigned *positives)
+{
+    int32x4_t zero = vdupq_n_s32(0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32x4_t value = vld1q_s32(values + i);
+        int32x2_t low = vget_low_s32(value);
+        int32x2_t high = vget_high_s32(value);
+        vst1q_s64(sums + i, vaddq_s64(vld1q_s64(sums + i), vmovl_s32(low)));
+        vst1q_s64(sums + i + 2, vaddq_s64(vld1q_s64(sums + i + 2),
+                                          vmovl_s32(high)));
+        vst1q_s64(squares + i, vmlal_s32(vld1q_s64(squares + i), low, low));
+        vst1q_s64(squares + i + 2, vmlal_s32(vld1q_s64(squares + i + 2),
+                                             high, high));
+        // the comparison gives all bits (minus one) for positive values
+        vst1q_u32(positives + i, vsubq_u32(vld1q_u32(positives + i),
+                                           vcgtq_s32(value, zero)));
+    }
+    scalar_accumulate(values + i, count - i, sums + i, squares + i,
+                      positives + i);
+}
+
+static void neon_add_sums(int64_t *a, const int64_t *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+        vst1q_s64(a + i, vaddq_s64(vld1q_s64(a + i), vld1q_s64(b + i)));
+    scalar_add_sums(a + i, b + i, count - i);
+}
+
+static void neon_add_counts(unsigned *a, const unsigned *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_u32(a + i, vaddq_u32(vld1q_u32(a + i), vld1q_u32(b + i)));
+    scalar_add_counts(a + i, b + i, count - i);
+}
+
+static void neon_spore_means(double *tree_means, double *cell_means,
+                             const int *trees, const double *weather,
+                             double rate, size_t count)
+{
+    float64x2_t factor = vdupq_n_f64(rate);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        float64x2_t tree = vmulq_f64(factor, vld1q_f64(weather + i));
+        vst1q_f64(tree_means + i, tree);
+        vst1q_f64(cell_means + i,
+                  vmulq_f64(neon_load_doubles(trees + i), tree));
+    }
+    scalar_spore_means(tree_means + i, cell_means + i, trees + i,
+                       weather + i, rate, count - i);
+}
+
+#endif
+
+/* The loops for one instruction set */
+struct SimdKernels
+{
+    SimdInstructions instructions;
+    void (*add)(int *, const int *, const int *, size_t);
+    void (*subtract)(int *, const int *, const int *, size_t);
+    void (*multiply)(int *, const int *, const int *, size_t);
+    void (*divide)(int *, const int *, const int *, size_t);
+    void (*add_value)(int *, const int *, int, size_t);
+    void (*multiply_value)(int *, const int *, double, size_t);
+    void (*divide_value)(int *, const int *, double, size_t);
+    int64_t (*sum)(const int *, size_t);
+    int64_t (*sum_where_positive)(const int *, const int *, size_t);
+    size_t (*count_nonzero)(const int *, size_t);
+    bool (*any_positive)(const int *, size_t);
+    void (*accumulate)(const int *, size_t, int64_t *, int64_t *,
+                       unsigned *);
+    void (*add_sums)(int64_t *, const int64_t *, size_t);
+    void (*add_counts)(unsigned *, const unsigned *, size_t);
+    void (*spore_means)(double *, double *, const int *, const double *,
+                        double, size_t);
+};
+
+static SimdKernels kernels_for(SimdInstructions instructions)
+{
+    switch (instructions) {
+#ifdef SOD_SIMD_X86
+    case SIMD_AVX512:
+        return {SIMD_AVX512, avx512_add, avx512_subtract, avx512_multiply,
+                avx512_divide, avx512_add_value, avx512_multiply_value,
+                avx512_divide_value, avx512_sum, avx512_sum_where_positive,
+                avx512_count_nonzero, avx512_any_positive,
+                avx512_accumulate, avx512_add_sums, avx512_add_counts,
+                avx512_spore_means};
+    case SIMD_AVX2:
+        return {SIMD_AVX2, avx2_add, avx2_subtract, avx2_multiply,
+                avx2_divide, avx2_add_value, avx2_multiply_value,
+                avx2_divide_value, avx2_sum, avx2_sum_where_positive,
+                avx2_count_nonzero, avx2_any_positive, avx2_accumulate,
+                avx2_add_sums, avx2_add_counts, avx2_spore_means};
+#endif
+#ifdef SOD_SIMD_NEON
+    case SIMD_NEON:
+        return {SIMD_NEON, neon_add, neon_subtract, neon_multiply,
+                neon_divide, neon_add_value, neon_multiply_value,
+                neon_divide_value, neon_sum, neon_sum_where_positive,
+                neon_count_nonzero, neon_any_positive, neon_accumulate,
+                neon_add_sums, neon_add_counts, neon_spore_means};
+#endif
+    default:
+        return {SIMD_SCALAR, scalar_add, scalar_subtract, scalar_multiply,
+                scalar_divide, scalar_add_value, scalar_multiply_value,
+                scalar_divide_value, scalar_sum, scalar_sum_where_positive,
+                scalar_count_nonzero, scalar_any_positive, scalar_accumulate,
+                scalar_add_sums, scalar_add_counts, scalar_spore_means};
+    }
+}
+
+// selected when first used (initialization of the static is thread-safe)
+static SimdKernels& kernels()
+{
+    static SimdKernels selected = kernels_for(simd_supported());
+    return selected;
+}
+
+const char *simd_name(SimdInstructions instructions)
+{
+    switch (instructions) {
+    case SIMD_AVX2:
+        return "avx2";
+    case SIMD_AVX512:
+        return "avx512";
+    case SIMD_NEON:
+        return "neon";
+    default:
+        return "scalar";
+    }
+}
+
+SimdInstructions simd_supported()
+{
+#if defined(SOD_SIMD_X86)
+    // also checks that the system saves the registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    return SIMD_SCALAR;
+#elif defined(SOD_SIMD_NEON)
+    return SIMD_NEON;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+SimdInstructions simd_used()
+{
+    return kernels().instructions;
+}
+
+SimdInstructions simd_use(SimdInstructions instructions)
+{
+    SimdInstructions supported = simd_supported();
+    bool available = instructions == supported
+            || (instructions == SIMD_AVX2 && supported == SIMD_AVX512);
+    kernels() = kernels_for(available ? instructions : SIMD_SCALAR);
+    return kernels().instructions;
+}
+
+void simd_add(int *out, const int *a, const int *b, size_t count)
+{
+    kernels().add(out, a, b, count);
+}
+
+void simd_subtract(int *out, const int *a, const int *b, size_t count)
+{
+    kernels().subtract(out, a, b, count);
+}
+
+void simd_multiply(int *out, const int *a, const int *b, size_t count)
+{
+    kernels().multiply(out, a, b, count);
+}
+
+void simd_divide(int *out, const int *a, const int *b, size_t count)
+{
+    kernels().divide(out, a, b, count);
+}
+
+void simd_add_value(int *out, const int *a, int value, size_t count)
+{
+    kernels().add_value(out, a, value, count);
+}
+
+void simd_multiply_value(int *out, const int *a, double value,
+                         size_t count)
+{
+    kernels().multiply_value(out, a, value, count);
+}
+
+void simd_divide_value(int *out, const int *a, double value, size_t count)
+{
+    kernels().divide_value(out, a, value, count);
+}
+
+int64_t simd_sum(const int *values, size_t count)
+{
+    return kernels().sum(values, count);
+}
+
+int64_t simd_sum_where_positive(const int *values, const int *condition,
+                                size_t count)
+{
+    return kernels().sum_where_positive(values, condition, count);
+}
+
+size_t simd_count_nonzero(const int *values, size_t count)
+{
+    return kernels().count_nonzero(values, count);
+}
+
+bool simd_any_positive(const int *values, size_t count)
+{
+    return kernels().any_positive(values, count);
+}
+
+void simd_accumulate(const int *values, size_t count, int64_t *sums,
+                     int64_t *squares, unsigned *positives)
+{
+    kernels().accumulate(values, count, sums, squares, positives);
+}
+
+void simd_add_to(int64_t *a, const int64_t *b, size_t count)
+{
+    kernels().add_sums(a, b, count);
+}
+
+void simd_add_to(unsigned *a, const unsigned *b, size_t count)
+{
+    kernels().add_counts(a, b, count);
+}
+
+void simd_spore_means(double *tree_means, double *cell_means,
+                      const int *trees, const double *weather, double rate,
+                      size_t count)
+{
+    kernels().spore_means(tree_means, cell_means, trees, weather, rate,
+                          count);
+}
@@ -0,0 +1,98 @@
+/*
+ * SOD model - vectorized loops over raster values
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <stdint.h>
+
+/* Instruction sets of the loops
+ *
+ * On x86, the AVX-512 and AVX2 loops are compiled into the module
+ * regardless of the compiler flags and the best one the processor
+ * supports is selected when a loop is called for the first time.
+ * NEON is used on 64-bit ARM, where it is always available (it has
+ * no double precision on 32-bit ARM). Otherwise the plain loops are used.
+ */
+enum SimdInstructions
+{
+    SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512, SIMD_NEON
+};
+
+// name for reports (scalar, avx2, avx512 or neon)
+const char *simd_name(SimdInstructions instructions);
+// best instructions supported by the processor
+SimdInstructions simd_supported();
+// instructions used by the loops below
+SimdInstructions simd_used();
+// use other instructions (e.g. to compare them in benchmarks)
+// when they are supported, otherwise the plain loops, returns the ones
+// used, must not be called while the loops run in other threads
+SimdInstructions simd_use(SimdInstructions instructions);
+
+/* Loops over arrays of the given number of int cells
+ *
+ * The results are the same with all instruction sets and the same as
+ * the plain C++ loops would give, i.e. the multiplication and division
+ * by a double truncate the result to int. The division of two ints is
+ * computed in double precision, which gives the exact quotient for
+ * all 32-bit integers (the rounding never reaches the next integer).
+ * The output can be the same array as an input. The arrays do not have
+ * to be aligned, but the loads are faster when they are (rasters are
+ * aligned to a cache line, see Memory.h).
+ */
+void simd_add(int *out, const int *a, const int *b, size_t count);
+void simd_subtract(int *out, const int *a, const int *b, size_t count);
+void simd_multiply(int *out, const int *a, const int *b, size_t count);
+void simd_divide(int *out, const int *a, const int *b, size_t count);
+void simd_add_value(int *out, const int *a, int value, size_t count);
+void simd_multiply_value(int *out, const int *a, double value,
+                         size_t count);
+void simd_divide_value(int *out, const int *a, double value, size_t count);
+
+// sum of all values (64-bit, so it cannot overflow for rasters)
+int64_t simd_sum(const int *values, size_t count);
+// sum of the values where the condition is greater than zero
+int64_t simd_sum_where_positive(const int *values, const int *condition,
+                                size_t count);
+size_t simd_count_nonzero(const int *values, size_t count);
+// stops at the first block with a positive value
+bool simd_any_positive(const int *values, size_t count);
+
+/* Adds values of one run to the sums over the runs
+ *
+ * The sums and squares of the values and the numbers of values
+ * greater than zero (as in RasterSums) are updated in one pass.
+ */
+void simd_accumulate(const int *values, size_t count, int64_t *sums,
+                     int64_t *squares, unsigned *positives);
+// element-wise a += b
+void simd_add_to(int64_t *a, const int64_t *b, size_t count);
+void simd_add_to(unsigned *a, const unsigned *b, size_t count);
+
+/* Poisson means of the spores of a block of cells
+ *
+ * The mean of one tree is the rate times the weather coefficient
+ * of its cell and the mean of the cell is the trees times that.
+ * Both are the same as the plain multiplications in that order.
+ */
+void simd_spore_means(double *tree_means, double *cell_means,
+                      const int *trees, const double *weather, double rate,
+                      size_t count);
+
+#endif
@@ -0,0 +1,1076 @@
+/*
+ * SOD model - simulation of the stochastic runs
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Simulation.h"
+#include "Simd.h"
+#include "HostState.h"
+#ifdef HAVE_CUDA
+#include "DeviceEnsemble.h"
+#endif
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <stdint.h>
+
+using std::string;
+using std::cerr;
+using std::endl;
+
+// Initialize infected trees for each species
+// needed unless empirical info is available
+static int initial_infected_umca(int umca, int I_oaks)
+{
+    if (I_oaks > 0) {
+        if (umca > I_oaks)
+            return umca < (I_oaks * 2) ? umca : (I_oaks * 2);
+        else
+            return umca;
+    }
+    return 0;
+}
+
+// counts the hosts with one scan of the rasters
+template<typename Raster>
+static HostTotals count_hosts(const Raster& S_umca, const Raster& S_oaks,
+                              const Raster& I_umca, const Raster& I_oaks)
+{
+    HostTotals totals;
+    for (int i = 0; i < S_umca.getHeight(); i++) {
+        for (int j = 0; j < S_umca.getWidth(); j++) {
+            totals.S_umca += S_umca(i, j);
+            totals.S_oaks += S_oaks(i, j);
+            totals.I_umca += I_umca(i, j);
+            totals.I_oaks += I_oaks(i, j);
+            if (I_umca(i, j) > 0)
+                totals.exposed_S_oaks += S_oaks(i, j);
+        }
+    }
+    return totals;
+}
+
+// int rasters are summed with the vector instructions, one pass each
+static HostTotals count_hosts(const Img& S_umca, const Img& S_oaks,
+                              const Img& I_umca, const Img& I_oaks)
+{
+    HostTotals totals;
+    size_t cells = size_t(S_umca.getWidth()) * S_umca.getHeight();
+    totals.S_umca = S_umca.sum();
+    totals.S_oaks = S_oaks.sum();
+    totals.I_umca = I_umca.sum();
+    totals.I_oaks = I_oaks.sum();
+    totals.exposed_S_oaks = simd_sum_where_positive(S_oaks.values(),
+                                                    I_umca.values(), cells);
+    return totals;
+}
+
+std::vector<unsigned> weeks_until_year_end(unsigned week, Date date,
+                                           const Date& end,
+                                           bool seasonality)
+{
+    std::vector<unsigned> weeks;
+    for (; ; week++, date.increasedByWeek()) {
+        if (date < end)
+            if (!seasonality || !(date.getMonth() > 9))
+                weeks.push_back(week);
+        if (date.isYearEnd() || date >= end)
+            break;
+    }
+    return weeks;
+}
+
+void WeatherValues::prepare(const std::vector<unsigned>& weeks)
+{
+    if (!values.empty() && weeks.back() >= values.size())
+        throw std::runtime_error(
+                "Weather values are given for " + std::to_string(values.size())
+                + " weeks, week " + std::to_string(weeks.back() + 1)
+                + " is needed");
+    this->weeks = weeks;
+}
+
+WeatherInMemory::WeatherInMemory(const WeatherFormat& format,
+                                 std::vector<float> values, size_t cells)
+    : weather_format(format), values(std::move(values)), cells(cells)
+{
+    weather_format.spatial = true;
+    weather_format.code = WEATHER_FLOAT32;
+}
+
+void WeatherInMemory::prepare(const std::vector<unsigned>& weeks)
+{
+    size_t available = values.size() / cells;
+    if (weeks.back() >= available)
+        throw std::runtime_error(
+                "Weather has only " + std::to_string(available)
+                + " weeks, week " + std::to_string(weeks.back() + 1)
+                + " is needed");
+    this->weeks = weeks;
+}
+
+void WeatherFromCache::prepare(const std::vector<unsigned>& weeks)
+{
+    unsigned last_week = weeks.back();
+    if (last_week >= cache.weeks())
+        throw std::runtime_error(
+                "Weather cache has only " + std::to_string(cache.weeks())
+                + " weeks, week " + std::to_string(last_week + 1)
+                + " is needed");
+    // the weeks skipped by seasonality are not prefetched,
+    // e.g. when the weeks of several years are prepared at once
+    size_t first = 0;
+    for (size_t i = 1; i <= weeks.size(); i++) {
+        if (i == weeks.size() || weeks[i] != weeks[i - 1] + 1) {
+            cache.prefetch(weeks[first], i - first);
+            first = i;
+        }
+    }
+    this->weeks.clear();
+    for (unsigned week : weeks)
+        this->weeks.push_back(cache.week(week));
+}
+
+inline const Img& to_img(const Img& image)
+{
+    return image;
+}
+
+template<typename Number>
+inline Img to_img(const BasicImg<Number>& image)
+{
+    return Img(image);
+}
+
+template<typename Number>
+inline Img to_img(const BasicCompactImg<Number>& image)
+{
+    return image.toImg();
+}
+
+/* State of one run stored as separate rasters */
+template<typename Raster>
+struct RasterState
+{
+    Raster S_umca;
+    Raster S_oaks;
+    Raster I_umca;
+    Raster I_oaks;
+    const Img *lvtree;
+};
+
+// simulate one week of one run
+template<typename Raster, typename Dispersal, typename Weather>
+void simulate_week(Sporulation& sporulation, RasterState<Raster>& state,
+                   const Dispersal& dispersal, const Weather& weather,
+                   double spore_rate)
+{
+    sporulation.SporeGen(state.I_umca, weather, spore_rate);
+    sporulation.SporeSpreadDisp(state.S_umca, state.S_oaks, state.I_umca,
+                                state.I_oaks, *state.lvtree, dispersal,
+                                weather);
+}
+
+template<typename Number, typename Dispersal, typename Weather>
+void simulate_week(Sporulation& sporulation, HostState<Number>& state,
+                   const Dispersal& dispersal, const Weather& weather,
+                   double spore_rate)
+{
+    sporulation.SporeGen(state, weather, spore_rate);
+    sporulation.SporeSpreadDisp(state, dispersal, weather);
+}
+
+template<typename Raster>
+auto infected_oaks(const RasterState<Raster>& state)
+    -> decltype(to_img(state.I_oaks))
+{
+    return to_img(state.I_oaks);
+}
+
+template<typename Number>
+Img infected_oaks(const HostState<Number>& state)
+{
+    return state.toImg(&HostState<Number>::Cell::I_oaks);
+}
+
+template<typename Raster>
+HostTotals host_totals(const RasterState<Raster>& state)
+{
+    return count_hosts(state.S_umca, state.S_oaks, state.I_umca,
+                       state.I_oaks);
+}
+
+template<typename Number>
+HostTotals host_totals(const HostState<Number>& state)
+{
+    return count_hosts(state.S_umca(), state.S_oaks(), state.I_umca(),
+                       state.I_oaks());
+}
+
+// infected trees of one run by zone, scanning all cells
+template<typename Raster>
+static void summarize_infection(const Raster& I_umca, const Raster& I_oaks,
+                                const SummaryZones *zones,
+                                InfectionSummary *summaries)
+{
+    for (int i = 0; i < I_umca.getHeight(); i++)
+        for (int j = 0; j < I_umca.getWidth(); j++)
+            summarize_cell(summaries, zones, i, j, I_umca(i, j),
+                           I_oaks(i, j));
+}
+
+// only the host cells can be infected
+template<typename Number>
+static void summarize_infection(const BasicCompactImg<Number>& I_umca,
+                                const BasicCompactImg<Number>& I_oaks,
+                                const SummaryZones *zones,
+                                InfectionSummary *summaries)
+{
+    const Number *umca = I_umca.values();
+    const Number *oaks = I_oaks.values();
+    I_umca.index().for_each_cell([&](int row, int col, int i) {
+        summarize_cell(summaries, zones, row, col, umca[i], oaks[i]);
+    });
+}
+
+template<typename Raster>
+void summarize_state(const RasterState<Raster>& state,
+                     const SummaryZones *zones, InfectionSummary *summaries)
+{
+    summarize_infection(state.I_umca, state.I_oaks, zones, summaries);
+}
+
+template<typename Number>
+void summarize_state(const HostState<Number>& state,
+                     const SummaryZones *zones, InfectionSummary *summaries)
+{
+    summarize_infection(state.I_umca(), state.I_oaks(), zones, summaries);
+}
+
+// the living trees are not part of the state of a run
+template<typename Raster>
+void write_state(std::ostream& stream, const RasterState<Raster>& state)
+{
+    state.S_umca.write(stream);
+    state.S_oaks.write(stream);
+    state.I_umca.write(stream);
+    state.I_oaks.write(stream);
+}
+
+template<typename Raster>
+void read_state(std::istream& stream, RasterState<Raster>& state)
+{
+    state.S_umca.read(stream);
+    state.S_oaks.read(stream);
+    state.I_umca.read(stream);
+    state.I_oaks.read(stream);
+}
+
+template<typename Number>
+void write_state(std::ostream& stream, const HostState<Number>& state)
+{
+    state.write(stream);
+}
+
+template<typename Number>
+void read_state(std::istream& stream, HostState<Number>& state)
+{
+    state.read(stream);
+}
+
+/* Host state of all the stochastic runs
+ *
+ * The storage of the state is hidden, so the simulation loop does not
+ * depend on whether the full rasters, only the host cells, or records
+ * with all layers for each cell are stored.
+ */
+class Ensemble
+{
+public:
+    virtual ~Ensemble() {}
+    // simulate one week of one run using its sporulation object
+    virtual void step(unsigned run, Sporulation& sporulation,
+                      const void *weather, double weather_value) = 0;
+    // add infected oaks of one run to the statistics
+    // (can be called for different runs in parallel)
+    virtual void add_infected_oaks(unsigned run,
+                                   EnsembleStatistics& statistics) const = 0;
+    // numbers of hosts in all cells of one run (scans the state)
+    virtual HostTotals totals(unsigned run) const = 0;
+    // adds infected trees of one run to the summaries of the landscape
+    // and the zones (can be null), can be called for different runs
+    // in parallel except for batched ensembles
+    virtual void summarize(unsigned run, const SummaryZones *zones,
+                           InfectionSummary *summaries) const = 0;
+    // binary state of one run (for checkpoints)
+    virtual void write(unsigned run, std::ostream& stream) const = 0;
+    virtual void read(unsigned run, std::istream& stream) = 0;
+    // all runs are simulated at once by step_all (e.g. on a device)
+    // instead of one by one by step
+    virtual bool batched() const
+    {
+        return false;
+    }
+    // simulate one week of all runs which are not finished
+    // and update the totals of their sporulation objects
+    virtual void step_all(std::vector<Sporulation>&, const void *, double)
+    {}
+    // add infected oaks of all runs to the statistics in the calling
+    // thread (for batched ensembles instead of add_infected_oaks)
+    virtual void add_all_infected_oaks(EnsembleStatistics&) const {}
+};
+
+template<typename State, typename Dispersal, typename Weather>
+class StateEnsemble : public Ensemble
+{
+private:
+    std::vector<std::unique_ptr<State> > states;
+    std::shared_ptr<const Dispersal> dispersal;
+    WeatherFormat weather_format;
+    double spore_rate;
+public:
+    // run i is copied by thread i % threads, the thread which simulates
+    // it with pinned threads, so its memory is first touched there
+    StateEnsemble(unsigned num_runs, unsigned threads, const State& initial,
+                  std::shared_ptr<const Dispersal> dispersal,
+                  const WeatherFormat& weather_format, double spore_rate)
+        :
+          states(num_runs),
+          dispersal(dispersal),
+          weather_format(weather_format),
+          spore_rate(spore_rate)
+    {
+        #pragma omp parallel for schedule(static, 1) num_threads(threads)
+        for (unsigned run = 0; run < num_runs; run++)
+            states[run].reset(new State(initial));
+    }
+
+    void step(unsigned run, Sporulation& sporulation,
+              const void *weather, double weather_value)
+    {
+        Weather week_weather(weather_format, weather, weather_value);
+        simulate_week(sporulation, *states[run], *dispersal, week_weather,
+                      spore_rate);
+    }
+
+    void add_infected_oaks(unsigned run,
+                           EnsembleStatistics& statistics) const
+    {
+        statistics.add(infected_oaks(*states[run]));
+    }
+
+    HostTotals totals(unsigned run) const
+    {
+        return host_totals(*states[run]);
+    }
+
+    void summarize(unsigned run, const SummaryZones *zones,
+                   InfectionSummary *summaries) const
+    {
+        summarize_state(*states[run], zones, summaries);
+    }
+
+    void write(unsigned run, std::ostream& stream) const
+    {
+        write_state(stream, *states[run]);
+    }
+
+    void read(unsigned run, std::istream& stream)
+    {
+        read_state(stream, *states[run]);
+    }
+};
+
+/* Creates the ensemble with kernels compiled for the given parameters
+ *
+ * Everything what is the same for the whole simulation (radial type,
+ * wind, spatial or constant weather and how it is stored) is decided
+ * here once, so that
+ * the kernels do not test it for each cell or spore.
+ * The initial state is only referenced and copied for each run
+ * when the ensemble is created.
+ */
+template<typename State>
+class EnsembleFactory
+{
+private:
+    unsigned num_runs;
+    unsigned threads;
+    const State& initial;
+    int w_e_res;
+    int n_s_res;
+    const WeatherFormat& weather;
+public:
+    EnsembleFactory(unsigned num_runs, unsigned threads, const State& initial,
+                    int w_e_res, int n_s_res, const WeatherFormat& weather)
+        :
+          num_runs(num_runs),
+          threads(threads),
+          initial(initial),
+          w_e_res(w_e_res),
+          n_s_res(n_s_res),
+          weather(weather)
+    {}
+
+    template<typename Dispersal, typename Weather>
+    Ensemble *create(std::shared_ptr<const Dispersal> dispersal,
+                     double spore_rate) const
+    {
+        return new StateEnsemble<State, Dispersal, Weather>(
+                    num_runs, threads, initial, dispersal, weather,
+                    spore_rate);
+    }
+
+    template<typename Dispersal>
+    Ensemble *create(std::shared_ptr<const Dispersal> dispersal,
+                     double spore_rate) const
+    {
+        if (!weather.spatial)
+            return create<Dispersal, ConstantWeather>(dispersal, spore_rate);
+        if (weather.code == WEATHER_UINT8)
+            return create<Dispersal, IndexedWeather<uint8_t>>(dispersal,
+                                                               spore_rate);
+        if (weather.code == WEATHER_UINT16)
+            return create<Dispersal, IndexedWeather<uint16_t>>(dispersal,
+                                                                spore_rate);
+        if (weather.index)
+            return create<Dispersal, IndexedWeather<float>>(dispersal,
+                                                            spore_rate);
+        return create<Dispersal, SpatialWeather>(dispersal, spore_rate);
+    }
+
+    template<Rtype rtype, bool wind>
+    Ensemble *create(const SpreadParams& params) const
+    {
+        typedef DistributionDispersal<rtype, wind> Dispersal;
+        auto dispersal = std::make_shared<const Dispersal>(
+                    params.scale1, params.scale2, params.gamma, params.kappa,
+                    params.wdir, w_e_res, n_s_res);
+        return create(dispersal, params.spore_rate);
+    }
+
+    // the table is used instead of the distributions when provided
+    Ensemble *create(const SpreadParams& params,
+                     std::shared_ptr<const DispersalTable> table) const
+    {
+        if (table && params.binned)
+            return create(std::make_shared<const BinnedDispersal>(table),
+                          params.spore_rate);
+        if (table)
+            return create(table, params.spore_rate);
+        bool wind = params.wdir != NONE;
+        if (params.rtype == CAUCHY && wind)
+            return create<CAUCHY, true>(params);
+        else if (params.rtype == CAUCHY)
+            return create<CAUCHY, false>(params);
+        else if (wind)
+            return create<CAUCHY_MIX, true>(params);
+        else
+            return create<CAUCHY_MIX, false>(params);
+    }
+};
+
+#ifdef HAVE_CUDA
+/* All runs on the GPU (see DeviceEnsemble)
+ *
+ * The sporulation objects of the runs only keep the seeds and totals.
+ */
+class DeviceStateEnsemble : public Ensemble
+{
+private:
+    DeviceEnsemble device;
+    std::vector<unsigned> seeds;
+    std::vector<char> active;
+    int width;
+public:
+    DeviceStateEnsemble(unsigned num_runs, const Img& S_umca,
+                        const Img& S_oaks, const Img& I_umca,
+                        const Img& I_oaks, const Img& lvtree,
+                        const WeatherFormat& weather,
+                        const DeviceDispersal& dispersal, double spore_rate)
+        :
+          device(num_runs, S_umca, S_oaks, I_umca, I_oaks, lvtree, weather,
+                 dispersal, spore_rate),
+          seeds(num_runs),
+          active(num_runs),
+          width(lvtree.getWidth())
+    {}
+
+    bool batched() const
+    {
+        return true;
+    }
+
+    void step(unsigned, Sporulation&, const void *, double)
+    {
+        throw std::runtime_error("Runs on the device are simulated"
+                                 " only all at once");
+    }
+
+    void step_all(std::vector<Sporulation>& sporulations,
+                  const void *weather, double weather_value)
+    {
+        for (size_t run = 0; run < sporulations.size(); run++) {
+            seeds[run] = sporulations[run].get_seed();
+            active[run] = !sporulations[run].get_totals().finished();
+        }
+        device.step(seeds, active, weather, weather_value);
+        std::vector<HostTotals> totals = device.totals();
+        for (size_t run = 0; run < sporulations.size(); run++)
+            sporulations[run].set_totals(totals[run]);
+    }
+
+    void add_infected_oaks(unsigned, EnsembleStatistics&) const
+    {
+        throw std::runtime_error("Runs on the device are added"
+                                 " only all at once");
+    }
+
+    void add_all_infected_oaks(EnsembleStatistics& statistics) const
+    {
+        RasterSums sums;
+        device.infected_oaks(sums);
+        statistics.add_sums(sums);
+    }
+
+    HostTotals totals(unsigned run) const
+    {
+        return device.totals()[run];
+    }
+
+    // the infected layers of the run are downloaded
+    void summarize(unsigned run, const SummaryZones *zones,
+                   InfectionSummary *summaries) const
+    {
+        std::vector<int> I_umca, I_oaks;
+        device.infected(run, I_umca, I_oaks);
+        for (size_t cell = 0; cell < I_umca.size(); cell++)
+            summarize_cell(summaries, zones, cell / width, cell % width,
+                           I_umca[cell], I_oaks[cell]);
+    }
+
+    void write(unsigned run, std::ostream& stream) const
+    {
+        device.write(run, stream);
+    }
+
+    void read(unsigned run, std::istream& stream)
+    {
+        device.read(run, stream);
+    }
+};
+
+// the table is sampled instead of the distributions when provided
+// (also for binned dispersal, which has the same distribution)
+static Ensemble *create_device_ensemble(
+        unsigned num_runs, const Img& S_umca, const Img& S_oaks,
+        const Img& I_umca, const Img& I_oaks, const Img& lvtree,
+        const WeatherFormat& weather, const SpreadParams& params,
+        std::shared_ptr<const DispersalTable> table)
+{
+    if (table)
+        return new DeviceStateEnsemble(
+                    num_runs, S_umca, S_oaks, I_umca, I_oaks, lvtree,
+                    weather, DeviceDispersal(*table), params.spore_rate);
+    return new DeviceStateEnsemble(
+                num_runs, S_umca, S_oaks, I_umca, I_oaks, lvtree, weather,
+                DeviceDispersal(params.rtype, params.scale1, params.scale2,
+                                params.gamma, params.kappa, params.wdir,
+                                lvtree.getWEResolution(),
+                                lvtree.getNSResolution()),
+                params.spore_rate);
+}
+#endif
+
+/* Creates the ensemble which stores the state using the given type
+ *
+ * The full rasters, only the host cells (compact), or one record
+ * with all layers for each cell (interleaved) are stored.
+ */
+template<typename Number>
+Ensemble *create_ensemble(StateLayout layout, unsigned num_runs,
+                          unsigned threads,
+                          const Img& S_umca, const Img& S_oaks,
+                          const Img& I_umca, const Img& I_oaks,
+                          const Img& lvtree,
+                          std::shared_ptr<const HostIndex> host_index,
+                          const WeatherFormat& weather,
+                          const SpreadParams& params,
+                          std::shared_ptr<const DispersalTable> table)
+{
+    int w_e_res = lvtree.getWEResolution();
+    int n_s_res = lvtree.getNSResolution();
+    if (layout == CELL_RECORDS) {
+        typedef HostState<Number> State;
+        State initial(S_umca, S_oaks, I_umca, I_oaks, lvtree);
+        return EnsembleFactory<State>(num_runs, threads, initial, w_e_res,
+                                      n_s_res, weather).create(params, table);
+    }
+    if (layout == HOST_CELLS) {
+        typedef BasicCompactImg<Number> Raster;
+        typedef RasterState<Raster> State;
+        State initial{Raster(host_index, S_umca), Raster(host_index, S_oaks),
+                      Raster(host_index, I_umca), Raster(host_index, I_oaks),
+                      &lvtree};
+        return EnsembleFactory<State>(num_runs, threads, initial, w_e_res,
+                                      n_s_res, weather).create(params, table);
+    }
+    typedef BasicImg<Number> Raster;
+    typedef RasterState<Raster> State;
+    State initial{Raster(S_umca), Raster(S_oaks), Raster(I_umca),
+                  Raster(I_oaks), &lvtree};
+    return EnsembleFactory<State>(num_runs, threads, initial, w_e_res,
+                                  n_s_res, weather).create(params, table);
+}
+
+Simulation::Simulation(const Img& umca, const Img& oaks, const Img& lvtree,
+                       const Img& I_oaks, const SimulationSetup& setup)
+    :
+      I_oaks(I_oaks),
+      lvtree(lvtree),
+      setup(setup)
+{
+#ifndef HAVE_CUDA
+    if (setup.backend == BACKEND_CUDA)
+        throw std::invalid_argument("The CUDA backend is not available"
+                                    " (compiled without CUDA)");
+#endif
+    int width = lvtree.getWidth();
+    int height = lvtree.getHeight();
+    for (const Img *image : {&umca, &oaks, &I_oaks})
+        if (image->getWidth() != width || image->getHeight() != height)
+            throw std::invalid_argument("The sizes of the input rasters"
+                                        " do not match");
+    int w_e_res = lvtree.getWEResolution();
+    int n_s_res = lvtree.getNSResolution();
+    S_umca = Img(width, height, w_e_res, n_s_res);
+    S_oaks = Img(width, height, w_e_res, n_s_res);
+    I_umca = Img(width, height, w_e_res, n_s_res);
+    // the initial susceptible and infected images, the largest number
+    // of trees and the totals are computed in one pass over the inputs
+    // (rows are independent)
+    bool with_lvtree = setup.layout == CELL_RECORDS;
+    int max_trees = std::numeric_limits<int>::min();
+    int64_t S_umca_total = 0, S_oaks_total = 0;
+    int64_t I_umca_total = 0, I_oaks_total = 0, exposed_total = 0;
+    #pragma omp parallel for schedule(static) num_threads(setup.threads) \
+        reduction(max: max_trees) reduction(+: S_umca_total, S_oaks_total, \
+        I_umca_total, I_oaks_total, exposed_total)
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            int infected = I_oaks(i, j);
+            int infected_umca = initial_infected_umca(umca(i, j), infected);
+            I_umca(i, j) = infected_umca;
+            // create the initial suspectible umca and oaks images
+            S_umca(i, j) = umca(i, j) - infected_umca;
+            S_oaks(i, j) = oaks(i, j) - infected;
+            // all trees of a species in a cell are either susceptible
+            // or infected, living trees are part of the state
+            // in the interleaved layout
+            max_trees = std::max(max_trees, std::max(umca(i, j), oaks(i, j)));
+            if (with_lvtree)
+                max_trees = std::max(max_trees, lvtree(i, j));
+            S_umca_total += S_umca(i, j);
+            S_oaks_total += S_oaks(i, j);
+            I_umca_total += infected_umca;
+            I_oaks_total += infected;
+            if (infected_umca > 0)
+                exposed_total += S_oaks(i, j);
+        }
+    }
+    if ((setup.type == STATE_UINT16 && max_trees > UINT16_MAX)
+            || (setup.type == STATE_UINT8 && max_trees > UINT8_MAX))
+        throw std::invalid_argument(
+                "Up to " + std::to_string(max_trees) + " trees in a cell"
+                " do not fit into the type of the state");
+    if (setup.layout == HOST_CELLS)
+        host_index = std::make_shared<const HostIndex>(lvtree);
+    initial_totals.S_umca = S_umca_total;
+    initial_totals.S_oaks = S_oaks_total;
+    initial_totals.I_umca = I_umca_total;
+    initial_totals.I_oaks = I_oaks_total;
+    initial_totals.exposed_S_oaks = exposed_total;
+}
+
+int Simulation::stored_cells() const
+{
+    if (host_index)
+        return host_index->size();
+    return lvtree.getWidth() * lvtree.getHeight();
+}
+
+std::unique_ptr<EnsembleRun>
+Simulation::start(const SpreadParams& params, const WeatherFormat& weather,
+                  unsigned seed, unsigned runs) const
+{
+    if (params.binned && !params.kernel_radius)
+        throw std::invalid_argument("Dispersal of the spores of a cell"
+                                    " together requires the kernel radius");
+    std::shared_ptr<const DispersalTable> table;
+    if (params.kernel_radius)
+        table = std::make_shared<DispersalTable>(
+                    params.rtype, params.scale1, params.scale2, params.gamma,
+                    params.kappa, params.wdir, lvtree.getWEResolution(),
+                    lvtree.getNSResolution(), params.kernel_radius);
+    Ensemble *ensemble;
+#ifdef HAVE_CUDA
+    if (setup.backend == BACKEND_CUDA)
+        ensemble = create_device_ensemble(runs, S_umca, S_oaks, I_umca,
+                                          I_oaks, lvtree, weather, params,
+                                          table);
+    else
+#endif
+    if (setup.type == STATE_UINT8)
+        ensemble = create_ensemble<uint8_t>(
+                    setup.layout, runs, setup.threads, S_umca, S_oaks,
+                    I_umca, I_oaks, lvtree, host_index, weather, params,
+                    table);
+    else if (setup.type == STATE_UINT16)
+        ensemble = create_ensemble<uint16_t>(
+                    setup.layout, runs, setup.threads, S_umca, S_oaks,
+                    I_umca, I_oaks, lvtree, host_index, weather, params,
+                    table);
+    else
+        ensemble = create_ensemble<int>(
+                    setup.layout, runs, setup.threads, S_umca, S_oaks,
+                    I_umca, I_oaks, lvtree, host_index, weather, params,
+                    table);
+    return std::unique_ptr<EnsembleRun>(
+                new EnsembleRun(*this, ensemble, table, seed, runs));
+}
+
+EnsembleStatistics Simulation::run(const SpreadParams& params,
+                                   WeatherInput& weather, unsigned seed,
+                                   unsigned runs, const Date& start,
+                                   const Date& end, bool seasonality) const
+{
+    auto ensemble = this->start(params, weather.format(), seed, runs);
+    ensemble->simulate(0, start, end, seasonality, weather,
+                       SimulationControl());
+    return ensemble->statistics();
+}
+
+EnsembleRun::EnsembleRun(const Simulation& simulation, Ensemble *ensemble,
+                         std::shared_ptr<const DispersalTable> table,
+                         unsigned seed, unsigned runs)
+    :
+      simulation(simulation),
+      ensemble(ensemble),
+      table(table),
+      collected(simulation.setup.threads, simulation.lvtree),
+      thread_usage(simulation.setup.threads),
+      affinity(simulation.setup.affinity)
+{
+    sporulations.reserve(runs);
+    for (unsigned i = 0; i < runs; ++i) {
+        sporulations.emplace_back(seed++, simulation.I_umca);
+        sporulations.back().set_engine(simulation.setup.engine);
+        sporulations.back().set_totals(simulation.initial_totals);
+    }
+    history.resize(runs);
+    run_summaries.resize(runs);
+    last_summaries.resize(runs);
+    if (simulation.setup.tile_size)
+        for (auto& sporulation : sporulations)
+            sporulation.set_tiles(simulation.setup.tile_size,
+                                  simulation.setup.threads, &thread_usage);
+}
+
+EnsembleRun::~EnsembleRun() {}
+
+void EnsembleRun::write(std::ostream& stream) const
+{
+    for (unsigned run = 0; run < runs(); run++) {
+        sporulations[run].write(stream);
+        ensemble->write(run, stream);
+    }
+}
+
+void EnsembleRun::read(std::istream& stream, bool reseed)
+{
+    for (unsigned run = 0; run < runs(); run++) {
+        unsigned seed = sporulations[run].get_seed();
+        sporulations[run].read(stream);
+        ensemble->read(run, stream);
+        if (reseed)
+            sporulations[run].reseed(seed);
+        sporulations[run].set_totals(ensemble->totals(run));
+        last_summaries[run].clear();
+    }
+}
+
+void EnsembleRun::clear_summaries()
+{
+    dates.clear();
+    for (auto& summaries : run_summaries)
+        summaries.clear();
+}
+
+void EnsembleRun::add_summaries(unsigned run, const SummaryZones *zones)
+{
+    std::vector<InfectionSummary>& last = last_summaries[run];
+    if (last.empty()) {
+        last.resize(zones ? zones->size() + 1 : 1);
+        ensemble->summarize(run, zones, last.data());
+    }
+    run_summaries[run].insert(run_summaries[run].end(), last.begin(),
+                              last.end());
+}
+
+unsigned EnsembleRun::finished_runs() const
+{
+    unsigned finished = 0;
+    for (const auto& sporulation : sporulations)
+        finished += sporulation.get_totals().finished();
+    return finished;
+}
+
+const EnsembleStatistics& EnsembleRun::statistics(
+        const Distributed *processes)
+{
+    unsigned threads = simulation.setup.threads;
+    if (collected.runs() != runs()) {
+        collected.clear();
+        if (ensemble->batched())
+            ensemble->add_all_infected_oaks(collected);
+        else {
+            #pragma omp parallel for num_threads(threads) schedule(dynamic)
+            for (unsigned run = 0; run < runs(); run++)
+                ensemble->add_infected_oaks(run, collected);
+        }
+    }
+    collected.combine(threads, processes);
+    return collected;
+}
+
+// stochastic simulation runs as tasks, threads which
+// are done take the next run or tiles of the other runs
+// (batched ensembles simulate all runs at once)
+void EnsembleRun::simulate_weeks(size_t num_weeks,
+                                 const WeatherInput& weather, bool collect,
+                                 const SimulationControl& control,
+                                 InstrumentationReport::Year *year)
+{
+    const unsigned threads = simulation.setup.threads;
+    const unsigned num_runs = runs();
+    collected.clear();
+    if (ensemble->batched()) {
+        if (control.while_simulating)
+            control.while_simulating();
+        // all runs together, finished runs are skipped by the ensemble
+        for (size_t i = 0; i < num_weeks; i++) {
+            ensemble->step_all(sporulations, weather.coefficients(i),
+                               weather.value(i));
+            for (unsigned run = 0; run < num_runs; run++) {
+                last_summaries[run].clear();
+                if (control.record_totals)
+                    history[run].push_back(sporulations[run].get_totals());
+                if (control.summaries == SUMMARY_WEEKLY)
+                    add_summaries(run, control.zones);
+            }
+        }
+        if (control.summaries == SUMMARY_YEARLY)
+            for (unsigned run = 0; run < num_runs; run++)
+                add_summaries(run, control.zones);
+        if (collect)
+            ensemble->add_all_infected_oaks(collected);
+        if (year)
+            for (unsigned run = 0; run < num_runs; run++)
+                year->runs[run] = sporulations[run].take_counters();
+        return;
+    }
+    auto simulate_run = [&](unsigned run) {
+        double waited = thread_usage.waited();
+        double start = wall_time();
+        Sporulation& sporulation = sporulations[run];
+        // actual runs of the simulation per week,
+        // finished runs skip the remaining weeks
+        for (size_t i = 0; i < num_weeks; i++) {
+            if (!sporulation.get_totals().finished()) {
+                ensemble->step(run, sporulation, weather.coefficients(i),
+                               weather.value(i));
+                last_summaries[run].clear();
+            }
+            if (control.record_totals)
+                history[run].push_back(sporulation.get_totals());
+            if (control.summaries == SUMMARY_WEEKLY)
+                add_summaries(run, control.zones);
+        }
+        double statistics_start = wall_time();
+        if (control.summaries == SUMMARY_YEARLY)
+            add_summaries(run, control.zones);
+        if (collect)
+            ensemble->add_infected_oaks(run, collected);
+        if (year) {
+            RunCounters counters = sporulation.take_counters();
+            counters.statistics_time = wall_time() - statistics_start;
+            year->runs[run] = counters;
+        }
+        thread_usage.add_busy(wall_time() - start
+                              - (thread_usage.waited() - waited));
+    };
+    double chunk_start = wall_time();
+    #pragma omp parallel num_threads(threads)
+    {
+        if (affinity.enabled()) {
+            // pinned threads keep their runs (where the memory of the
+            // state was first touched), tiles are still tasks
+            affinity.bind(thread_number(), threads);
+            #pragma omp for schedule(static, 1) nowait
+            for (unsigned run = 0; run < num_runs; run++)
+                simulate_run(run);
+        }
+        else {
+            #pragma omp single nowait
+            for (unsigned run = 0; run < num_runs; run++) {
+                #pragma omp task
+                simulate_run(run);
+            }
+        }
+        // meanwhile, the other threads take the runs (or tiles) which
+        // are left, all wait for each other at the end of the region
+        #pragma omp master
+        if (control.while_simulating)
+            control.while_simulating();
+    }
+    thread_usage.add_wall(wall_time() - chunk_start);
+}
+
+void EnsembleRun::simulate(unsigned first_week, Date date, const Date& end,
+                           bool seasonality, WeatherInput& weather,
+                           const SimulationControl& control)
+{
+    const unsigned max_weeks_in_year = 53;
+    const unsigned num_runs = runs();
+    // runs need to wait for each other only when all of them need to get
+    // to the end of the year to read weather or to write output
+    // (weeks in the cache are available at any time), the summaries
+    // are taken from the runs in each year end
+    bool yearly_sync = control.yearly || weather.yearly()
+            || control.summaries != SUMMARY_NONE;
+    if (control.zones
+            && (control.zones->getWidth() != simulation.lvtree.getWidth()
+                || control.zones->getHeight()
+                != simulation.lvtree.getHeight()))
+        throw std::runtime_error("The size of the zones does not match"
+                                 " the size of the rasters");
+    InstrumentationReport::Year *year = nullptr;
+    bool finished = false;
+    auto add_phase = [&](Phase phase, double start) {
+        if (year)
+            year->phases[phase] += wall_time() - start;
+    };
+
+    std::vector<unsigned> unresolved_weeks;
+    unresolved_weeks.reserve(max_weeks_in_year);
+    // dates of the weeks for the weekly summaries
+    std::vector<Date> unresolved_dates;
+
+    // main simulation loop (weekly steps)
+    for (unsigned current_week = first_week; ; current_week++, date.increasedByWeek()) {
+        if (date < end)
+            if (!seasonality || !(date.getMonth() > 9)) {
+                unresolved_weeks.push_back(current_week);
+                if (control.summaries == SUMMARY_WEEKLY)
+                    unresolved_dates.push_back(date);
+            }
+
+        // check whether the spore occurs in the month
+        if (date.isYearEnd() || date >= end) {
+            if (!unresolved_weeks.empty() && (yearly_sync || date >= end)) {
+                // when no run can change anymore, the weeks are skipped
+                // and only the year ends are reported
+                if (!finished) {
+                    finished = finished_runs() == num_runs;
+                    if (control.processes)
+                        finished = control.processes->all(finished);
+                    if (finished)
+                        cerr << "In the " << date << " all runs have no"
+                             << " infected or no suspectible hosts!" << endl;
+                }
+                if (finished && !control.year_end
+                        && control.summaries == SUMMARY_NONE)
+                    break;
+                if (control.record_totals)
+                    weeks.insert(weeks.end(), unresolved_weeks.begin(),
+                                 unresolved_weeks.end());
+                if (control.summaries == SUMMARY_WEEKLY)
+                    dates.insert(dates.end(), unresolved_dates.begin(),
+                                 unresolved_dates.end());
+                else if (control.summaries == SUMMARY_YEARLY)
+                    dates.push_back(date);
+                if (finished) {
+                    if (control.record_totals)
+                        for (unsigned run = 0; run < num_runs; run++)
+                            history[run].insert(history[run].end(),
+                                                unresolved_weeks.size(),
+                                                totals(run));
+                    // the summaries of the last state are repeated
+                    size_t repeated = 0;
+                    if (control.summaries == SUMMARY_WEEKLY)
+                        repeated = unresolved_weeks.size();
+                    else if (control.summaries == SUMMARY_YEARLY)
+                        repeated = 1;
+                    for (unsigned run = 0; run < num_runs; run++)
+                        for (size_t i = 0; i < repeated; i++)
+                            add_summaries(run, control.zones);
+                }
+                else {
+                    if (control.report) {
+                        std::ostringstream text;
+                        text << date.getYear() << "-"
+                             << std::setfill('0') << std::setw(2)
+                             << date.getMonth() << "-" << std::setw(2)
+                             << date.getDay();
+                        year = &control.report->add_year(
+                                    text.str(), unresolved_weeks.size());
+                    }
+                    double phase_start = wall_time();
+                    // get weather for all the weeks and let the input read
+                    // the next year while this one is simulated
+                    weather.prepare(unresolved_weeks);
+                    if (date < end) {
+                        Date next_week(date);
+                        next_week.increasedByWeek();
+                        weather.will_need(weeks_until_year_end(
+                                              current_week + 1, next_week,
+                                              end, seasonality));
+                    }
+                    add_phase(PHASE_WEATHER, phase_start);
+                    phase_start = wall_time();
+                    simulate_weeks(unresolved_weeks.size(), weather,
+                                   control.yearly_statistics
+                                   || (date >= end
+                                       && control.final_statistics),
+                                   control, year);
+                    add_phase(PHASE_SIMULATION, phase_start);
+                }
+                unresolved_weeks.clear();
+                unresolved_dates.clear();
+            }
+            // only when the runs are at this date (no weeks are left
+            // for later)
+            if (control.year_end && unresolved_weeks.empty())
+                control.year_end(date, current_week);
+        }
+
+        if (date >= end)
+            break;
+    }
+}
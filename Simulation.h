@@ -0,0 +1,420 @@
+/*
+ * SOD model - simulation of the stochastic runs
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "date.h"
+#include "Img.h"
+#include "CompactImg.h"
+#include "Dispersal.h"
+#include "Weather.h"
+#include "WeatherCache.h"
+#include "Spore.h"
+#include "Statistics.h"
+#include "Summary.h"
+#include "Distributed.h"
+#include "Instrumentation.h"
+#include "Tasks.h"
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+/* Parameters of spore production and dispersal */
+struct SpreadParams
+{
+    double spore_rate;
+    Rtype rtype;
+    double scale1;
+    double scale2;
+    double kappa;
+    double gamma;
+    Direction wdir;
+    // radius of the precomputed kernel in cells, zero for none
+    int kernel_radius;
+    // spores of a cell dispersed together (requires the kernel table)
+    bool binned;
+};
+
+/* How the state of each run is stored */
+enum StateLayout
+{
+    FULL_RASTERS, HOST_CELLS, CELL_RECORDS
+};
+
+/* Type of the numbers of trees in the state of each run */
+enum StateType
+{
+    STATE_INT, STATE_UINT16, STATE_UINT8
+};
+
+/* Where the runs are computed */
+enum Backend
+{
+    BACKEND_CPU, BACKEND_CUDA
+};
+
+/* Storage of the runs and the threads which compute them */
+struct SimulationSetup
+{
+    StateLayout layout;
+    StateType type;
+    unsigned threads;
+    // rows of a tile computed in parallel within a run, zero for none
+    int tile_size;
+    // pinned threads simulate always the same runs (run i by thread
+    // i % threads), otherwise runs are tasks for any idle thread
+    Affinity affinity;
+    // with CUDA, all runs are on the GPU and the layout, type, tiles,
+    // affinity and engine are not used
+    Backend backend;
+    // random numbers of the runs (see Sporulation::set_engine)
+    RandomEngine engine;
+
+    SimulationSetup()
+        : layout(FULL_RASTERS), type(STATE_INT), threads(1), tile_size(0),
+          affinity(AFFINITY_NONE), backend(BACKEND_CPU), engine(ENGINE_STD)
+    {}
+};
+
+/* Weather coefficients for the weeks of the simulation
+ *
+ * The weeks are prepared in the main thread before they are simulated,
+ * then the coefficients of the prepared weeks are used from the runs
+ * in parallel.
+ */
+class WeatherInput
+{
+public:
+    virtual ~WeatherInput() {}
+    virtual const WeatherFormat& format() const = 0;
+    // all weeks of a year must be prepared at once (e.g. to read them)
+    virtual bool yearly() const
+    {
+        return false;
+    }
+    // the weeks will be prepared later (can be read in advance)
+    virtual void will_need(const std::vector<unsigned>&) {}
+    // throws when a week is not available
+    virtual void prepare(const std::vector<unsigned>& weeks) = 0;
+    // spatial coefficients (null if not spatial) and the single value
+    // of the i-th week from the last prepare
+    virtual const void *coefficients(size_t i) const = 0;
+    virtual double value(size_t i) const = 0;
+};
+
+/* The same weather value for each week or a value by week */
+class WeatherValues : public WeatherInput
+{
+private:
+    WeatherFormat weather_format;
+    double constant;
+    std::vector<double> values;
+    std::vector<unsigned> weeks;
+public:
+    explicit WeatherValues(double value)
+        : constant(value)
+    {}
+    explicit WeatherValues(const std::vector<double>& values)
+        : constant(0), values(values)
+    {}
+    const WeatherFormat& format() const
+    {
+        return weather_format;
+    }
+    void prepare(const std::vector<unsigned>& weeks);
+    const void *coefficients(size_t) const
+    {
+        return nullptr;
+    }
+    double value(size_t i) const
+    {
+        return values.empty() ? constant : values[weeks[i]];
+    }
+};
+
+/* Spatial weather of all weeks in memory, floats by week
+ *
+ * The format can have an index for weather on a coarser grid.
+ * This is the weather for repeated simulations (e.g. calibration),
+ * it is read only once.
+ */
+class WeatherInMemory : public WeatherInput
+{
+private:
+    WeatherFormat weather_format;
+    std::vector<float> values;
+    size_t cells;
+    std::vector<unsigned> weeks;
+public:
+    WeatherInMemory(const WeatherFormat& format, std::vector<float> values,
+                    size_t cells);
+    const WeatherFormat& format() const
+    {
+        return weather_format;
+    }
+    void prepare(const std::vector<unsigned>& weeks);
+    const void *coefficients(size_t i) const
+    {
+        return &values[weeks[i] * cells];
+    }
+    double value(size_t) const
+    {
+        return 0;
+    }
+};
+
+/* Weeks used directly from the memory-mapped weather cache */
+class WeatherFromCache : public WeatherInput
+{
+private:
+    const WeatherCache& cache;
+    WeatherFormat weather_format;
+    std::vector<const void *> weeks;
+public:
+    // the format can add an index for the coarse grid to the cache format
+    WeatherFromCache(const WeatherCache& cache, const WeatherFormat& format)
+        : cache(cache), weather_format(format)
+    {}
+    const WeatherFormat& format() const
+    {
+        return weather_format;
+    }
+    void prepare(const std::vector<unsigned>& weeks);
+    const void *coefficients(size_t i) const
+    {
+        return weeks[i];
+    }
+    double value(size_t) const
+    {
+        return 0;
+    }
+};
+
+class Ensemble;
+class EnsembleRun;
+
+/* Landscape and initial infection shared by any number of ensembles
+ *
+ * The rasters are loaded only once and the ensembles are simulated
+ * with different parameters and seeds from the same initial state
+ * (e.g. in calibration without reading the inputs for each sample).
+ */
+class Simulation
+{
+public:
+    // throws invalid_argument when the trees do not fit the state type
+    // or when the backend is not available
+    Simulation(const Img& umca, const Img& oaks, const Img& lvtree,
+               const Img& I_oaks, const SimulationSetup& setup);
+
+    // runs with seeds seed, seed + 1, ..., throws invalid_argument
+    // for invalid parameters, the simulation must exist while the
+    // runs are used
+    std::unique_ptr<EnsembleRun> start(const SpreadParams& params,
+                                       const WeatherFormat& weather,
+                                       unsigned seed, unsigned runs) const;
+    // simulates the runs from the start to the end date
+    // and returns the statistics of infected oaks at the end
+    EnsembleStatistics run(const SpreadParams& params, WeatherInput& weather,
+                           unsigned seed, unsigned runs, const Date& start,
+                           const Date& end, bool seasonality) const;
+
+    const Img& living_trees() const
+    {
+        return lvtree;
+    }
+    const Img& susceptible_oaks() const
+    {
+        return S_oaks;
+    }
+    // cells with state stored in the compact layout (all cells otherwise)
+    int stored_cells() const;
+
+private:
+    friend class EnsembleRun;
+    Img S_umca;
+    Img S_oaks;
+    Img I_umca;
+    Img I_oaks;
+    Img lvtree;
+    HostTotals initial_totals;
+    SimulationSetup setup;
+    std::shared_ptr<const HostIndex> host_index;
+};
+
+/* When the summaries of the runs are computed */
+enum SummaryInterval
+{
+    SUMMARY_NONE, SUMMARY_WEEKLY, SUMMARY_YEARLY
+};
+
+/* What to do in each year end of EnsembleRun::simulate() */
+struct SimulationControl
+{
+    // simulate all runs to the end of each year (e.g. to write outputs),
+    // otherwise they continue until weather needs to be read
+    bool yearly;
+    // statistics collected at the end of each year
+    bool yearly_statistics;
+    // statistics collected at the end (to be used without them,
+    // e.g. when only the summaries are needed)
+    bool final_statistics;
+    // totals of hosts of each run recorded after each week
+    bool record_totals;
+    // summaries of each run computed by its thread after each week
+    // or in each year end, the runs are simulated to the end of each
+    // year as with yearly
+    SummaryInterval summaries;
+    // zones of the summaries (can be null for only the whole landscape)
+    const SummaryZones *zones;
+    // timings and counters by year (can be null)
+    InstrumentationReport *report;
+    // processes with the other runs of the ensemble (can be null),
+    // the simulation ends early only when the runs of all are finished
+    const Distributed *processes;
+    // called with the date and the week of the loop in each year end
+    // in which the runs are simulated to that week, that is in each year
+    // end with yearly (or with the summaries or yearly weather), otherwise
+    // only when no weeks are left to simulate (e.g. at the end)
+    std::function<void(const Date& date, unsigned week)> year_end;
+    // called from the thread which called simulate() while the other
+    // threads simulate the weeks, before that thread joins them (e.g. to
+    // write outputs of the last year end with a library which is not
+    // thread-safe)
+    std::function<void()> while_simulating;
+
+    SimulationControl()
+        :
+          yearly(false), yearly_statistics(false), final_statistics(true),
+          record_totals(false), summaries(SUMMARY_NONE), zones(nullptr),
+          report(nullptr), processes(nullptr)
+    {}
+};
+
+/* Stochastic runs with one set of parameters */
+class EnsembleRun
+{
+public:
+    ~EnsembleRun();
+    EnsembleRun(const EnsembleRun&) = delete;
+    EnsembleRun& operator=(const EnsembleRun&) = delete;
+
+    unsigned runs() const
+    {
+        return sporulations.size();
+    }
+    unsigned first_seed() const
+    {
+        return sporulations.front().get_seed();
+    }
+    // the kernel table or null when the distributions are sampled
+    std::shared_ptr<const DispersalTable> dispersal_table() const
+    {
+        return table;
+    }
+
+    // weekly steps from the first week at the start date to the end
+    // date, throws runtime_error when the weather is not available,
+    // runs which are finished (see HostTotals) skip the remaining weeks,
+    // when all of them are finished, the weather is not prepared anymore
+    // and the simulation ends (without a year_end callback) or only
+    // reports the remaining year ends
+    void simulate(unsigned first_week, Date start, const Date& end,
+                  bool seasonality, WeatherInput& weather,
+                  const SimulationControl& control);
+
+    // current numbers of hosts in a run
+    const HostTotals& totals(unsigned run) const
+    {
+        return sporulations[run].get_totals();
+    }
+    unsigned finished_runs() const;
+    // weeks simulated with SimulationControl::record_totals
+    // and the totals of a run after each of them
+    const std::vector<unsigned>& recorded_weeks() const
+    {
+        return weeks;
+    }
+    const std::vector<HostTotals>& recorded_totals(unsigned run) const
+    {
+        return history[run];
+    }
+    // dates of the summaries (see SimulationControl::summaries) since
+    // they were cleared and the summaries of a run for each of them,
+    // the whole landscape followed by the zones for each date
+    const std::vector<Date>& summary_dates() const
+    {
+        return dates;
+    }
+    const std::vector<InfectionSummary>& summaries(unsigned run) const
+    {
+        return run_summaries[run];
+    }
+    // forget the summaries (e.g. when they are written)
+    void clear_summaries();
+
+    // adds the runs which were not collected yet, called by all
+    // processes, only the root has the statistics of all of them
+    const EnsembleStatistics& statistics(
+            const Distributed *processes = nullptr);
+
+    // binary state of all runs (for checkpoints), with reseed the runs
+    // continue with their seeds instead of the saved random numbers,
+    // reading throws runtime_error
+    void write(std::ostream& stream) const;
+    void read(std::istream& stream, bool reseed);
+
+    const ThreadUsage& usage() const
+    {
+        return thread_usage;
+    }
+
+private:
+    friend class Simulation;
+    EnsembleRun(const Simulation& simulation, Ensemble *ensemble,
+                std::shared_ptr<const DispersalTable> table, unsigned seed,
+                unsigned runs);
+    void simulate_weeks(size_t num_weeks, const WeatherInput& weather,
+                        bool collect, const SimulationControl& control,
+                        InstrumentationReport::Year *year);
+    // adds the current summaries of a run (computed only when it changed)
+    void add_summaries(unsigned run, const SummaryZones *zones);
+    const Simulation& simulation;
+    std::unique_ptr<Ensemble> ensemble;
+    std::shared_ptr<const DispersalTable> table;
+    std::vector<Sporulation> sporulations;
+    std::vector<unsigned> weeks;
+    std::vector<std::vector<HostTotals> > history;
+    std::vector<Date> dates;
+    std::vector<std::vector<InfectionSummary> > run_summaries;
+    // summaries of the current state, empty when a run changed
+    std::vector<std::vector<InfectionSummary> > last_summaries;
+    EnsembleStatistics collected;
+    ThreadUsage thread_usage;
+    ThreadAffinity affinity;
+};
+
+// weeks which the loop collects from the given week and date
+// until the end of the year (or of the simulation)
+std::vector<unsigned> weeks_until_year_end(unsigned week, Date date,
+                                           const Date& end,
+                                           bool seasonality);
+
+#endif
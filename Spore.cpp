@@ -16,71 +16,11 @@
 
 
 #include "Spore.h"
+#include "BinaryIO.h"
 
-#include <cmath>
-
-// PI is used in the code and M_PI is not guaranteed
-// fix it, but prefer the system definition
-#ifndef M_PI
-    #define M_PI 3.14159265358979323846
-#endif
-#ifndef PI
-    #define PI M_PI
-#endif
-
-using std::cerr;
-using std::endl;
-
-/*
-Von Mises Distribution(Circular data distribution)
-
-mu is the mean angle, expressed in radians between 0 and 2*pi,
-and kappa is the concentration parameter, which must be greater
-than or equal to zero. If kappa is equal to zero, this distribution
-reduces to a uniform random angle over the range 0 to 2*pi
-*/
-class von_mises_distribution
-{
-public:
-    von_mises_distribution(double mu, double kappa)
-        : mu(mu), kappa(kappa), distribution(0.0, 1.0)
-    {}
-    template<class Generator>
-    double operator ()(Generator& generator)
-    {
-        double a, b, c, f, r, theta, u1, u2, u3, z;
-
-        if (kappa <= 1.e-06)
-            return 2 * PI * distribution(generator);
-
-        a = 1.0 + sqrt(1.0 + 4.0 * kappa * kappa);
-        b = (a - sqrt(2.0 * a)) / (2.0 * kappa);
-        r = (1.0 + b * b) / (2.0 * b);
-
-        while (true) {
-            u1 = distribution(generator);
-            z = cos(PI * u1);
-            f = (1.0 + r * z) / (r + z);
-            c = kappa * (r - f);
-            u2 = distribution(generator);
-            if (u2 <= c * (2.0 - c) || u2 < c * exp(1.0 - c))
-                break;
-        }
-
-        u3 = distribution(generator);
-        if (u3 > 0.5) {
-            theta = fmod(mu + acos(f), 2 * PI);
-        }
-        else {
-            theta = fmod(mu - acos(f), 2 * PI);
-        }
-        return theta;
-    }
-private:
-    double mu;
-    double kappa;
-    std::uniform_real_distribution<double> distribution;
-};
+#include <algorithm>
+#include <sstream>
+#include <string>
 
 Sporulation::Sporulation(unsigned random_seed, const Img& size)
     :
@@ -88,154 +28,129 @@ Sporulation::Sporulation(unsigned random_seed, const Img& size)
       height(size.getHeight()),
       w_e_res(size.getWEResolution()),
       n_s_res(size.getNSResolution()),
-      sp(width, height, w_e_res, n_s_res)
+      sorted_cells(0),
+      activated(false),
+      xoshiro(random_seed),
+      pcg(random_seed),
+      philox(random_seed),
+      engine(ENGINE_STD),
+      seed(random_seed),
+      step(0),
+      tile_rows(0),
+      threads(1),
+      usage(nullptr)
 {
     generator.seed(random_seed);
 }
 
-void Sporulation::SporeGen(const Img& I, const double *weather,
-                           double weather_value, double rate)
+void Sporulation::set_tiles(int tile_rows, unsigned threads,
+                            ThreadUsage *usage)
 {
-    double lambda = 0;
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            if (I(i, j) > 0) {
-                if (weather)
-                    lambda = rate * weather[i * width + j];
-                else
-                    lambda = rate * weather_value;
-                int sum = 0;
-                std::poisson_distribution<int> distribution(lambda);
+    this->tile_rows = tile_rows;
+    this->threads = threads;
+    this->usage = usage;
+}
 
-                for (int k = 0; k < I(i, j); k++) {
-                    sum += distribution(generator);
-                }
-                sp(i, j) = sum;
-            }
-            else {
-                sp(i, j) = 0;
-            }
-        }
+void Sporulation::write(std::ostream& stream) const
+{
+    write_value(stream, int32_t(width));
+    write_value(stream, int32_t(height));
+    write_vector(stream, active_cells);
+    write_value(stream, uint64_t(sorted_cells));
+    write_value(stream, uint8_t(activated));
+    std::ostringstream engine_state;
+    switch (engine) {
+    case ENGINE_XOSHIRO:
+        engine_state << xoshiro;
+        break;
+    case ENGINE_PCG:
+        engine_state << pcg;
+        break;
+    case ENGINE_PHILOX:
+        engine_state << philox;
+        break;
+    default:
+        engine_state << generator;
     }
+    write_string(stream, engine_state.str());
+    write_value(stream, uint32_t(seed));
+    write_value(stream, uint32_t(step));
 }
 
-void Sporulation::SporeSpreadDisp(Img& S_umca, Img& S_oaks, Img& I_umca,
-                                  Img& I_oaks, const Img& lvtree_rast,
-                                  Rtype rtype, const double *weather,
-                                  double weather_value, double scale1,
-                                  double kappa, Direction wdir, double scale2,
-                                  double gamma)
+void Sporulation::read(std::istream& stream)
 {
-    std::cauchy_distribution < double >distribution_cauchy_one(0.0, scale1);
-    std::cauchy_distribution < double >distribution_cauchy_two(0.0, scale2);
-
-    std::bernoulli_distribution distribution_bern(gamma);
-    std::uniform_real_distribution < double >distribution_uniform(0.0, 1.0);
-
-    if (wdir == NONE)
-        kappa = 0;
-    von_mises_distribution vonmisesvariate(wdir * PI / 180, kappa);
-
-    double dist = 0;
-    double theta = 0;
-
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            if (sp(i, j) > 0) {
-                for (int k = 0; k < sp(i, j); k++) {
-
-                    // generate the distance from cauchy distribution or cauchy mixture distribution
-                    if (rtype == CAUCHY) {
-                        dist = abs(distribution_cauchy_one(generator));
-                    }
-                    else if (rtype == CAUCHY_MIX) {
-                        if (gamma >= 1 || gamma <= 0) {
-                            cerr <<
-                                    "The parameter gamma must be in the range (0~1)"
-                                 << endl;
-                            return;
-                        }
-                        // use bernoulli distribution to act as the sampling with prob(gamma,1-gamma)
-                        if (distribution_bern(generator))
-                            dist = abs(distribution_cauchy_one(generator));
-                        else
-                            dist = abs(distribution_cauchy_two(generator));
-                    }
-                    else {
-                        cerr <<
-                                "The paramter Rtype muse be set as either CAUCHY OR CAUCHY_MIX"
-                             << endl;
-                        exit(EXIT_FAILURE);
-                    }
-
-                    theta = vonmisesvariate(generator);
-
-                    int row = i - round(dist * cos(theta) / n_s_res);
-                    int col = j + round(dist * sin(theta) / w_e_res);
-
-                    if (row < 0 || row >= height)
-                        continue;
-                    if (col < 0 || col >= width)
-                        continue;
-
-                    if (row == i && col == j) {
-                        if (S_umca(row, col) > 0 ||
-                                S_oaks(row, col) > 0) {
-                            double prob =
-                                    (double)(S_umca(row, col) +
-                                             S_oaks(row, col)) /
-                                    lvtree_rast(row, col);
-
-                            double U = distribution_uniform(generator);
+    int32_t stored_width;
+    int32_t stored_height;
+    read_value(stream, stored_width);
+    read_value(stream, stored_height);
+    if (stored_width != width || stored_height != height)
+        throw std::runtime_error("The height or width of the stored"
+                                 " sporulation does not match.");
+    read_vector(stream, active_cells);
+    uint64_t stored_sorted;
+    read_value(stream, stored_sorted);
+    sorted_cells = stored_sorted;
+    uint8_t stored_activated;
+    read_value(stream, stored_activated);
+    activated = stored_activated;
+    // the engine must be set as in the stored object
+    std::string engine_state;
+    read_string(stream, engine_state);
+    std::istringstream engine_stream(engine_state);
+    switch (engine) {
+    case ENGINE_XOSHIRO:
+        engine_stream >> xoshiro;
+        break;
+    case ENGINE_PCG:
+        engine_stream >> pcg;
+        break;
+    case ENGINE_PHILOX:
+        engine_stream >> philox;
+        break;
+    default:
+        engine_stream >> generator;
+    }
+    uint32_t value;
+    read_value(stream, value);
+    seed = value;
+    read_value(stream, value);
+    step = value;
+}
 
-                            if (weather)
-                                prob = prob * weather[row * width + col];
-                            else
-                                prob = prob * weather_value;
+void Sporulation::reseed(unsigned random_seed)
+{
+    seed = random_seed;
+    generator.seed(random_seed);
+    xoshiro.seed(random_seed);
+    pcg.seed(random_seed);
+    philox.seed(random_seed);
+}
 
-                            // if U < prob, then one host will become infected
-                            if (U < prob) {
-                                double prob_S_umca =
-                                        (double)(S_umca(row, col)) /
-                                        (S_umca(row, col) +
-                                         S_oaks(row, col));
-                                double prob_S_oaks =
-                                        (double)(S_oaks(row, col)) /
-                                        (S_umca(row, col) +
-                                         S_oaks(row, col));
+RunCounters Sporulation::take_counters()
+{
+    RunCounters taken = counters;
+    counters = RunCounters();
+    return taken;
+}
 
-                                std::bernoulli_distribution
-                                    distribution_bern_prob(prob_S_umca);
-                                if (distribution_bern_prob(generator)) {
-                                    I_umca(row, col) += 1;
-                                    S_umca(row, col) -= 1;
-                                }
-                                else {
-                                    I_oaks(row, col) += 1;
-                                    S_oaks(row, col) -= 1;
-                                }
-                            }
-                        }
-                    }
-                    else {
-                        if (S_umca(row, col) > 0) {
-                            double prob_S_umca =
-                                    (double)(S_umca(row, col)) /
-                                    lvtree_rast(row, col);
-                            double U = distribution_uniform(generator);
+// spores of all active cells from the last SporeGen call
+void Sporulation::count_spores(double start)
+{
+    for (int spores : sp)
+        counters.spores += spores;
+    counters.spore_gen_time += wall_time() - start;
+}
 
-                            if (weather)
-                                prob_S_umca *= weather[row * width + col];
-                            else
-                                prob_S_umca *= weather_value;
-                            if (U < prob_S_umca) {
-                                I_umca(row, col) += 1;
-                                S_umca(row, col) -= 1;
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
+/* Merge the newly infected cells into the ordered part of the list
+ * so that cells are always visited in the same order as in a full
+ * row-by-row scan (which keeps the stream of random numbers the same).
+ */
+void Sporulation::sort_active_cells()
+{
+    if (sorted_cells == active_cells.size())
+        return;
+    auto middle = active_cells.begin() + sorted_cells;
+    std::sort(middle, active_cells.end());
+    std::inplace_merge(active_cells.begin(), middle, active_cells.end());
+    sorted_cells = active_cells.size();
 }
@@ -19,15 +19,68 @@
 #define SPORE_H
 
 #include "Img.h"
+#include "HostState.h"
+#include "Dispersal.h"
+#include "Weather.h"
+#include "Random.h"
+#include "Samplers.h"
+#include "Simd.h"
+#include "Tasks.h"
+#include "Instrumentation.h"
 
 #include <random>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdint.h>
 
-
-enum Rtype
+/* Numbers of hosts in all cells of one run
+ *
+ * Sporulation keeps them up to date when hosts get infected, so they
+ * are known every week without a scan of the rasters.
+ */
+struct HostTotals
 {
-    CAUCHY, CAUCHY_MIX          // NO means that there is no wind
+    int64_t S_umca;
+    int64_t S_oaks;
+    int64_t I_umca;
+    int64_t I_oaks;
+    // susceptible oaks in cells with infected bay laurel, oaks are
+    // infected only by spores which stay in their cell
+    int64_t exposed_S_oaks;
+
+    HostTotals()
+        : S_umca(0), S_oaks(0), I_umca(0), I_oaks(0), exposed_S_oaks(0)
+    {}
+    HostTotals& operator+=(const HostTotals& other)
+    {
+        S_umca += other.S_umca;
+        S_oaks += other.S_oaks;
+        I_umca += other.I_umca;
+        I_oaks += other.I_oaks;
+        exposed_S_oaks += other.exposed_S_oaks;
+        return *this;
+    }
+    // only infected bay laurel produces spores
+    bool burned_out() const
+    {
+        return I_umca <= 0;
+    }
+    // no spore can infect a host
+    bool saturated() const
+    {
+        return S_umca <= 0 && exposed_S_oaks <= 0;
+    }
+    // the run cannot change anymore
+    bool finished() const
+    {
+        return burned_out() || saturated();
+    }
 };
 
+// active cells whose spore means are computed together
+static const size_t spore_block = 256;
+
 class Sporulation
 {
 private:
@@ -37,18 +90,700 @@ private:
     int w_e_res;
     // the north-south resolution of the pixel
     int n_s_res;
-    Img sp;
+    // cells (row * width + col) with infected UMCA hosts,
+    // the first sorted_cells items are in row-major order
+    std::vector<int> active_cells;
+    size_t sorted_cells;
+    bool activated;
+    // spores produced in the last week, one value per sorted active cell
+    std::vector<int> sp;
     std::default_random_engine generator;
+    // the other engines, only the selected one is used
+    Xoshiro256pp xoshiro;
+    Pcg64 pcg;
+    PhiloxEngine philox;
+    RandomEngine engine;
+    unsigned seed;
+    // number of weeks simulated (SporeGen calls)
+    unsigned step;
+    // rows in one tile, zero when not using tiles
+    int tile_rows;
+    unsigned threads;
+    ThreadUsage *usage;
+    // spore which ended in the grid in the tiled mode
+    struct Landing
+    {
+        int cell;
+        bool self;
+        // random numbers for the infection of a host
+        double u;
+        double v;
+    };
+    // landings for each pair of source and destination tiles
+    std::vector<std::vector<Landing> > landings;
+    // newly infected cells in each tile
+    std::vector<std::vector<int> > infected;
+    HostTotals totals;
+    // changes of the totals in each tile
+    std::vector<HostTotals> tile_totals;
+    // counted only with SOD_INSTRUMENTATION
+    RunCounters counters;
+    std::vector<RunCounters> tile_counters;
+    void count_spores(double start);
+    template<typename Raster>
+    void activate(const Raster& I);
+    void sort_active_cells();
+    // trees and weather of consecutive active cells and the means
+    // of their spores (see simd_spore_means)
+    struct SporeBlock
+    {
+        int trees[spore_block];
+        double weather[spore_block];
+        double tree_means[spore_block];
+        double cell_means[spore_block];
+    };
+    template<typename Weather, typename Raster>
+    void spore_means(SporeBlock& block, const Raster& I,
+                     const Weather& weather, double rate, size_t first,
+                     size_t count) const;
+    template<typename Generator, typename Weather, typename Raster>
+    void spore_gen(Generator& generator, const Raster& I,
+                   const Weather& weather, double rate);
+    template<typename Generator, typename Dispersal, typename Weather,
+             typename Raster, typename Hosts>
+    void spread(Generator& generator, Raster& S_umca, Raster& S_oaks,
+                Raster& I_umca, Raster& I_oaks, const Hosts& lvtree_rast,
+                const Dispersal& dispersal, const Weather& weather);
+    template<typename Generator, typename Weather, typename Raster,
+             typename Hosts>
+    void binned_spread(Generator& generator, Raster& S_umca,
+                       Raster& S_oaks, Raster& I_umca, Raster& I_oaks,
+                       const Hosts& lvtree_rast,
+                       const BinnedDispersal& dispersal,
+                       const Weather& weather);
+    template<typename Stream, typename Weather, typename Raster>
+    void tiled_spore_gen(const Raster& I, const Weather& weather,
+                         double rate);
+    template<typename Stream, typename Dispersal, typename Weather,
+             typename Raster, typename Hosts>
+    void tiled_spread(Raster& S_umca, Raster& S_oaks, Raster& I_umca,
+                      Raster& I_oaks, const Hosts& lvtree_rast,
+                      const Dispersal& dispersal, const Weather& weather);
+    template<typename Generator, typename Raster, typename Hosts>
+    void infect(Generator& generator, Raster& S_umca, Raster& S_oaks,
+                Raster& I_umca, Raster& I_oaks, const Hosts& lvtree_rast,
+                int row, int col, bool self, int spores, double weather);
 public:
     Sporulation(unsigned random_seed, const Img &size);
-    void SporeGen(const Img& I, const double *weather,
-                  double weather_value, double rate);
-    void SporeSpreadDisp(Img& S_umca, Img& S_oaks, Img& I_umca,
-                         Img& I_oaks, const Img& lvtree_rast, Rtype rtype,
-                         const double *weather, double weather_value,
-                         double scale1, double kappa = 2,
-                         Direction wdir = NONE, double scale2 = 0.0,
-                         double gamma = 0.0);
+    /* Use tiles of the given number of rows processed in parallel
+     *
+     * Random numbers come from counter-based streams given by the seed,
+     * week, cell and spore, so the result does not depend on the number
+     * of threads or the tile size (but it differs from the non-tiled
+     * computation which uses one sequential generator).
+     *
+     * When the kernels are called from a parallel region, the tiles are
+     * tasks which any idle thread of that region can execute.
+     */
+    void set_tiles(int tile_rows, unsigned threads,
+                   ThreadUsage *usage = nullptr);
+    /* Draw the random numbers from the given engine
+     *
+     * The standard engine is used with the standard distributions,
+     * the others with the fast samplers (see Samplers.h), which is also
+     * the case for the streams of the tiled mode with those engines.
+     */
+    void set_engine(RandomEngine engine)
+    {
+        this->engine = engine;
+    }
+    /* Binary state between weeks (for checkpoints)
+     *
+     * The random number generator, the list of active cells and the
+     * number of simulated weeks are stored, so a loaded object continues
+     * exactly as the saved one would. The tiles are not stored.
+     */
+    void write(std::ostream& stream) const;
+    void read(std::istream& stream);
+    unsigned get_seed() const
+    {
+        return seed;
+    }
+    // continue with a different stream of random numbers
+    void reseed(unsigned random_seed);
+    // totals of the hosts which SporeSpreadDisp modifies
+    // (not stored by write, they are set from the state)
+    void set_totals(const HostTotals& totals)
+    {
+        this->totals = totals;
+    }
+    const HostTotals& get_totals() const
+    {
+        return totals;
+    }
+    // counters since the last call (zero without SOD_INSTRUMENTATION)
+    RunCounters take_counters();
+    // the Raster type is Img or CompactImg (or anything with the same
+    // width, height and operator() interface), the Weather type is
+    // SpatialWeather, IndexedWeather or ConstantWeather
+    template<typename Weather, typename Raster>
+    void SporeGen(const Raster& I, const Weather& weather, double rate);
+    // the Dispersal type is DistributionDispersal or DispersalTable
+    // (BinnedDispersal is below)
+    template<typename Dispersal, typename Weather, typename Raster,
+             typename Hosts>
+    void SporeSpreadDisp(Raster& S_umca, Raster& S_oaks, Raster& I_umca,
+                         Raster& I_oaks, const Hosts& lvtree_rast,
+                         const Dispersal& dispersal, const Weather& weather);
+    // all spores of a cell together (the tiled mode uses
+    // the table for each spore)
+    template<typename Weather, typename Raster, typename Hosts>
+    void SporeSpreadDisp(Raster& S_umca, Raster& S_oaks, Raster& I_umca,
+                         Raster& I_oaks, const Hosts& lvtree_rast,
+                         const BinnedDispersal& dispersal,
+                         const Weather& weather);
+    // the same for all layers stored together
+    template<typename Weather, typename Number>
+    void SporeGen(const HostState<Number>& state, const Weather& weather,
+                  double rate);
+    template<typename Dispersal, typename Weather, typename Number>
+    void SporeSpreadDisp(HostState<Number>& state, const Dispersal& dispersal,
+                         const Weather& weather);
 };
 
+/* Collect the cells with infected hosts from the initial state.
+ *
+ * This is the only full scan of the raster, afterwards the list is
+ * maintained by SporeSpreadDisp when a cell gets its first infected host.
+ */
+template<typename Raster>
+void Sporulation::activate(const Raster& I)
+{
+    active_cells.clear();
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            if (I(i, j) > 0)
+                active_cells.push_back(i * width + j);
+        }
+    }
+    sorted_cells = active_cells.size();
+    activated = true;
+}
+
+/* The I raster must be the same as the I_umca image passed to
+ * SporeSpreadDisp and it must not be modified by anything else,
+ * otherwise the list of active cells gets out of sync.
+ */
+template<typename Weather, typename Raster>
+void Sporulation::SporeGen(const Raster& I, const Weather& weather,
+                           double rate)
+{
+    SOD_INSTRUMENT(double start = wall_time();)
+    if (!activated)
+        activate(I);
+    sort_active_cells();
+    sp.resize(active_cells.size());
+    ++step;
+    if (tile_rows) {
+        if (engine == ENGINE_STD)
+            tiled_spore_gen<CounterStream>(I, weather, rate);
+        else
+            tiled_spore_gen<SampledStream>(I, weather, rate);
+        SOD_INSTRUMENT(count_spores(start);)
+        return;
+    }
+    switch (engine) {
+    case ENGINE_XOSHIRO:
+        spore_gen(xoshiro, I, weather, rate);
+        break;
+    case ENGINE_PCG:
+        spore_gen(pcg, I, weather, rate);
+        break;
+    case ENGINE_PHILOX:
+        spore_gen(philox, I, weather, rate);
+        break;
+    default:
+        spore_gen(generator, I, weather, rate);
+    }
+    SOD_INSTRUMENT(count_spores(start);)
+}
+
+template<typename Weather, typename Raster>
+void Sporulation::spore_means(SporeBlock& block, const Raster& I,
+                              const Weather& weather, double rate,
+                              size_t first, size_t count) const
+{
+    for (size_t b = 0; b < count; b++) {
+        int cell = active_cells[first + b];
+        block.trees[b] = I(cell / width, cell % width);
+        block.weather[b] = weather(cell);
+    }
+    simd_spore_means(block.tree_means, block.cell_means, block.trees,
+                     block.weather, rate, count);
+}
+
+// the means of a block of cells are computed together, then the
+// numbers of the block are drawn in the order of the cells
+template<typename Generator, typename Weather, typename Raster>
+void Sporulation::spore_gen(Generator& generator, const Raster& I,
+                            const Weather& weather, double rate)
+{
+    SporeBlock block;
+    for (size_t first = 0; first < active_cells.size();
+         first += spore_block) {
+        size_t count = std::min(active_cells.size() - first, spore_block);
+        spore_means(block, I, weather, rate, first, count);
+        for (size_t b = 0; b < count; b++) {
+            if (block.trees[b] > 0)
+                sp[first + b] = Samplers<Generator>::spores(
+                            generator, block.trees[b], block.tree_means[b],
+                            block.cell_means[b]);
+            else
+                sp[first + b] = 0;
+        }
+    }
+}
+
+template<typename Dispersal, typename Weather, typename Raster,
+         typename Hosts>
+void Sporulation::SporeSpreadDisp(Raster& S_umca, Raster& S_oaks,
+                                  Raster& I_umca, Raster& I_oaks,
+                                  const Hosts& lvtree_rast,
+                                  const Dispersal& dispersal,
+                                  const Weather& weather)
+{
+    SOD_INSTRUMENT(double start = wall_time();)
+    if (tile_rows) {
+        if (engine == ENGINE_STD)
+            tiled_spread<CounterStream>(S_umca, S_oaks, I_umca, I_oaks,
+                                        lvtree_rast, dispersal, weather);
+        else
+            tiled_spread<SampledStream>(S_umca, S_oaks, I_umca, I_oaks,
+                                        lvtree_rast, dispersal, weather);
+        SOD_INSTRUMENT(counters.spread_time += wall_time() - start;)
+        return;
+    }
+    switch (engine) {
+    case ENGINE_XOSHIRO:
+        spread(xoshiro, S_umca, S_oaks, I_umca, I_oaks, lvtree_rast,
+               dispersal, weather);
+        break;
+    case ENGINE_PCG:
+        spread(pcg, S_umca, S_oaks, I_umca, I_oaks, lvtree_rast,
+               dispersal, weather);
+        break;
+    case ENGINE_PHILOX:
+        spread(philox, S_umca, S_oaks, I_umca, I_oaks, lvtree_rast,
+               dispersal, weather);
+        break;
+    default:
+        spread(generator, S_umca, S_oaks, I_umca, I_oaks, lvtree_rast,
+               dispersal, weather);
+    }
+    SOD_INSTRUMENT(counters.spread_time += wall_time() - start;)
+}
+
+template<typename Generator, typename Dispersal, typename Weather,
+         typename Raster, typename Hosts>
+void Sporulation::spread(Generator& generator, Raster& S_umca,
+                         Raster& S_oaks, Raster& I_umca, Raster& I_oaks,
+                         const Hosts& lvtree_rast,
+                         const Dispersal& dispersal, const Weather& weather)
+{
+    typedef Samplers<Generator> Sampling;
+    typename Sampling::Uniform distribution_uniform(0.0, 1.0);
+
+    // cells infected during this call are added at the end of the list
+    // and have no spores yet, so only the cells from SporeGen are visited
+    for (size_t a = 0; a < sp.size(); a++) {
+        int i = active_cells[a] / width;
+        int j = active_cells[a] % width;
+        for (int k = 0; k < sp[a]; k++) {
+
+            int drow;
+            int dcol;
+            dispersal(generator, drow, dcol);
+            int row = i + drow;
+            int col = j + dcol;
+
+            if (row < 0 || row >= height || col < 0 || col >= width) {
+                SOD_INSTRUMENT(++counters.outside;)
+                continue;
+            }
+
+            if (row == i && col == j) {
+                SOD_INSTRUMENT(if (S_umca(row, col) <= 0
+                                   && S_oaks(row, col) <= 0)
+                                   ++counters.no_hosts;)
+                if (S_umca(row, col) > 0 ||
+                        S_oaks(row, col) > 0) {
+                    double prob =
+                            (double)(S_umca(row, col) +
+                                     S_oaks(row, col)) /
+                            lvtree_rast(row, col);
+
+                    double U = distribution_uniform(generator);
+
+                    prob = prob * weather(row * width + col);
+
+                    // if U < prob, then one host will become infected
+                    if (U < prob) {
+                        double prob_S_umca =
+                                (double)(S_umca(row, col)) /
+                                (S_umca(row, col) +
+                                 S_oaks(row, col));
+                        double prob_S_oaks =
+                                (double)(S_oaks(row, col)) /
+                                (S_umca(row, col) +
+                                 S_oaks(row, col));
+
+                        typename Sampling::Bernoulli
+                            distribution_bern_prob(prob_S_umca);
+                        if (distribution_bern_prob(generator)) {
+                            if (I_umca(row, col) == 0) {
+                                active_cells.push_back(row * width + col);
+                                totals.exposed_S_oaks += S_oaks(row, col);
+                            }
+                            I_umca(row, col) += 1;
+                            S_umca(row, col) -= 1;
+                            ++totals.I_umca;
+                            --totals.S_umca;
+                            SOD_INSTRUMENT(++counters.infected_umca;)
+                        }
+                        else {
+                            I_oaks(row, col) += 1;
+                            S_oaks(row, col) -= 1;
+                            ++totals.I_oaks;
+                            --totals.S_oaks;
+                            --totals.exposed_S_oaks;
+                            SOD_INSTRUMENT(++counters.infected_oaks;)
+                        }
+                    }
+                }
+            }
+            else {
+                SOD_INSTRUMENT(if (S_umca(row, col) <= 0)
+                                   ++counters.no_hosts;)
+                if (S_umca(row, col) > 0) {
+                    double prob_S_umca =
+                            (double)(S_umca(row, col)) /
+                            lvtree_rast(row, col);
+                    double U = distribution_uniform(generator);
+
+                    prob_S_umca *= weather(row * width + col);
+                    if (U < prob_S_umca) {
+                        if (I_umca(row, col) == 0) {
+                            active_cells.push_back(row * width + col);
+                            totals.exposed_S_oaks += S_oaks(row, col);
+                        }
+                        I_umca(row, col) += 1;
+                        S_umca(row, col) -= 1;
+                        ++totals.I_umca;
+                        --totals.S_umca;
+                        SOD_INSTRUMENT(++counters.infected_umca;)
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Infections from the given number of spores which land in a cell
+ *
+ * As in the trials for each spore, a spore infects one of the living
+ * trees when that tree is susceptible (oaks only from the same cell)
+ * with the probability given by the weather. The spores which land
+ * between two infections are skipped at once using the geometric
+ * distribution, so the random numbers scale with the infections.
+ */
+template<typename Generator, typename Raster, typename Hosts>
+void Sporulation::infect(Generator& generator, Raster& S_umca,
+                         Raster& S_oaks, Raster& I_umca, Raster& I_oaks,
+                         const Hosts& lvtree_rast, int row, int col,
+                         bool self, int spores, double weather)
+{
+    typedef Samplers<Generator> Sampling;
+    while (spores > 0) {
+        int susceptible = S_umca(row, col);
+        if (self)
+            susceptible += S_oaks(row, col);
+        if (susceptible <= 0) {
+            SOD_INSTRUMENT(counters.no_hosts += spores;)
+            return;
+        }
+        double prob = (double)(susceptible) / lvtree_rast(row, col);
+        prob *= weather;
+        if (!(prob > 0))
+            return;
+        if (spores == 1 && prob < 1) {
+            // the same trial as for each spore
+            if (typename Sampling::Uniform(0, 1)(generator) >= prob)
+                return;
+        }
+        else if (prob < 1) {
+            // spores landing without infection before the next one
+            long missed = typename Sampling::Geometric(prob)(generator);
+            if (missed >= spores)
+                return;
+            spores -= missed;
+        }
+        --spores;
+        if (!self || typename Sampling::Bernoulli(
+                (double)(S_umca(row, col)) / susceptible)(generator)) {
+            if (I_umca(row, col) == 0) {
+                active_cells.push_back(row * width + col);
+                totals.exposed_S_oaks += S_oaks(row, col);
+            }
+            I_umca(row, col) += 1;
+            S_umca(row, col) -= 1;
+            ++totals.I_umca;
+            --totals.S_umca;
+            SOD_INSTRUMENT(++counters.infected_umca;)
+        }
+        else {
+            I_oaks(row, col) += 1;
+            S_oaks(row, col) -= 1;
+            ++totals.I_oaks;
+            --totals.S_oaks;
+            --totals.exposed_S_oaks;
+            SOD_INSTRUMENT(++counters.infected_oaks;)
+        }
+    }
+}
+
+template<typename Weather, typename Raster, typename Hosts>
+void Sporulation::SporeSpreadDisp(Raster& S_umca, Raster& S_oaks,
+                                  Raster& I_umca, Raster& I_oaks,
+                                  const Hosts& lvtree_rast,
+                                  const BinnedDispersal& dispersal,
+                                  const Weather& weather)
+{
+    SOD_INSTRUMENT(double start = wall_time();)
+    if (tile_rows) {
+        if (engine == ENGINE_STD)
+            tiled_spread<CounterStream>(S_umca, S_oaks, I_umca, I_oaks,
+                                        lvtree_rast, dispersal, weather);
+        else
+            tiled_spread<SampledStream>(S_umca, S_oaks, I_umca, I_oaks,
+                                        lvtree_rast, dispersal, weather);
+        SOD_INSTRUMENT(counters.spread_time += wall_time() - start;)
+        return;
+    }
+    switch (engine) {
+    case ENGINE_XOSHIRO:
+        binned_spread(xoshiro, S_umca, S_oaks, I_umca, I_oaks, lvtree_rast,
+                      dispersal, weather);
+        break;
+    case ENGINE_PCG:
+        binned_spread(pcg, S_umca, S_oaks, I_umca, I_oaks, lvtree_rast,
+                      dispersal, weather);
+        break;
+    case ENGINE_PHILOX:
+        binned_spread(philox, S_umca, S_oaks, I_umca, I_oaks, lvtree_rast,
+                      dispersal, weather);
+        break;
+    default:
+        binned_spread(generator, S_umca, S_oaks, I_umca, I_oaks,
+                      lvtree_rast, dispersal, weather);
+    }
+    SOD_INSTRUMENT(counters.spread_time += wall_time() - start;)
+}
+
+template<typename Generator, typename Weather, typename Raster,
+         typename Hosts>
+void Sporulation::binned_spread(Generator& generator, Raster& S_umca,
+                                Raster& S_oaks, Raster& I_umca,
+                                Raster& I_oaks, const Hosts& lvtree_rast,
+                                const BinnedDispersal& dispersal,
+                                const Weather& weather)
+{
+    for (size_t a = 0; a < sp.size(); a++) {
+        int i = active_cells[a] / width;
+        int j = active_cells[a] % width;
+        dispersal.split(generator, sp[a], [&](int drow, int dcol,
+                                              int spores) {
+            int row = i + drow;
+            int col = j + dcol;
+            if (row < 0 || row >= height || col < 0 || col >= width) {
+                SOD_INSTRUMENT(counters.outside += spores;)
+                return;
+            }
+            infect(generator, S_umca, S_oaks, I_umca, I_oaks, lvtree_rast,
+                   row, col, row == i && col == j, spores,
+                   weather(row * width + col));
+        });
+    }
+}
+
+template<typename Weather, typename Number>
+void Sporulation::SporeGen(const HostState<Number>& state,
+                           const Weather& weather, double rate)
+{
+    SporeGen(state.I_umca(), weather, rate);
+}
+
+template<typename Dispersal, typename Weather, typename Number>
+void Sporulation::SporeSpreadDisp(HostState<Number>& state,
+                                  const Dispersal& dispersal,
+                                  const Weather& weather)
+{
+    auto S_umca = state.S_umca();
+    auto S_oaks = state.S_oaks();
+    auto I_umca = state.I_umca();
+    auto I_oaks = state.I_oaks();
+    SporeSpreadDisp(S_umca, S_oaks, I_umca, I_oaks, state.lvtree(),
+                    dispersal, weather);
+}
+
+template<typename Stream, typename Weather, typename Raster>
+void Sporulation::tiled_spore_gen(const Raster& I, const Weather& weather,
+                                  double rate)
+{
+    // cells are independent, so the tiles are just chunks of the cells
+    const size_t chunk = 64;
+    int num_chunks = (active_cells.size() + chunk - 1) / chunk;
+    parallel_tiles(num_chunks, threads, [&](int c) {
+        size_t first = c * chunk;
+        size_t count = std::min(active_cells.size() - first, chunk);
+        SporeBlock block;
+        spore_means(block, I, weather, rate, first, count);
+        for (size_t b = 0; b < count; b++) {
+            Stream stream(seed, step, active_cells[first + b], 0);
+            sp[first + b] = Samplers<Stream>::spores(
+                        stream, block.trees[b], block.tree_means[b],
+                        block.cell_means[b]);
+        }
+    }, usage);
+}
+
+/* Dispersal in two phases
+ *
+ * First, the spores of each source tile are dispersed and their landings
+ * are stored by destination tile. Then, the landings in each destination
+ * tile are applied to the hosts in the order of the source cells, i.e.,
+ * in the same order as in the sequential computation. Each tile is
+ * modified only by one thread.
+ */
+template<typename Stream, typename Dispersal, typename Weather,
+         typename Raster, typename Hosts>
+void Sporulation::tiled_spread(Raster& S_umca, Raster& S_oaks,
+                               Raster& I_umca, Raster& I_oaks,
+                               const Hosts& lvtree_rast,
+                               const Dispersal& dispersal,
+                               const Weather& weather)
+{
+    int num_tiles = (height + tile_rows - 1) / tile_rows;
+    landings.resize(num_tiles * num_tiles);
+    infected.resize(num_tiles);
+    tile_totals.assign(num_tiles, HostTotals());
+    SOD_INSTRUMENT(tile_counters.assign(num_tiles, RunCounters());)
+
+    // the active cells are ordered by rows, so each tile is a range
+    std::vector<size_t> tile_cells(num_tiles + 1);
+    for (int t = 0; t <= num_tiles; t++) {
+        int first_cell = std::min(t * tile_rows, height) * width;
+        tile_cells[t] = std::lower_bound(active_cells.begin(),
+                                         active_cells.begin() + sp.size(),
+                                         first_cell)
+                        - active_cells.begin();
+    }
+
+    parallel_tiles(num_tiles, threads, [&](int t) {
+        typename Samplers<Stream>::Uniform distribution_uniform(0.0, 1.0);
+
+        for (int d = 0; d < num_tiles; d++)
+            landings[t * num_tiles + d].clear();
+        for (size_t a = tile_cells[t]; a < tile_cells[t + 1]; a++) {
+            int i = active_cells[a] / width;
+            int j = active_cells[a] % width;
+            for (int k = 0; k < sp[a]; k++) {
+                Stream stream(seed, step, active_cells[a], k + 1);
+                int drow;
+                int dcol;
+                dispersal(stream, drow, dcol);
+                int row = i + drow;
+                int col = j + dcol;
+
+                if (row < 0 || row >= height || col < 0 || col >= width) {
+                    SOD_INSTRUMENT(++tile_counters[t].outside;)
+                    continue;
+                }
+
+                Landing landing;
+                landing.cell = row * width + col;
+                landing.self = row == i && col == j;
+                landing.u = distribution_uniform(stream);
+                landing.v = distribution_uniform(stream);
+                landings[t * num_tiles + row / tile_rows].push_back(landing);
+            }
+        }
+    }, usage);
+
+    parallel_tiles(num_tiles, threads, [&](int d) {
+        infected[d].clear();
+        for (int t = 0; t < num_tiles; t++) {
+            for (const auto& landing : landings[t * num_tiles + d]) {
+                int row = landing.cell / width;
+                int col = landing.cell % width;
+                double w = weather(landing.cell);
+                int s_umca = S_umca(row, col);
+                int s_oaks = S_oaks(row, col);
+                if (landing.self) {
+                    if (s_umca <= 0 && s_oaks <= 0) {
+                        SOD_INSTRUMENT(++tile_counters[d].no_hosts;)
+                        continue;
+                    }
+                    double prob = (double)(s_umca + s_oaks)
+                            / lvtree_rast(row, col) * w;
+                    if (!(landing.u < prob))
+                        continue;
+                    double prob_S_umca = (double)(s_umca) / (s_umca + s_oaks);
+                    if (landing.v < prob_S_umca) {
+                        if (I_umca(row, col) == 0) {
+                            infected[d].push_back(landing.cell);
+                            tile_totals[d].exposed_S_oaks += s_oaks;
+                        }
+                        I_umca(row, col) += 1;
+                        S_umca(row, col) -= 1;
+                        ++tile_totals[d].I_umca;
+                        --tile_totals[d].S_umca;
+                        SOD_INSTRUMENT(++tile_counters[d].infected_umca;)
+                    }
+                    else {
+                        I_oaks(row, col) += 1;
+                        S_oaks(row, col) -= 1;
+                        ++tile_totals[d].I_oaks;
+                        --tile_totals[d].S_oaks;
+                        --tile_totals[d].exposed_S_oaks;
+                        SOD_INSTRUMENT(++tile_counters[d].infected_oaks;)
+                    }
+                }
+                else if (s_umca > 0) {
+                    double prob_S_umca = (double)(s_umca)
+                            / lvtree_rast(row, col) * w;
+                    if (landing.u < prob_S_umca) {
+                        if (I_umca(row, col) == 0) {
+                            infected[d].push_back(landing.cell);
+                            tile_totals[d].exposed_S_oaks += s_oaks;
+                        }
+                        I_umca(row, col) += 1;
+                        S_umca(row, col) -= 1;
+                        ++tile_totals[d].I_umca;
+                        --tile_totals[d].S_umca;
+                        SOD_INSTRUMENT(++tile_counters[d].infected_umca;)
+                    }
+                }
+                else {
+                    SOD_INSTRUMENT(++tile_counters[d].no_hosts;)
+                }
+            }
+        }
+    }, usage);
+    for (const auto& cells : infected)
+        active_cells.insert(active_cells.end(), cells.begin(), cells.end());
+    for (const auto& tile : tile_totals)
+        totals += tile;
+    SOD_INSTRUMENT(for (const auto& tile : tile_counters) counters += tile;)
+}
+
 #endif
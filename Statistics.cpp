@@ -0,0 +1,211 @@
+/*
+ * SOD model - statistics over the stochastic runs
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+RasterSums::RasterSums()
+    : width(0), height(0), count(0)
+{}
+
+void RasterSums::reset(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    count = 0;
+    sums.assign(width * height, 0);
+    squares.assign(width * height, 0);
+    positives.assign(width * height, 0);
+}
+
+void RasterSums::assign(int width, int height, unsigned runs,
+                        AlignedVector<int64_t> sums,
+                        AlignedVector<int64_t> squares,
+                        AlignedVector<unsigned> positives)
+{
+    this->width = width;
+    this->height = height;
+    count = runs;
+    this->sums = std::move(sums);
+    this->squares = std::move(squares);
+    this->positives = std::move(positives);
+}
+
+void RasterSums::add_rows(const RasterSums& other, int first_row,
+                          int end_row)
+{
+    size_t first = size_t(first_row) * width;
+    size_t count = size_t(end_row - first_row) * width;
+    simd_add_to(sums.data() + first, other.sums.data() + first, count);
+    simd_add_to(squares.data() + first, other.squares.data() + first,
+                count);
+    simd_add_to(positives.data() + first, other.positives.data() + first,
+                count);
+}
+
+void RasterSums::sum_to_root(const Distributed& processes)
+{
+    processes.sum_to_root(sums.data(), sums.size());
+    processes.sum_to_root(squares.data(), squares.size());
+    processes.sum_to_root(positives.data(), positives.size());
+    processes.sum_to_root(count);
+}
+
+EnsembleStatistics::EnsembleStatistics(unsigned threads, const Img& size)
+    :
+      width(size.getWidth()),
+      height(size.getHeight()),
+      w_e_res(size.getWEResolution()),
+      n_s_res(size.getNSResolution()),
+      partial(threads),
+      combined(false)
+{}
+
+void EnsembleStatistics::clear()
+{
+    // the memory is zeroed by each thread when it adds the first run
+    for (auto& sums : partial)
+        sums.clear();
+    combined = false;
+}
+
+void EnsembleStatistics::add_sums(const RasterSums& sums)
+{
+    RasterSums& own = partial[thread_number()];
+    if (!own.runs())
+        own.reset(width, height);
+    own.add_rows(sums, 0, height);
+    own.add_runs(sums.runs());
+    combined = false;
+}
+
+void EnsembleStatistics::add_sums(const EnsembleStatistics& other)
+{
+    add_sums(other.total);
+}
+
+unsigned EnsembleStatistics::runs() const
+{
+    unsigned count = 0;
+    for (const auto& sums : partial)
+        count += sums.runs();
+    return count;
+}
+
+void EnsembleStatistics::combine(unsigned threads,
+                                 const Distributed *processes)
+{
+    if (combined)
+        return;
+    total.reset(width, height);
+    const int rows = 64;
+    int blocks = (height + rows - 1) / rows;
+    #pragma omp parallel for num_threads(threads) schedule(dynamic)
+    for (int block = 0; block < blocks; block++) {
+        int end_row = std::min(height, (block + 1) * rows);
+        for (const auto& sums : partial)
+            if (sums.runs())
+                total.add_rows(sums, block * rows, end_row);
+    }
+    total.add_runs(runs());
+    if (processes && processes->size() > 1)
+        total.sum_to_root(*processes);
+    combined = true;
+}
+
+BasicImg<double> EnsembleStatistics::mean() const
+{
+    BasicImg<double> out(width, height, w_e_res, n_s_res);
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            out(i, j) = total.mean(i * width + j);
+    return out;
+}
+
+BasicImg<double> EnsembleStatistics::stddev() const
+{
+    BasicImg<double> out(width, height, w_e_res, n_s_res);
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            out(i, j) = std::sqrt(total.variance(i * width + j));
+    return out;
+}
+
+BasicImg<double> EnsembleStatistics::probability() const
+{
+    BasicImg<double> out(width, height, w_e_res, n_s_res);
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            out(i, j) = total.probability(i * width + j);
+    return out;
+}
+
+BatchConvergence::BatchConvergence(ConvergenceCriterion criterion,
+                                   double tolerance)
+    :
+      criterion(criterion),
+      tolerance(tolerance),
+      batches(0),
+      count(0),
+      sum(0),
+      squares(0),
+      last_value(std::numeric_limits<double>::infinity())
+{}
+
+// a / b when b is positive, otherwise zero for zero a (or infinity)
+static double relative(double a, double b)
+{
+    if (b > 0)
+        return a / b;
+    return a > 0 ? std::numeric_limits<double>::infinity() : 0;
+}
+
+bool BatchConvergence::add_batch(const BasicImg<double>& mean,
+                                 unsigned runs, double sum, double squares)
+{
+    ++batches;
+    count += runs;
+    this->sum += sum;
+    this->squares += squares;
+    if (criterion == CONVERGENCE_CHANGE) {
+        if (batches > 1) {
+            double difference = 0;
+            double total = 0;
+            for (int i = 0; i < mean.getHeight(); i++) {
+                for (int j = 0; j < mean.getWidth(); j++) {
+                    difference += std::abs(mean(i, j) - previous_mean(i, j));
+                    total += mean(i, j);
+                }
+            }
+            last_value = relative(difference, total);
+        }
+        previous_mean = mean;
+    }
+    else if (batches > 1) {
+        double summary_mean = this->sum / count;
+        double variance = (this->squares - count * summary_mean
+                           * summary_mean) / (count - 1);
+        double half_width = 1.96 * std::sqrt(std::max(variance, 0.)
+                                             / count);
+        last_value = relative(half_width, summary_mean);
+    }
+    return batches > 1 && last_value <= tolerance;
+}
@@ -0,0 +1,220 @@
+/*
+ * SOD model - statistics over the stochastic runs
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include "Img.h"
+#include "Tasks.h"
+#include "Distributed.h"
+#include "Memory.h"
+#include "Simd.h"
+
+#include <vector>
+#include <stdint.h>
+
+/* Sums of a raster over the runs added to it
+ *
+ * The values are numbers of trees, so the sums of the values and of
+ * their squares are exact integers. Unlike with a running (Welford)
+ * mean, the result does not depend on the order in which the runs are
+ * added, so partial sums from threads can be combined in any order and
+ * the result is always the same. Runs stored as int images are added
+ * with the vector instructions of the processor in one pass over the
+ * aligned sums.
+ */
+class RasterSums
+{
+private:
+    int width;
+    int height;
+    unsigned count;
+    AlignedVector<int64_t> sums;
+    AlignedVector<int64_t> squares;
+    // number of runs with value greater than zero
+    AlignedVector<unsigned> positives;
+public:
+    RasterSums();
+    // set to zero runs of the given size, memory is allocated only once
+    void reset(int width, int height);
+
+    // set to zero runs without touching the memory,
+    // reset must be called before adding
+    void clear()
+    {
+        count = 0;
+    }
+
+    unsigned runs() const
+    {
+        return count;
+    }
+
+    template<typename Raster>
+    void add(const Raster& image)
+    {
+        for (int i = 0; i < height; i++) {
+            for (int j = 0; j < width; j++) {
+                int64_t value = image(i, j);
+                sums[i * width + j] += value;
+                squares[i * width + j] += value * value;
+                if (value > 0)
+                    positives[i * width + j] += 1;
+            }
+        }
+        ++count;
+    }
+    void add(const Img& image)
+    {
+        simd_accumulate(image.values(), sums.size(), sums.data(),
+                        squares.data(), positives.data());
+        ++count;
+    }
+
+    // sums of the given number of runs computed elsewhere
+    // (e.g. on a device), the vectors have a value for each cell
+    void assign(int width, int height, unsigned runs,
+                AlignedVector<int64_t> sums, AlignedVector<int64_t> squares,
+                AlignedVector<unsigned> positives);
+
+    // add sums of the rows from other sums (of the same size),
+    // the number of runs is added separately
+    void add_rows(const RasterSums& other, int first_row, int end_row);
+    void add_runs(unsigned runs)
+    {
+        count += runs;
+    }
+    // sums of all the processes, only the root has the result
+    void sum_to_root(const Distributed& processes);
+
+    double mean(int cell) const
+    {
+        return double(sums[cell]) / count;
+    }
+
+    // population variance (divided by the number of runs)
+    double variance(int cell) const
+    {
+        // exact as long as the squares fit into 64 bits
+        int64_t numerator = count * squares[cell] - sums[cell] * sums[cell];
+        return double(numerator) / (double(count) * count);
+    }
+
+    double probability(int cell) const
+    {
+        return double(positives[cell]) / count;
+    }
+};
+
+/* Statistics of a raster collected from multiple threads
+ *
+ * Each thread adds the runs it simulated to its own sums (in a task
+ * right after the run is done), so there is no synchronization
+ * and no serial pass over all runs. The partial sums are combined
+ * in parallel when the result is needed. With multiple processes,
+ * the sums of all processes are then added in the root process, so
+ * only the root has the results.
+ */
+class EnsembleStatistics
+{
+private:
+    int width;
+    int height;
+    int w_e_res;
+    int n_s_res;
+    std::vector<RasterSums> partial;
+    RasterSums total;
+    bool combined;
+public:
+    EnsembleStatistics(unsigned threads, const Img& size);
+    // forget all the runs added so far
+    void clear();
+    // add a run in the calling thread
+    template<typename Raster>
+    void add(const Raster& image)
+    {
+        RasterSums& sums = partial[thread_number()];
+        if (!sums.runs())
+            sums.reset(width, height);
+        sums.add(image);
+        combined = false;
+    }
+    // add sums of runs (of the same size) in the calling thread
+    void add_sums(const RasterSums& sums);
+    // add all runs of other combined statistics (of the same size),
+    // e.g. of the batches of an ensemble
+    void add_sums(const EnsembleStatistics& other);
+    unsigned runs() const;
+    // combine the partial sums with the given number of threads
+    // and then from all the processes if given (called by all of them),
+    // must be called before getting the results
+    void combine(unsigned threads, const Distributed *processes = nullptr);
+    BasicImg<double> mean() const;
+    BasicImg<double> stddev() const;
+    // part of the runs with value greater than zero
+    BasicImg<double> probability() const;
+};
+
+/* How BatchConvergence tests the runs */
+enum ConvergenceCriterion
+{
+    CONVERGENCE_CHANGE, CONVERGENCE_INTERVAL
+};
+
+/* Whether an ensemble simulated in batches has enough runs
+ *
+ * With CONVERGENCE_CHANGE, the mean raster of all runs after a batch
+ * is compared with the one after the previous batch, the value is the
+ * sum of the absolute differences divided by the sum of the mean.
+ * With CONVERGENCE_INTERVAL, a summary of each run (e.g. the total of
+ * infected oaks) is used, the value is the half-width of the 95%
+ * confidence interval of its mean divided by the mean. The runs are
+ * enough when the value is at most the tolerance. The first batch is
+ * never enough, there is nothing to compare with or no variance yet.
+ */
+class BatchConvergence
+{
+private:
+    ConvergenceCriterion criterion;
+    double tolerance;
+    unsigned batches;
+    unsigned count;
+    // of the summaries of the runs
+    double sum;
+    double squares;
+    BasicImg<double> previous_mean;
+    double last_value;
+public:
+    BatchConvergence(ConvergenceCriterion criterion, double tolerance);
+    // mean raster of all runs so far and the sum and sum of squares
+    // of the summaries of the runs in the batch, returns true when
+    // the runs are enough
+    bool add_batch(const BasicImg<double>& mean, unsigned runs, double sum,
+                   double squares);
+    // relative change or width after the last batch
+    // (infinity after the first one)
+    double value() const
+    {
+        return last_value;
+    }
+    unsigned runs() const
+    {
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * SOD model - summaries of the runs by date and zone
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "Summary.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+using std::string;
+
+SummaryZones::SummaryZones(const Img& image)
+    :
+      width(image.getWidth()),
+      height(image.getHeight()),
+      positions(size_t(width) * height, 0)
+{
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            if (image(i, j) > 0)
+                categories.push_back(image(i, j));
+    std::sort(categories.begin(), categories.end());
+    categories.erase(std::unique(categories.begin(), categories.end()),
+                     categories.end());
+    for (int i = 0; i < height; i++) {
+        for (int j = 0; j < width; j++) {
+            if (image(i, j) <= 0)
+                continue;
+            auto zone = std::lower_bound(categories.begin(),
+                                         categories.end(), image(i, j));
+            positions[size_t(i) * width + j]
+                    = zone - categories.begin() + 1;
+        }
+    }
+}
+
+SummaryTable::SummaryTable(const string& filename, const SummaryZones *zones,
+                           int64_t cell_area)
+    :
+      stream(filename),
+      filename(filename),
+      zones(zones),
+      cell_area(cell_area)
+{
+    if (!stream)
+        throw std::runtime_error("Cannot create summary table " + filename);
+    stream << "run,date,zone,infected_oaks,infected_umca,infected_cells,"
+              "infected_area\n";
+}
+
+void SummaryTable::write(unsigned run, const std::vector<Date>& dates,
+                         const std::vector<InfectionSummary>& summaries)
+{
+    size_t num_zones = zones ? zones->size() : 0;
+    for (size_t i = 0; i < dates.size(); i++) {
+        const Date& date = dates[i];
+        for (size_t zone = 0; zone <= num_zones; zone++) {
+            const InfectionSummary& summary
+                    = summaries[i * (num_zones + 1) + zone];
+            stream << run << "," << date.getYear() << "-"
+                   << std::setfill('0') << std::setw(2) << date.getMonth()
+                   << "-" << std::setw(2) << date.getDay() << ","
+                   << (zone ? zones->category(zone - 1) : 0) << ","
+                   << summary.infected_oaks << ","
+                   << summary.infected_umca << ","
+                   << summary.infected_cells << ","
+                   << summary.infected_cells * cell_area << "\n";
+        }
+    }
+    if (!stream)
+        throw std::runtime_error("Cannot write summary table " + filename);
+}
+
+void SummaryTable::close()
+{
+    stream.close();
+    if (!stream)
+        throw std::runtime_error("Cannot write summary table " + filename);
+}
@@ -0,0 +1,136 @@
+/*
+ * SOD model - summaries of the runs by date and zone
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include "date.h"
+#include "Img.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/* Infected trees of one run in the whole landscape or in one zone
+ *
+ * The infected cells have infected oaks or infected bay laurel,
+ * the area is the number of the cells times the area of a cell.
+ */
+struct InfectionSummary
+{
+    int64_t infected_oaks;
+    int64_t infected_umca;
+    int64_t infected_cells;
+
+    InfectionSummary()
+        : infected_oaks(0), infected_umca(0), infected_cells(0)
+    {}
+};
+
+/* Zones of the summaries from a raster of categories
+ *
+ * Each category greater than zero is one zone, the other cells
+ * (zero, negative or null) are not in any zone. The summaries of a run
+ * are the whole landscape followed by the zones ordered by category.
+ */
+class SummaryZones
+{
+public:
+    explicit SummaryZones(const Img& categories);
+
+    int getWidth() const
+    {
+        return width;
+    }
+    int getHeight() const
+    {
+        return height;
+    }
+    // number of zones
+    size_t size() const
+    {
+        return categories.size();
+    }
+    int category(size_t zone) const
+    {
+        return categories[zone];
+    }
+    // position of the zone of a cell in the summaries (one for the first
+    // zone), zero when the cell is not in any zone
+    unsigned position(int row, int col) const
+    {
+        return positions[size_t(row) * width + col];
+    }
+
+private:
+    int width;
+    int height;
+    std::vector<int> categories;
+    std::vector<unsigned> positions;
+};
+
+inline void add_infected_cell(InfectionSummary& summary,
+                              int infected_umca, int infected_oaks)
+{
+    summary.infected_umca += infected_umca;
+    summary.infected_oaks += infected_oaks;
+    summary.infected_cells += 1;
+}
+
+// adds infected trees of a cell to the landscape and its zone
+// (zones can be null), the summaries must have the size
+// of the zones plus one
+inline void summarize_cell(InfectionSummary *summaries,
+                           const SummaryZones *zones, int row, int col,
+                           int infected_umca, int infected_oaks)
+{
+    if (infected_umca <= 0 && infected_oaks <= 0)
+        return;
+    add_infected_cell(summaries[0], infected_umca, infected_oaks);
+    unsigned position = zones ? zones->position(row, col) : 0;
+    if (position)
+        add_infected_cell(summaries[position], infected_umca, infected_oaks);
+}
+
+/* Table of the summaries as CSV
+ *
+ * One line for each run, date and zone with the columns run, date,
+ * zone, infected_oaks, infected_umca, infected_cells and infected_area.
+ * Zone 0 is the whole landscape, the others are the categories.
+ * Throws runtime_error when the file cannot be written.
+ */
+class SummaryTable
+{
+public:
+    // the area is of one cell, zones can be null
+    SummaryTable(const std::string& filename, const SummaryZones *zones,
+                 int64_t cell_area);
+
+    // summaries of a run (numbered from one) for each of the dates,
+    // each date has the landscape and then all zones
+    void write(unsigned run, const std::vector<Date>& dates,
+               const std::vector<InfectionSummary>& summaries);
+    void close();
+
+private:
+    std::ofstream stream;
+    std::string filename;
+    const SummaryZones *zones;
+    int64_t cell_area;
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * SOD model - parallel tasks
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <vector>
+#include <chrono>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+inline double wall_time()
+{
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return std::chrono::duration<double>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline unsigned thread_number()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/* Time spent in tasks by each thread
+ *
+ * Each thread writes only its own items. Time a task spends waiting for
+ * its nested tasks (which is counted by the nested tasks themselves)
+ * is recorded separately so that it can be subtracted.
+ */
+class ThreadUsage
+{
+private:
+    std::vector<double> busy_time;
+    std::vector<double> wait_time;
+    std::vector<unsigned long> task_count;
+    double wall;
+public:
+    explicit ThreadUsage(unsigned threads)
+        : busy_time(threads, 0), wait_time(threads, 0),
+          task_count(threads, 0), wall(0)
+    {}
+
+    unsigned threads() const
+    {
+        return busy_time.size();
+    }
+
+    void add_busy(double seconds)
+    {
+        busy_time[thread_number()] += seconds;
+        task_count[thread_number()] += 1;
+    }
+
+    void add_wait(double seconds)
+    {
+        wait_time[thread_number()] += seconds;
+    }
+
+    // wait time of the current thread
+    double waited() const
+    {
+        return wait_time[thread_number()];
+    }
+
+    void add_wall(double seconds)
+    {
+        wall += seconds;
+    }
+
+    double busy(unsigned thread) const
+    {
+        return busy_time[thread];
+    }
+
+    unsigned long tasks(unsigned thread) const
+    {
+        return task_count[thread];
+    }
+
+    // time of all parallel sections
+    double wall_time() const
+    {
+        return wall;
+    }
+};
+
+/* Placement of threads on the processors */
+enum Affinity
+{
+    AFFINITY_NONE, AFFINITY_CLOSE, AFFINITY_SPREAD
+};
+
+/* Pinning of the threads of parallel regions to processors
+ *
+ * The processors are the ones the process can use when the object is
+ * created. With close, thread i is pinned to the i-th processor, with
+ * spread, the threads are distributed evenly over all of them (e.g.
+ * over both sockets of a node when the processors are numbered by
+ * socket). A pinned thread keeps using the memory node where it first
+ * touched the state of its runs. Only Linux is supported, elsewhere
+ * nothing is pinned.
+ */
+class ThreadAffinity
+{
+private:
+    Affinity affinity;
+    std::vector<int> processors;
+public:
+    explicit ThreadAffinity(Affinity affinity)
+        : affinity(affinity)
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        if (affinity != AFFINITY_NONE
+                && !sched_getaffinity(0, sizeof(set), &set))
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (CPU_ISSET(cpu, &set))
+                    processors.push_back(cpu);
+#endif
+    }
+
+    bool enabled() const
+    {
+        return !processors.empty();
+    }
+
+    // pin the calling thread which has the given number in a region
+    void bind(unsigned thread, unsigned threads) const
+    {
+#ifdef __linux__
+        if (processors.empty())
+            return;
+        size_t i = thread % processors.size();
+        if (affinity == AFFINITY_SPREAD && threads < processors.size())
+            i = size_t(thread) * processors.size() / threads;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(processors[i], &set);
+        sched_setaffinity(0, sizeof(set), &set);
+#else
+        (void) thread;
+        (void) threads;
+#endif
+    }
+};
+
+/* Call f(i) for i from 0 to n - 1 in parallel
+ *
+ * When called from a parallel region (e.g. from a task of a run), the
+ * calls are created as tasks which idle threads can take over, otherwise
+ * a new parallel region with the given number of threads is used.
+ */
+template<class Function>
+void parallel_tiles(int n, unsigned threads, Function f,
+                    ThreadUsage *usage = nullptr)
+{
+    double start = wall_time();
+#ifdef _OPENMP
+    if (omp_in_parallel()) {
+        #pragma omp taskloop grainsize(1)
+        for (int i = 0; i < n; i++) {
+            double task_start = wall_time();
+            f(i);
+            if (usage)
+                usage->add_busy(wall_time() - task_start);
+        }
+        if (usage)
+            usage->add_wait(wall_time() - start);
+        return;
+    }
+#endif
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for (int i = 0; i < n; i++) {
+        double task_start = wall_time();
+        f(i);
+        if (usage)
+            usage->add_busy(wall_time() - task_start);
+    }
+    if (usage)
+        usage->add_wait(wall_time() - start);
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * SOD model - weather coefficients
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef WEATHER_H
+#define WEATHER_H
+
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+/* Type of the stored spatial weather coefficients */
+enum WeatherCode
+{
+    WEATHER_FLOAT32, WEATHER_UINT16, WEATHER_UINT8
+};
+
+/* How the spatial weather coefficients of a week are stored
+ *
+ * Quantized coefficients are offset + scale * code. The weather can
+ * have a coarser grid than the hosts (with the same extent). The index
+ * gives the weather cell for each host cell, it is used for quantized
+ * or coarse weather.
+ */
+struct WeatherFormat
+{
+    bool spatial;
+    WeatherCode code;
+    double scale;
+    double offset;
+    // empty for floats on the same grid as the hosts
+    std::shared_ptr<const std::vector<unsigned>> index;
+
+    WeatherFormat()
+        : spatial(false), code(WEATHER_FLOAT32), scale(1), offset(0)
+    {}
+};
+
+// weather cell for each host cell when the grids cover the same extent
+inline std::vector<unsigned> weather_index(int width, int height,
+                                           int weather_width,
+                                           int weather_height)
+{
+    std::vector<unsigned> index(size_t(width) * height);
+    for (int row = 0; row < height; row++) {
+        unsigned weather_row = int64_t(row) * weather_height / height;
+        for (int col = 0; col < width; col++) {
+            unsigned weather_col = int64_t(col) * weather_width / width;
+            index[row * width + col] =
+                    weather_row * weather_width + weather_col;
+        }
+    }
+    return index;
+}
+
+/* Weather coefficient of a week by cell (row * width + col)
+ *
+ * The kernels are templates over these classes, so they do not decide
+ * between spatial and constant weather or between the ways the
+ * coefficients are stored for each cell. All are created from the
+ * weekly inputs, i.e., the coefficients for all cells (can be null for
+ * constant weather) and the single value for all cells.
+ * SpatialWeather reads floats on the same grid as the hosts, so they
+ * can be used directly from the weather cache.
+ */
+class SpatialWeather
+{
+private:
+    const float *values;
+public:
+    SpatialWeather(const WeatherFormat&, const void *values, double)
+        : values(static_cast<const float *>(values))
+    {}
+    double operator()(int cell) const
+    {
+        return values[cell];
+    }
+};
+
+/* Quantized or coarse weather (or both) with Code as the stored type */
+template<typename Code>
+class IndexedWeather
+{
+private:
+    const Code *codes;
+    const unsigned *index;
+    double scale;
+    double offset;
+public:
+    IndexedWeather(const WeatherFormat& format, const void *values, double)
+        :
+          codes(static_cast<const Code *>(values)),
+          index(format.index->data()),
+          scale(format.scale),
+          offset(format.offset)
+    {}
+    double operator()(int cell) const
+    {
+        return offset + scale * codes[index[cell]];
+    }
+};
+
+class ConstantWeather
+{
+private:
+    double value;
+public:
+    ConstantWeather(const WeatherFormat&, const void *, double value)
+        : value(value)
+    {}
+    double operator()(int) const
+    {
+        return value;
+    }
+};
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * SOD model - binary cache of the weather coefficients
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "WeatherCache.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using std::string;
+
+static_assert(sizeof(WeatherCacheHeader) == 64,
+              "Weather cache header must have 64 bytes");
+
+static const char weather_cache_magic[8] = {'S', 'O', 'D', 'W',
+                                            'T', 'H', 'R', '\0'};
+static const uint32_t weather_cache_version = 1;
+
+static size_t code_size(uint32_t code)
+{
+    if (code == WEATHER_UINT16)
+        return sizeof(uint16_t);
+    if (code == WEATHER_UINT8)
+        return sizeof(uint8_t);
+    return sizeof(float);
+}
+
+static double max_code(uint32_t code)
+{
+    if (code == WEATHER_UINT16)
+        return std::numeric_limits<uint16_t>::max();
+    return std::numeric_limits<uint8_t>::max();
+}
+
+WeatherCacheWriter::WeatherCacheWriter(const char *filename,
+                                       int width, int height,
+                                       int start_year, int start_month,
+                                       int start_day, WeatherCode code,
+                                       double min, double max)
+{
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, weather_cache_magic, sizeof(header.magic));
+    header.version = weather_cache_version;
+    header.width = width;
+    header.height = height;
+    header.weeks = 0;
+    header.start_year = start_year;
+    header.start_month = start_month;
+    header.start_day = start_day;
+    header.days_per_step = 7;
+    header.code = code;
+    header.scale = 1;
+    header.offset = 0;
+    if (code != WEATHER_FLOAT32) {
+        header.offset = min;
+        if (max > min)
+            header.scale = (max - min) / max_code(code);
+        if (code == WEATHER_UINT16)
+            codes16.resize(size_t(width) * height);
+        else
+            codes8.resize(size_t(width) * height);
+    }
+    file = std::fopen(filename, "wb");
+    if (!file)
+        throw std::runtime_error(string("Cannot create weather cache ")
+                                 + filename);
+    // the number of weeks is updated when closing
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1)
+        throw std::runtime_error(string("Cannot write weather cache ")
+                                 + filename);
+}
+
+WeatherCacheWriter::~WeatherCacheWriter()
+{
+    if (file)
+        std::fclose(file);
+}
+
+void WeatherCacheWriter::add_week(const float *values)
+{
+    size_t cells = size_t(header.width) * header.height;
+    const void *data = values;
+    if (header.code != WEATHER_FLOAT32) {
+        double max = max_code(header.code);
+        for (size_t i = 0; i < cells; i++) {
+            double code = std::round((values[i] - header.offset)
+                                     / header.scale);
+            code = std::min(std::max(code, 0.), max);
+            if (header.code == WEATHER_UINT16)
+                codes16[i] = code;
+            else
+                codes8[i] = code;
+        }
+        if (header.code == WEATHER_UINT16)
+            data = codes16.data();
+        else
+            data = codes8.data();
+    }
+    size_t size = code_size(header.code);
+    if (std::fwrite(data, size, cells, file) != cells)
+        throw std::runtime_error("Writing weather cache failed");
+    ++header.weeks;
+}
+
+void WeatherCacheWriter::close()
+{
+    if (std::fseek(file, 0, SEEK_SET)
+            || std::fwrite(&header, sizeof(header), 1, file) != 1
+            || std::fclose(file))
+        throw std::runtime_error("Writing weather cache failed");
+    file = nullptr;
+}
+
+WeatherCache::WeatherCache(const char *filename)
+    : mapping(MAP_FAILED), length(0), values(nullptr), week_bytes(0)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error(string("Cannot open weather cache ")
+                                 + filename);
+    struct stat info;
+    if (fstat(fd, &info) || size_t(info.st_size) < sizeof(header)) {
+        ::close(fd);
+        throw std::runtime_error(string("Not a weather cache: ") + filename);
+    }
+    length = info.st_size;
+    mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the file is closed
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error(string("Cannot map weather cache ")
+                                 + filename);
+    std::memcpy(&header, mapping, sizeof(header));
+    week_bytes = size_t(header.width) * header.height
+            * code_size(header.code);
+    if (std::memcmp(header.magic, weather_cache_magic, sizeof(header.magic))
+            || header.version != weather_cache_version
+            || header.days_per_step != 7
+            || header.code > WEATHER_UINT8
+            || length != sizeof(header) + header.weeks * week_bytes) {
+        munmap(mapping, length);
+        throw std::runtime_error(string("Invalid weather cache ") + filename);
+    }
+    values = static_cast<const char *>(mapping) + sizeof(header);
+}
+
+WeatherCache::~WeatherCache()
+{
+    if (mapping != MAP_FAILED)
+        munmap(mapping, length);
+}
+
+WeatherFormat WeatherCache::format() const
+{
+    WeatherFormat format;
+    format.spatial = true;
+    format.code = WeatherCode(header.code);
+    format.scale = header.scale;
+    format.offset = header.offset;
+    return format;
+}
+
+const void *WeatherCache::week(unsigned week) const
+{
+    if (week >= header.weeks)
+        throw std::out_of_range("Week " + std::to_string(week)
+                                + " is not in the weather cache with "
+                                + std::to_string(header.weeks) + " weeks");
+    return values + week * week_bytes;
+}
+
+void WeatherCache::prefetch(unsigned first_week, unsigned count) const
+{
+    if (first_week >= header.weeks)
+        return;
+    if (count > header.weeks - first_week)
+        count = header.weeks - first_week;
+    // madvise needs a start aligned to a page
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = sizeof(header) + first_week * week_bytes;
+    size_t end = start + count * week_bytes;
+    start -= start % page;
+    madvise(static_cast<char *>(mapping) + start, end - start,
+            MADV_WILLNEED);
+}
@@ -0,0 +1,143 @@
+/*
+ * SOD model - binary cache of the weather coefficients
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef WEATHERCACHE_H
+#define WEATHERCACHE_H
+
+#include "Weather.h"
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+/* Header of the weather cache file
+ *
+ * The header is followed by the weather coefficients (already
+ * multiplied moisture and temperature coefficients) as 32-bit floats
+ * or as 16-bit or 8-bit codes (offset + scale * code), one week after
+ * another, each week row by row. The grid can be coarser than the
+ * computational region, but it has the same extent. The time axis starts
+ * at the given date and has a step of one week. The header size is
+ * kept at 64 bytes, so the weeks are aligned for reading in place.
+ */
+struct WeatherCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t weeks;
+    int32_t start_year;
+    int32_t start_month;
+    int32_t start_day;
+    uint32_t days_per_step;
+    // WeatherCode
+    uint32_t code;
+    char reserved[4];
+    double scale;
+    double offset;
+};
+
+/* Writes the weather cache week by week
+ *
+ * The number of weeks is written to the header when the file is
+ * closed, so the conversion does not need to know it in advance.
+ * Values are quantized using the given range when the code is
+ * an integer type, values outside of the range are clamped.
+ */
+class WeatherCacheWriter
+{
+private:
+    std::FILE *file;
+    WeatherCacheHeader header;
+    std::vector<uint16_t> codes16;
+    std::vector<uint8_t> codes8;
+public:
+    WeatherCacheWriter(const char *filename, int width, int height,
+                       int start_year, int start_month, int start_day,
+                       WeatherCode code = WEATHER_FLOAT32,
+                       double min = 0, double max = 1);
+    ~WeatherCacheWriter();
+    WeatherCacheWriter(const WeatherCacheWriter&) = delete;
+    WeatherCacheWriter& operator=(const WeatherCacheWriter&) = delete;
+    // add coefficients of the next week for all cells
+    void add_week(const float *values);
+    // finish the header and close the file
+    void close();
+};
+
+/* Weather cache mapped into memory
+ *
+ * Weeks are read by the operating system when they are first accessed,
+ * so opening the cache is fast regardless of the number of weeks and
+ * the values are used directly from the mapped file without a copy.
+ */
+class WeatherCache
+{
+private:
+    void *mapping;
+    size_t length;
+    WeatherCacheHeader header;
+    const char *values;
+    size_t week_bytes;
+public:
+    explicit WeatherCache(const char *filename);
+    ~WeatherCache();
+    WeatherCache(const WeatherCache&) = delete;
+    WeatherCache& operator=(const WeatherCache&) = delete;
+
+    int getWidth() const
+    {
+        return header.width;
+    }
+
+    int getHeight() const
+    {
+        return header.height;
+    }
+
+    unsigned weeks() const
+    {
+        return header.weeks;
+    }
+
+    // how the values are stored (without the index)
+    WeatherFormat format() const;
+
+    int start_year() const
+    {
+        return header.start_year;
+    }
+
+    int start_month() const
+    {
+        return header.start_month;
+    }
+
+    int start_day() const
+    {
+        return header.start_day;
+    }
+
+    // coefficients (or codes) of all cells for a week since the start
+    const void *week(unsigned week) const;
+    // hint that the given weeks will be needed soon
+    void prefetch(unsigned first_week, unsigned count) const;
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * SOD model - reading of weather in a background thread
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#include "WeatherReader.h"
+#include "Tasks.h"
+
+#include <stdexcept>
+
+WeatherReader::WeatherReader(ReadWeek read_week, size_t week_size,
+                             unsigned max_weeks)
+    :
+      read_week(read_week),
+      week_size(week_size),
+      max_weeks(max_weeks),
+      front(0),
+      pending(false),
+      done(false),
+      stop(false),
+      wait_time(0)
+{
+    buffers[0].resize(week_size * max_weeks);
+    buffers[1].resize(week_size * max_weeks);
+    thread = std::thread(&WeatherReader::run, this);
+}
+
+WeatherReader::~WeatherReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
+
+void WeatherReader::request(const std::vector<unsigned>& weeks)
+{
+    if (weeks.size() > max_weeks)
+        throw std::invalid_argument("WeatherReader: Too many weeks requested");
+    std::unique_lock<std::mutex> lock(mutex);
+    // the buffer for reading is free only when the previous reading is done
+    changed.wait(lock, [this]{ return !pending || done; });
+    requested = weeks;
+    pending = true;
+    done = false;
+    error = nullptr;
+    lock.unlock();
+    changed.notify_all();
+}
+
+const float *WeatherReader::get(const std::vector<unsigned>& weeks)
+{
+    double start = wall_time();
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!pending || requested != weeks) {
+        lock.unlock();
+        request(weeks);
+        lock.lock();
+    }
+    changed.wait(lock, [this]{ return done; });
+    pending = false;
+    wait_time += wall_time() - start;
+    if (error)
+        std::rethrow_exception(error);
+    front = 1 - front;
+    return buffers[front].data();
+}
+
+void WeatherReader::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this]{ return stop || (pending && !done); });
+        if (stop)
+            return;
+        // the weeks and the buffer are not changed until done is set
+        std::vector<unsigned> weeks = requested;
+        float *values = buffers[1 - front].data();
+        lock.unlock();
+        std::exception_ptr read_error;
+        try {
+            for (size_t i = 0; i < weeks.size(); i++)
+                read_week(weeks[i], values + i * week_size);
+        }
+        catch (...) {
+            read_error = std::current_exception();
+        }
+        lock.lock();
+        error = read_error;
+        done = true;
+        changed.notify_all();
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * SOD model - reading of weather in a background thread
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+
+#ifndef WEATHERREADER_H
+#define WEATHERREADER_H
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Reads chunks of weeks in a thread while the previous chunk is used
+ *
+ * There are two buffers. The one returned by get() is used by the
+ * simulation while the reader thread fills the other one with the weeks
+ * given to request(). The next get() waits for the reading to finish
+ * and swaps the buffers.
+ *
+ * The read function is called only from the reader thread, so it can
+ * use a library which is not thread-safe (such as NetCDF) as long as
+ * nothing else uses it at the same time.
+ */
+class WeatherReader
+{
+public:
+    // reads one week into values (size of the week)
+    typedef std::function<void(unsigned week, float *values)> ReadWeek;
+
+    WeatherReader(ReadWeek read_week, size_t week_size, unsigned max_weeks);
+    ~WeatherReader();
+    WeatherReader(const WeatherReader&) = delete;
+    WeatherReader& operator=(const WeatherReader&) = delete;
+
+    // start reading the weeks into the free buffer
+    void request(const std::vector<unsigned>& weeks);
+    // weather of the weeks (one after another), waits for the reading
+    // and requests the weeks first if they were not requested,
+    // the result is valid until the next call
+    const float *get(const std::vector<unsigned>& weeks);
+    // time spent in get() waiting for the reader (in seconds)
+    double waited() const
+    {
+        return wait_time;
+    }
+
+private:
+    ReadWeek read_week;
+    size_t week_size;
+    unsigned max_weeks;
+    std::vector<float> buffers[2];
+    // buffer used by the simulation, the other is for reading
+    unsigned front;
+    std::vector<unsigned> requested;
+    bool pending;
+    bool done;
+    bool stop;
+    std::exception_ptr error;
+    double wait_time;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+
+    void run();
+};
+
+#endif
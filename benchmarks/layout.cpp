@@ -0,0 +1,252 @@
+/*
+ * SOD model - benchmark of the host state layouts
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/* Compares the separate rasters and the interleaved records (-i flag)
+ * on the same simulation. The landscape from the layers directory can be
+ * repeated to get a state which does not fit into the cache. The cache
+ * misses are counted using the Linux performance counters when they are
+ * available.
+ *
+ * Usage: layout-benchmark [layers_dir [weeks [repeat]]]
+ */
+
+#include "Img.h"
+#include "HostState.h"
+#include "Dispersal.h"
+#include "Weather.h"
+#include "Spore.h"
+#include "Tasks.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+using std::string;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+enum CacheEvent
+{
+    L1D_READ_MISSES, LLC_MISSES
+};
+
+/* Hardware event counter, reads -1 when not available */
+class EventCounter
+{
+private:
+    int fd;
+public:
+    explicit EventCounter(CacheEvent event)
+        : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        if (event == L1D_READ_MISSES) {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D
+                    | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        else {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        }
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        (void) event;
+#endif
+    }
+    ~EventCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    long long stop()
+    {
+        long long count = -1;
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = -1;
+        }
+#endif
+        return count;
+    }
+};
+
+static Img read_layer(const string& dir, const string& name)
+{
+    string path = dir + "/" + name;
+    if (!std::ifstream(path)) {
+        cerr << "Cannot open the layer " << path << endl;
+        exit(EXIT_FAILURE);
+    }
+    return Img(path.c_str());
+}
+
+// landscape repeated the given number of times in both directions
+static Img repeat_image(const Img& image, int times)
+{
+    int width = image.getWidth();
+    int height = image.getHeight();
+    Img out(width * times, height * times,
+            image.getWEResolution(), image.getNSResolution());
+    for (int i = 0; i < out.getHeight(); i++)
+        for (int j = 0; j < out.getWidth(); j++)
+            out(i, j) = image(i % height, j % width);
+    return out;
+}
+
+/* Time and cache misses summed over the measured parts */
+class Measurement
+{
+private:
+    EventCounter l1;
+    EventCounter llc;
+    double time;
+    long long l1_misses;
+    long long llc_misses;
+public:
+    Measurement()
+        :
+          l1(L1D_READ_MISSES),
+          llc(LLC_MISSES),
+          time(0), l1_misses(0), llc_misses(0)
+    {}
+    void start()
+    {
+        l1.start();
+        llc.start();
+        time -= wall_time();
+    }
+    void stop()
+    {
+        time += wall_time();
+        long long count = l1.stop();
+        l1_misses = count < 0 ? -1 : l1_misses + count;
+        count = llc.stop();
+        llc_misses = count < 0 ? -1 : llc_misses + count;
+    }
+    void print(const string& layout, long long infected) const
+    {
+        cout << layout << "\t" << time << "\t" << l1_misses
+             << "\t" << llc_misses << "\t" << infected << endl;
+    }
+};
+
+template<typename Raster>
+static long long total(const Raster& image)
+{
+    long long sum = 0;
+    for (int i = 0; i < image.getHeight(); i++)
+        for (int j = 0; j < image.getWidth(); j++)
+            sum += image(i, j);
+    return sum;
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = argc > 1 ? argv[1] : "layers";
+    int weeks = argc > 2 ? std::atoi(argv[2]) : 52;
+    int times = argc > 3 ? std::atoi(argv[3]) : 4;
+
+    Img umca = repeat_image(read_layer(dir, "UMCA_den_100m.img"), times);
+    Img oaks = repeat_image(read_layer(dir, "OAKS_den_100m.img"), times);
+    Img lvtree = repeat_image(read_layer(dir, "TPH_den_100m.img"), times);
+    Img I_oaks = repeat_image(read_layer(dir, "init_2000_cnt.img"), times);
+
+    // the same initial infection as in the module
+    Img I_umca(umca.getWidth(), umca.getHeight(),
+               umca.getWEResolution(), umca.getNSResolution(), 0);
+    for (int i = 0; i < umca.getHeight(); i++)
+        for (int j = 0; j < umca.getWidth(); j++)
+            if (I_oaks(i, j) > 0)
+                I_umca(i, j) = std::min(umca(i, j), 2 * I_oaks(i, j));
+    Img S_umca = umca - I_umca;
+    Img S_oaks = oaks - I_oaks;
+
+    DistributionDispersal<CAUCHY, true> dispersal(
+                20.57, 0, 0, 2, NE, lvtree.getWEResolution(),
+                lvtree.getNSResolution());
+    ConstantWeather weather(WeatherFormat(), nullptr, 1);
+    const double spore_rate = 4.4;
+    const unsigned seed = 42;
+
+    cerr << "Landscape " << lvtree.getWidth() << "x" << lvtree.getHeight()
+         << ", " << weeks << " weeks" << endl;
+    cout << "layout\ttime_s\tl1d_read_misses\tllc_misses\tinfected_umca"
+         << endl;
+
+    // only the dispersal is measured, spore generation does not
+    // depend on the layout
+    {
+        Img S_umca_run(S_umca);
+        Img S_oaks_run(S_oaks);
+        Img I_umca_run(I_umca);
+        Img I_oaks_run(I_oaks);
+        Sporulation sporulation(seed, lvtree);
+        Measurement measurement;
+        for (int week = 0; week < weeks; week++) {
+            sporulation.SporeGen(I_umca_run, weather, spore_rate);
+            measurement.start();
+            sporulation.SporeSpreadDisp(S_umca_run, S_oaks_run, I_umca_run,
+                                        I_oaks_run, lvtree, dispersal,
+                                        weather);
+            measurement.stop();
+        }
+        measurement.print("rasters", total(I_umca_run));
+    }
+    {
+        HostState<int> state(S_umca, S_oaks, I_umca, I_oaks, lvtree);
+        Sporulation sporulation(seed, lvtree);
+        Measurement measurement;
+        for (int week = 0; week < weeks; week++) {
+            sporulation.SporeGen(state, weather, spore_rate);
+            measurement.start();
+            sporulation.SporeSpreadDisp(state, dispersal, weather);
+            measurement.stop();
+        }
+        measurement.print("interleaved", total(state.I_umca()));
+    }
+    return 0;
+}
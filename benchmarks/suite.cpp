@@ -0,0 +1,819 @@
+/*
+ * SOD model - benchmark suite of the simulation parts
+ *
+ * Copyright (C) 2015-2017 by the authors.
+ *
+ * Authors: Zexi Chen (zchen22 ncsu edu)
+ *          Vaclav Petras (wenzeslaus gmail com)
+ *
+ * The code contained herein is licensed under the GNU General Public
+ * License. You may obtain a copy of the GNU General Public License
+ * Version 2 or later at the following locations:
+ *
+ * http://www.opensource.org/licenses/gpl-license.html
+ * http://www.gnu.org/copyleft/gpl.html
+ */
+
+/* Microbenchmarks of the spore generation and dispersal on synthetic
+ * landscapes of several sizes and infection densities, of the raster
+ * operators and sums with each supported instruction set, the von Mises
+ * distribution, the random number engines and their samplers and
+ * the weather input,
+ * repeated simulations with different parameters (as in calibration),
+ * and an end-to-end scenario with the landscape from the layers
+ * directory.
+ *
+ * Each case is repeated until it took at least the minimal time
+ * (and at least three times) after one repetition to warm up. The
+ * results are written as JSON to the standard output, so they can be
+ * compared between versions, progress is written to the standard error.
+ *
+ * Usage: sod-benchmark [layers_dir [filter]] > results.json
+ *
+ * Only the cases with names containing the filter are run, e.g.
+ * spore_spread/size=512 or end_to_end.
+ */
+
+#include "Img.h"
+#include "Dispersal.h"
+#include "Weather.h"
+#include "WeatherCache.h"
+#include "NetcdfWeather.h"
+#include "Spore.h"
+#include "Samplers.h"
+#include "Simulation.h"
+#include "Simd.h"
+#include "Statistics.h"
+#include "Tasks.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::string;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+// results of the benchmarked code are added here,
+// so the compiler cannot remove the code
+static volatile double sink;
+
+/* Parameters of a benchmark case as JSON values */
+class Parameters
+{
+private:
+    std::vector<std::pair<string, string>> values;
+public:
+    Parameters& add(const string& key, const string& value)
+    {
+        values.emplace_back(key, "\"" + value + "\"");
+        return *this;
+    }
+    Parameters& add(const string& key, const char *value)
+    {
+        return add(key, string(value));
+    }
+    Parameters& add(const string& key, bool value)
+    {
+        values.emplace_back(key, value ? "true" : "false");
+        return *this;
+    }
+    Parameters& add(const string& key, double value)
+    {
+        std::ostringstream text;
+        text << value;
+        values.emplace_back(key, text.str());
+        return *this;
+    }
+    Parameters& add(const string& key, int value)
+    {
+        values.emplace_back(key, std::to_string(value));
+        return *this;
+    }
+    // name of the case with the parameters, e.g. group/size=512
+    string name(const string& group) const
+    {
+        string text = group;
+        for (const auto& value : values) {
+            string plain = value.second;
+            plain.erase(std::remove(plain.begin(), plain.end(), '"'),
+                        plain.end());
+            text += "/" + value.first + "=" + plain;
+        }
+        return text;
+    }
+    string json() const
+    {
+        string text = "{";
+        for (size_t i = 0; i < values.size(); i++) {
+            if (i)
+                text += ", ";
+            text += "\"" + values[i].first + "\": " + values[i].second;
+        }
+        return text + "}";
+    }
+};
+
+/* Runs the cases and collects their times */
+class Suite
+{
+private:
+    struct Result
+    {
+        string group;
+        string name;
+        Parameters parameters;
+        // items processed by one repetition (e.g. cells), can be zero
+        double items;
+        std::vector<double> times;
+    };
+    string filter;
+    double min_time;
+    std::vector<Result> results;
+
+    static double median(std::vector<double> times)
+    {
+        std::sort(times.begin(), times.end());
+        size_t middle = times.size() / 2;
+        if (times.size() % 2)
+            return times[middle];
+        return (times[middle - 1] + times[middle]) / 2;
+    }
+
+public:
+    Suite(const string& filter, double min_time)
+        : filter(filter), min_time(min_time)
+    {}
+
+    bool enabled(const string& name) const
+    {
+        return filter.empty() || name.find(filter) != string::npos;
+    }
+
+    // setup is called before each repetition and is not measured
+    template<typename Setup, typename Body>
+    void run(const string& group, const Parameters& parameters,
+             double items, Setup setup, Body body)
+    {
+        string name = parameters.name(group);
+        if (!enabled(name))
+            return;
+        Result result{group, name, parameters, items, {}};
+        setup();
+        body();
+        double total = 0;
+        while (result.times.size() < 3
+               || (total < min_time && result.times.size() < 1000)) {
+            setup();
+            double start = wall_time();
+            body();
+            double time = wall_time() - start;
+            result.times.push_back(time);
+            total += time;
+        }
+        cerr << name << ": " << median(result.times) << " s" << endl;
+        results.push_back(std::move(result));
+    }
+
+    template<typename Body>
+    void run(const string& group, const Parameters& parameters,
+             double items, Body body)
+    {
+        run(group, parameters, items, []{}, body);
+    }
+
+    void print(std::ostream& stream, const string& layers) const
+    {
+        char date[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S",
+                      std::localtime(&now));
+        unsigned threads = 1;
+#ifdef _OPENMP
+        threads = omp_get_max_threads();
+#endif
+        stream << "{\n  \"context\": {\"date\": \"" << date
+               << "\", \"threads\": " << threads
+               << ", \"compiler\": \"" << __VERSION__
+               << "\", \"simd\": \"" << simd_name(simd_supported())
+               << "\", \"layers\": \"" << layers
+               << "\", \"min_time_s\": " << min_time << "},\n"
+               << "  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& result = results[i];
+            double time = median(result.times);
+            stream << (i ? ",\n" : "\n")
+                   << "    {\"name\": \"" << result.name
+                   << "\", \"group\": \"" << result.group
+                   << "\", \"parameters\": " << result.parameters.json()
+                   << ", \"repetitions\": " << result.times.size()
+                   << ", \"median_s\": " << time
+                   << ", \"min_s\": "
+                   << *std::min_element(result.times.begin(),
+                                        result.times.end());
+            if (result.items)
+                stream << ", \"items_per_s\": " << result.items / time;
+            stream << "}";
+        }
+        stream << "\n  ]\n}" << endl;
+    }
+};
+
+/* Hosts and infection of a landscape, all trees are counts per cell */
+struct Landscape
+{
+    Img S_umca;
+    Img S_oaks;
+    Img I_umca;
+    Img I_oaks;
+    Img lvtree;
+    std::vector<float> weather;
+};
+
+// landscape where 70% of cells have trees and the given part
+// of the cells with bay laurel is infected
+static Landscape synthetic_landscape(int size, double density)
+{
+    std::mt19937 generator(size);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    Landscape landscape;
+    Img empty(size, size, 100, 100, 0);
+    landscape.S_umca = empty;
+    landscape.S_oaks = empty;
+    landscape.I_umca = empty;
+    landscape.I_oaks = empty;
+    landscape.lvtree = empty;
+    landscape.weather.resize(size_t(size) * size);
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            landscape.weather[i * size + j] = uniform(generator);
+            if (uniform(generator) >= 0.7)
+                continue;
+            int umca = generator() % 20;
+            int oaks = generator() % 10;
+            int infected = 0;
+            if (umca && uniform(generator) < density)
+                infected = 1 + generator() % umca;
+            landscape.S_umca(i, j) = umca - infected;
+            landscape.I_umca(i, j) = infected;
+            landscape.S_oaks(i, j) = oaks;
+            landscape.lvtree(i, j) = umca + oaks + generator() % 30;
+        }
+    }
+    return landscape;
+}
+
+static const double spore_rate = 4.4;
+static const unsigned seed = 42;
+
+// the fast engines draw one number for all trees of a cell
+template<typename Weather>
+static void spore_gen(Suite& suite, const Landscape& landscape,
+                      const Weather& weather, Parameters parameters)
+{
+    const Img& lvtree = landscape.lvtree;
+    for (RandomEngine engine : {ENGINE_STD, ENGINE_XOSHIRO}) {
+        std::unique_ptr<Sporulation> sporulation;
+        auto setup = [&]{
+            sporulation.reset(new Sporulation(seed, lvtree));
+            sporulation->set_engine(engine);
+        };
+        suite.run("spore_gen", Parameters(parameters)
+                  .add("engine", engine == ENGINE_STD ? "std" : "xoshiro"),
+                  double(lvtree.getWidth()) * lvtree.getHeight(), setup,
+                  [&]{ sporulation->SporeGen(landscape.I_umca, weather,
+                                             spore_rate); });
+    }
+}
+
+// the spores are generated before each repetition,
+// only the dispersal is measured
+template<Rtype rtype, bool wind, typename Weather>
+static void spore_spread(Suite& suite, const Landscape& landscape,
+                         const Weather& weather, Parameters parameters)
+{
+    const Img& lvtree = landscape.lvtree;
+    DistributionDispersal<rtype, wind> dispersal(
+                20.57, 60.0, 0.9, 2, NE, lvtree.getWEResolution(),
+                lvtree.getNSResolution());
+    std::unique_ptr<Sporulation> sporulation;
+    Img S_umca, S_oaks, I_umca, I_oaks;
+    auto setup = [&]{
+        S_umca = landscape.S_umca;
+        S_oaks = landscape.S_oaks;
+        I_umca = landscape.I_umca;
+        I_oaks = landscape.I_oaks;
+        sporulation.reset(new Sporulation(seed, lvtree));
+        sporulation->SporeGen(I_umca, weather, spore_rate);
+    };
+    parameters.add("rtype", rtype == CAUCHY ? "cauchy" : "cauchy_mix")
+            .add("wind", wind);
+    suite.run("spore_spread", parameters, 0, setup, [&]{
+        sporulation->SporeSpreadDisp(S_umca, S_oaks, I_umca, I_oaks,
+                                     lvtree, dispersal, weather);
+    });
+}
+
+// the kernel table used for each spore or for all spores of a cell
+template<typename Dispersal, typename Weather>
+static void table_spread(Suite& suite, const Landscape& landscape,
+                         const Weather& weather, const Dispersal& dispersal,
+                         double rate, Parameters parameters)
+{
+    const Img& lvtree = landscape.lvtree;
+    std::unique_ptr<Sporulation> sporulation;
+    Img S_umca, S_oaks, I_umca, I_oaks;
+    auto setup = [&]{
+        S_umca = landscape.S_umca;
+        S_oaks = landscape.S_oaks;
+        I_umca = landscape.I_umca;
+        I_oaks = landscape.I_oaks;
+        sporulation.reset(new Sporulation(seed, lvtree));
+        sporulation->SporeGen(I_umca, weather, rate);
+    };
+    parameters.add("spore_rate", rate);
+    suite.run("spore_spread", parameters, 0, setup, [&]{
+        sporulation->SporeSpreadDisp(S_umca, S_oaks, I_umca, I_oaks,
+                                     lvtree, dispersal, weather);
+    });
+}
+
+template<typename Weather>
+static void spread_kernels(Suite& suite, const Landscape& landscape,
+                           const Weather& weather,
+                           const Parameters& parameters)
+{
+    spore_spread<CAUCHY, false>(suite, landscape, weather, parameters);
+    spore_spread<CAUCHY, true>(suite, landscape, weather, parameters);
+    spore_spread<CAUCHY_MIX, false>(suite, landscape, weather, parameters);
+    spore_spread<CAUCHY_MIX, true>(suite, landscape, weather, parameters);
+}
+
+static void sporulation_benchmarks(Suite& suite)
+{
+    ConstantWeather constant(WeatherFormat(), nullptr, 1);
+    WeatherFormat format;
+    format.spatial = true;
+    // sizes and densities with the default kernel and constant weather
+    for (int size : {128, 512, 2048}) {
+        for (double density : {0.001, 0.01, 0.1}) {
+            Parameters parameters;
+            parameters.add("size", size).add("density", density);
+            if (!suite.enabled(parameters.name("spore_gen"))
+                    && !suite.enabled(parameters.name("spore_spread")))
+                continue;
+            Landscape landscape = synthetic_landscape(size, density);
+            SpatialWeather spatial(format, landscape.weather.data(), 0);
+            spore_gen(suite, landscape, constant, Parameters(parameters)
+                      .add("weather", "constant"));
+            spore_gen(suite, landscape, spatial, Parameters(parameters)
+                      .add("weather", "spatial"));
+            spore_spread<CAUCHY, true>(suite, landscape, constant,
+                                       Parameters(parameters)
+                                       .add("weather", "constant"));
+        }
+    }
+    // all kernels on one landscape
+    const int size = 512;
+    const double density = 0.01;
+    Landscape landscape = synthetic_landscape(size, density);
+    SpatialWeather spatial(format, landscape.weather.data(), 0);
+    Parameters parameters;
+    parameters.add("size", size).add("density", density);
+    spread_kernels(suite, landscape, constant, Parameters(parameters)
+                   .add("weather", "constant"));
+    spread_kernels(suite, landscape, spatial, Parameters(parameters)
+                   .add("weather", "spatial"));
+    // table and binned dispersal with more spores per cell
+    auto table = std::make_shared<const DispersalTable>(
+                CAUCHY, 20.57, 0, 0, 2, NE, landscape.lvtree.getWEResolution(),
+                landscape.lvtree.getNSResolution(), 5);
+    BinnedDispersal binned(table);
+    for (double rate : {spore_rate, 10 * spore_rate, 100 * spore_rate}) {
+        table_spread(suite, landscape, spatial, *table, rate,
+                     Parameters(parameters).add("dispersal", "table"));
+        table_spread(suite, landscape, spatial, binned, rate,
+                     Parameters(parameters).add("dispersal", "binned"));
+    }
+}
+
+static void von_mises_benchmarks(Suite& suite)
+{
+    const int samples = 1000000;
+    for (double kappa : {0.0, 2.0, 10.0}) {
+        std::mt19937 generator(seed);
+        suite.run("von_mises", Parameters().add("kappa", kappa), samples,
+                  [&]{
+            von_mises_distribution distribution(NE * PI / 180, kappa);
+            double sum = 0;
+            for (int i = 0; i < samples; i++)
+                sum += distribution(generator);
+            sink = sink + sum;
+        });
+    }
+}
+
+// raw numbers of an engine and the samplers used with it
+// (the standard distributions for the standard engine)
+template<typename Generator>
+static void engine_benchmarks(Suite& suite, const string& engine)
+{
+    typedef Samplers<Generator> Sampling;
+    const int samples = 1000000;
+    Generator generator(seed);
+    Parameters parameters;
+    parameters.add("engine", engine);
+    suite.run("random_numbers", parameters, samples, [&]{
+        uint64_t sum = 0;
+        for (int i = 0; i < samples; i++)
+            sum += generator();
+        sink = sink + sum;
+    });
+    suite.run("poisson", Parameters(parameters).add("mean", spore_rate),
+              samples, [&]{
+        typename Sampling::Poisson distribution(spore_rate);
+        double sum = 0;
+        for (int i = 0; i < samples; i++)
+            sum += distribution(generator);
+        sink = sink + sum;
+    });
+    suite.run("half_cauchy", parameters, samples, [&]{
+        typename Sampling::HalfCauchy distribution(20.57);
+        double sum = 0;
+        for (int i = 0; i < samples; i++)
+            sum += distribution(generator);
+        sink = sink + sum;
+    });
+}
+
+static void random_benchmarks(Suite& suite)
+{
+    engine_benchmarks<std::default_random_engine>(suite, "std");
+    engine_benchmarks<Xoshiro256pp>(suite, "xoshiro");
+    engine_benchmarks<Pcg64>(suite, "pcg");
+    engine_benchmarks<PhiloxEngine>(suite, "philox");
+    const int samples = 1000000;
+    for (double kappa : {2.0, 10.0}) {
+        Xoshiro256pp generator(seed);
+        VonMisesTable table(NE * PI / 180, kappa);
+        suite.run("von_mises", Parameters().add("kappa", kappa)
+                  .add("sampler", "table"), samples, [&]{
+            double sum = 0;
+            for (int i = 0; i < samples; i++)
+                sum += table(open_uniform(generator));
+            sink = sink + sum;
+        });
+    }
+}
+
+// instruction sets supported by the processor, the plain loops first
+static std::vector<SimdInstructions> simd_instructions()
+{
+    std::vector<SimdInstructions> instructions{SIMD_SCALAR};
+    SimdInstructions best = simd_supported();
+    if (best == SIMD_AVX512)
+        instructions.push_back(SIMD_AVX2);
+    if (best != SIMD_SCALAR)
+        instructions.push_back(best);
+    return instructions;
+}
+
+static void image_benchmarks(Suite& suite)
+{
+    for (int size : {512, 2048}) {
+        std::mt19937 generator(size);
+        Img a(size, size, 100, 100);
+        Img b(size, size, 100, 100);
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < size; j++) {
+                a(i, j) = generator() % 100;
+                // nonzero for the division
+                b(i, j) = 1 + generator() % 100;
+            }
+        }
+        // any_positive has to scan all of it
+        Img zeros(size, size, 100, 100, 0);
+        double cells = double(size) * size;
+        Img out;
+        RasterSums sums;
+        for (SimdInstructions instructions : simd_instructions()) {
+            simd_use(instructions);
+            auto parameters = [size, instructions](const char *operation) {
+                return Parameters().add("operation", operation)
+                        .add("size", size)
+                        .add("simd", simd_name(instructions));
+            };
+            suite.run("img", parameters("add"), cells,
+                      [&]{ out = a + b; });
+            suite.run("img", parameters("subtract"), cells,
+                      [&]{ out = a - b; });
+            suite.run("img", parameters("multiply"), cells,
+                      [&]{ out = a * b; });
+            suite.run("img", parameters("divide"), cells,
+                      [&]{ out = a / b; });
+            suite.run("img", parameters("scale"), cells,
+                      [&]{ out = a * 0.5; });
+            // several operations evaluated in one loop
+            suite.run("img", parameters("expression"), cells,
+                      [&]{ out = (a - b) * b + a; });
+            suite.run("img", parameters("add_assign"), cells,
+                      [&]{ out = a; out += b; }, [&]{ out += b; });
+            suite.run("img", parameters("sum"), cells,
+                      [&]{ sink = sink + a.sum(); });
+            suite.run("img", parameters("count_nonzero"), cells,
+                      [&]{ sink = sink + a.count_nonzero(); });
+            suite.run("img", parameters("any_positive"), cells,
+                      [&]{ sink = sink + zeros.any_positive(); });
+            // a run added to the sums over the runs of an ensemble
+            suite.run("img", parameters("accumulate"), cells,
+                      [&]{ sums.reset(size, size); }, [&]{ sums.add(a); });
+        }
+        simd_use(simd_supported());
+        if (out.getWidth())
+            sink = sink + out(0, 0);
+    }
+}
+
+// reading of weeks from the NetCDF weather in the layers
+static void netcdf_benchmarks(Suite& suite, const string& dir)
+{
+    if (!suite.enabled("get_spatial_weather"))
+        return;
+    string path = dir + "/weather/weatherCoeff_2000_2007.nc";
+    if (!std::ifstream(path)) {
+        cerr << "No NetCDF weather in " << path << endl;
+        return;
+    }
+    NcFile file(path.c_str(), NcFile::ReadOnly);
+    NcVar *mcf_nc = file.is_valid() ? file.get_var("Mcoef") : nullptr;
+    NcVar *ccf_nc = file.is_valid() ? file.get_var("Ccoef") : nullptr;
+    if (!mcf_nc || !ccf_nc)
+        return;
+    int weeks = mcf_nc->get_dim(0)->size();
+    int height = mcf_nc->get_dim(1)->size();
+    int width = mcf_nc->get_dim(2)->size();
+    std::vector<double> mcf(size_t(width) * height);
+    std::vector<double> ccf(size_t(width) * height);
+    std::vector<float> weather(size_t(width) * height);
+    int week = 0;
+    suite.run("get_spatial_weather",
+              Parameters().add("rows", height).add("cols", width),
+              double(width) * height, [&]{
+        get_spatial_weather(mcf_nc, ccf_nc, mcf.data(), ccf.data(),
+                            weather.data(), width, height, week);
+        week = (week + 1) % weeks;
+    });
+}
+
+// writing and reading of the weather cache with each type
+static void weather_cache_benchmarks(Suite& suite)
+{
+    const int size = 1024;
+    const int weeks = 52;
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::vector<float> values(size_t(size) * size);
+    for (auto& value : values)
+        value = uniform(generator);
+    string filename = "sod-benchmark-weather.bin";
+    const std::pair<WeatherCode, const char *> codes[] = {
+        {WEATHER_FLOAT32, "float32"}, {WEATHER_UINT16, "uint16"},
+        {WEATHER_UINT8, "uint8"}};
+    for (const auto& code : codes) {
+        Parameters parameters;
+        parameters.add("type", code.second).add("size", size);
+        double cells = double(size) * size * weeks;
+        suite.run("weather_cache_write", parameters, cells, [&]{
+            WeatherCacheWriter writer(filename.c_str(), size, size, 2000, 1,
+                                      1, code.first, 0, 1);
+            for (int week = 0; week < weeks; week++)
+                writer.add_week(values.data());
+            writer.close();
+        });
+        // every cell of each week through the weather used by the kernels
+        if (!suite.enabled(parameters.name("weather_cache_read")))
+            continue;
+        {
+            WeatherCacheWriter writer(filename.c_str(), size, size, 2000, 1,
+                                      1, code.first, 0, 1);
+            for (int week = 0; week < weeks; week++)
+                writer.add_week(values.data());
+            writer.close();
+        }
+        WeatherCache cache(filename.c_str());
+        WeatherFormat format = cache.format();
+        if (code.first != WEATHER_FLOAT32)
+            format.index = std::make_shared<std::vector<unsigned>>(
+                        weather_index(size, size, size, size));
+        suite.run("weather_cache_read", parameters, cells, [&]{
+            double sum = 0;
+            for (int week = 0; week < weeks; week++) {
+                const void *data = cache.week(week);
+                if (code.first == WEATHER_FLOAT32) {
+                    SpatialWeather weather(format, data, 0);
+                    for (int cell = 0; cell < size * size; cell++)
+                        sum += weather(cell);
+                }
+                else if (code.first == WEATHER_UINT16) {
+                    IndexedWeather<uint16_t> weather(format, data, 0);
+                    for (int cell = 0; cell < size * size; cell++)
+                        sum += weather(cell);
+                }
+                else {
+                    IndexedWeather<uint8_t> weather(format, data, 0);
+                    for (int cell = 0; cell < size * size; cell++)
+                        sum += weather(cell);
+                }
+            }
+            sink = sink + sum;
+        });
+    }
+    std::remove(filename.c_str());
+}
+
+// the first quarter of a year of an ensemble for each parameter sample,
+// the landscape is set up only once
+static void calibration_benchmarks(Suite& suite)
+{
+    if (!suite.enabled("calibration"))
+        return;
+    const int size = 128;
+    const unsigned runs = 4;
+    Landscape landscape = synthetic_landscape(size, 0.01);
+    // infected oaks where bay laurel is infected, so the simulation
+    // creates the infected bay laurel from them
+    Img umca = landscape.S_umca + landscape.I_umca;
+    Img oaks = landscape.S_oaks + landscape.I_umca;
+    SimulationSetup setup;
+    Simulation simulation(umca, oaks, landscape.lvtree, landscape.I_umca,
+                          setup);
+    SpreadParams params;
+    params.spore_rate = spore_rate;
+    params.rtype = CAUCHY;
+    params.scale1 = 20.57;
+    params.scale2 = 0;
+    params.kappa = 2;
+    params.gamma = 0;
+    params.wdir = NE;
+    params.kernel_radius = 0;
+    params.binned = false;
+    WeatherValues weather(1);
+    unsigned sample = 0;
+    Parameters parameters;
+    parameters.add("size", size).add("runs", int(runs));
+    suite.run("calibration", parameters, 0, [&]{
+        // samples of the spore rate around the default
+        params.spore_rate = spore_rate * (0.5 + 0.1 * (sample++ % 10));
+        EnsembleStatistics statistics = simulation.run(
+                    params, weather, seed, runs, Date(2000, 1, 1),
+                    Date(2000, 3, 31), true);
+        sink = sink + statistics.mean()(0, 0);
+    });
+}
+
+static Img read_layer(const string& dir, const string& name)
+{
+    string path = dir + "/" + name;
+    return Img(path.c_str());
+}
+
+// all runs of a year with the given weather for each week
+template<typename Weather>
+static void scenario(Suite& suite, const Landscape& landscape,
+                     const std::vector<Weather>& weeks, int runs,
+                     Parameters parameters)
+{
+    const Img& lvtree = landscape.lvtree;
+    DistributionDispersal<CAUCHY, true> dispersal(
+                20.57, 0, 0, 2, NE, lvtree.getWEResolution(),
+                lvtree.getNSResolution());
+    parameters.add("runs", runs).add("weeks", int(weeks.size()));
+    suite.run("end_to_end", parameters, 0, [&]{
+        long long infected = 0;
+        #pragma omp parallel for schedule(dynamic) reduction(+:infected)
+        for (int run = 0; run < runs; run++) {
+            Img S_umca(landscape.S_umca);
+            Img S_oaks(landscape.S_oaks);
+            Img I_umca(landscape.I_umca);
+            Img I_oaks(landscape.I_oaks);
+            Sporulation sporulation(seed + run, lvtree);
+            for (const auto& weather : weeks) {
+                sporulation.SporeGen(I_umca, weather, spore_rate);
+                sporulation.SporeSpreadDisp(S_umca, S_oaks, I_umca, I_oaks,
+                                            lvtree, dispersal, weather);
+            }
+            infected += I_oaks(0, 0);
+        }
+        sink = sink + infected;
+    });
+}
+
+// one year of the module with the landscape and weather from the layers
+static void end_to_end_benchmarks(Suite& suite, const string& dir)
+{
+    if (!suite.enabled("end_to_end"))
+        return;
+    // the other results are still written without the layers
+    for (const char *name : {"UMCA_den_100m.img", "OAKS_den_100m.img",
+                             "TPH_den_100m.img", "init_2000_cnt.img"}) {
+        if (!std::ifstream(dir + "/" + name)) {
+            cerr << "Cannot open the layer " << dir << "/" << name
+                 << ", skipping the end-to-end scenario" << endl;
+            return;
+        }
+    }
+    Landscape landscape;
+    Img umca = read_layer(dir, "UMCA_den_100m.img");
+    Img oaks = read_layer(dir, "OAKS_den_100m.img");
+    landscape.lvtree = read_layer(dir, "TPH_den_100m.img");
+    landscape.I_oaks = read_layer(dir, "init_2000_cnt.img");
+    // the same initial infection as in the module
+    landscape.I_umca = Img(umca.getWidth(), umca.getHeight(),
+                           umca.getWEResolution(), umca.getNSResolution(),
+                           0);
+    for (int i = 0; i < umca.getHeight(); i++)
+        for (int j = 0; j < umca.getWidth(); j++)
+            if (landscape.I_oaks(i, j) > 0)
+                landscape.I_umca(i, j) = std::min(umca(i, j),
+                                                  2 * landscape.I_oaks(i, j));
+    landscape.S_umca = umca - landscape.I_umca;
+    landscape.S_oaks = oaks - landscape.I_oaks;
+    int width = umca.getWidth();
+    int height = umca.getHeight();
+    const int runs = 4;
+    const unsigned weeks = 52;
+
+    string path = dir + "/weather/weatherCoeff_2000_2007.nc";
+    std::unique_ptr<NcFile> file;
+    if (std::ifstream(path))
+        file.reset(new NcFile(path.c_str(), NcFile::ReadOnly));
+    NcVar *mcf_nc = file && file->is_valid() ? file->get_var("Mcoef")
+                                             : nullptr;
+    NcVar *ccf_nc = file && file->is_valid() ? file->get_var("Ccoef")
+                                             : nullptr;
+    if (!mcf_nc || !ccf_nc) {
+        cerr << "No NetCDF weather in " << path
+             << ", using constant weather" << endl;
+        std::vector<ConstantWeather> constant(
+                    weeks, ConstantWeather(WeatherFormat(), nullptr, 1));
+        scenario(suite, landscape, constant, runs,
+                 Parameters().add("weather", "constant"));
+        return;
+    }
+    int weather_height = mcf_nc->get_dim(1)->size();
+    int weather_width = mcf_nc->get_dim(2)->size();
+    size_t cells = size_t(weather_width) * weather_height;
+    std::vector<double> mcf(cells);
+    std::vector<double> ccf(cells);
+    landscape.weather.resize(cells * weeks);
+    for (unsigned week = 0; week < weeks; week++)
+        get_spatial_weather(mcf_nc, ccf_nc, mcf.data(), ccf.data(),
+                            &landscape.weather[week * cells], weather_width,
+                            weather_height, week);
+    WeatherFormat format;
+    format.spatial = true;
+    if (weather_width == width && weather_height == height) {
+        std::vector<SpatialWeather> spatial;
+        for (unsigned week = 0; week < weeks; week++)
+            spatial.emplace_back(format, &landscape.weather[week * cells], 0);
+        scenario(suite, landscape, spatial, runs,
+                 Parameters().add("weather", "spatial"));
+    }
+    else {
+        format.index = std::make_shared<std::vector<unsigned>>(
+                    weather_index(width, height, weather_width,
+                                  weather_height));
+        std::vector<IndexedWeather<float>> coarse;
+        for (unsigned week = 0; week < weeks; week++)
+            coarse.emplace_back(format, &landscape.weather[week * cells], 0);
+        scenario(suite, landscape, coarse, runs,
+                 Parameters().add("weather", "coarse"));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    string dir = argc > 1 ? argv[1] : "layers";
+    string filter = argc > 2 ? argv[2] : "";
+
+    Suite suite(filter, 0.2);
+    sporulation_benchmarks(suite);
+    von_mises_benchmarks(suite);
+    random_benchmarks(suite);
+    image_benchmarks(suite);
+    netcdf_benchmarks(suite, dir);
+    weather_cache_benchmarks(suite);
+    calibration_benchmarks(suite);
+    end_to_end_benchmarks(suite, dir);
+    suite.print(cout, dir);
+    return 0;
+}
@@ -33,6 +33,7 @@ private:
 
 public:
     Date(const Date &d): year(d.year), month(d.month), day(d.day){}
+    Date& operator=(const Date &d) = default;
     Date(int y, int m, int d): year(y), month(m), day(d){}
     Date(): year(2000), month(1), day(1){}
     void increasedByWeek();
@@ -53,30 +54,30 @@ public:
     friend bool operator<= (const Date &d1, const Date &d2);
 };
 
-std::ostream& operator<<(std::ostream& os, const Date &d)
+inline std::ostream& operator<<(std::ostream& os, const Date &d)
 {
     os << d.year << '-' << d.month << '-' << d.day;
     return os;
 }
 
-Date Date::getYearEnd() {
+inline Date Date::getYearEnd() {
     return Date(year, 12, 31);
 }
 
-bool Date::isYearEnd(){
+inline bool Date::isYearEnd(){
     if (month == 12 && (day + 7) > 31)
         return true;
     return false;
 }
 
-Date Date::getNextYearEnd(){
+inline Date Date::getNextYearEnd(){
     if (month == 1)
         return Date(year, 12, 31);
     else
         return Date(year + 1, 12, 31);
 }
 
-bool operator> (const Date &d1, const Date &d2)
+inline bool operator> (const Date &d1, const Date &d2)
 {
     if(d1.year < d2.year)
         return false;
@@ -96,12 +97,12 @@ bool operator> (const Date &d1, const Date &d2)
     }
 }
 
-bool operator<= (const Date &d1, const Date &d2)
+inline bool operator<= (const Date &d1, const Date &d2)
 {
     return !(d1 > d2);
 }
 
-bool operator< (const Date &d1, const Date &d2)
+inline bool operator< (const Date &d1, const Date &d2)
 {
     if(d1.year > d2.year)
         return false;
@@ -121,12 +122,12 @@ bool operator< (const Date &d1, const Date &d2)
     }
 }
 
-bool operator>= (const Date &d1, const Date &d2)
+inline bool operator>= (const Date &d1, const Date &d2)
 {
     return !(d1 < d2);
 }
 
-void Date::increasedByWeek()
+inline void Date::increasedByWeek()
 {
     day += 7;
     if (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) {
@@ -151,7 +152,7 @@ void Date::increasedByWeek()
     }
 }
 
-int Date::weeksFromDate(Date start) {
+inline int Date::weeksFromDate(Date start) {
 
     int week = 0;
     while (start <= *this) {
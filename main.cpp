@@ -17,7 +17,21 @@
 
 #include "date.h"
 #include "Img.h"
-#include "Spore.h"
+#include "Dispersal.h"
+#include "Weather.h"
+#include "Simulation.h"
+#include "Statistics.h"
+#include "Summary.h"
+#include "WeatherCache.h"
+#include "WeatherReader.h"
+#include "RasterWriter.h"
+#include "GdalOutput.h"
+#include "Checkpoint.h"
+#include "BinaryIO.h"
+#include "Distributed.h"
+#include "NetcdfWeather.h"
+#include "Instrumentation.h"
+#include "Tasks.h"
 
 extern "C" {
 #include <grass/gis.h>
@@ -26,12 +40,17 @@ extern "C" {
 
 #include <netcdfcpp.h>
 
+#include <algorithm>
+#include <cctype>
 #include <map>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <limits>
+#include <stdint.h>
 
 using std::string;
 using std::cout;
@@ -41,39 +60,6 @@ using std::endl;
 
 #define DIM 1
 
-// Initialize infected trees for each species
-// needed unless empirical info is available
-static Img initialize(Img& img1,Img& img2) {
-    if (img1.getWidth() != img2.getWidth() ||
-            img2.getHeight() != img2.getHeight()) {
-        cerr << "The height or width of one image do not match with that of the other one!" << endl;
-        return Img();
-    }
-    else {
-        auto re_width = img1.getWidth();
-        auto re_height = img1.getHeight();
-        auto out = Img(re_width, re_height, img1.getWEResolution(), img1.getNSResolution());
-
-        for (int i = 0; i < re_height; i++) {
-            for (int j = 0; j < re_width; j++) {
-                if (img2(i, j) > 0) {
-                    if (img1(i, j) > img2(i, j))
-                        out(i, j) =
-                            img1(i, j) <
-                            (img2(i, j) *
-                             2) ? img1(i, j) : (img2(i, j) * 2);
-                    else
-                        out(i, j) = img1(i, j);
-                }
-                else {
-                    out(i, j) = 0;
-                }
-            }
-        }
-        return out;
-    }
-}
-
 string generate_name(const string& basename, const Date& date)
 {
     // counting on year being 4 digits
@@ -137,64 +123,211 @@ std::vector<double> weather_file_to_list(const string& filename)
     return output;
 }
 
-bool all_infected(Img& S_oaks_rast)
+// writes all weeks from the NetCDF file to the weather cache,
+// the range of values for the integer codes is found in the first pass
+void convert_weather(NcVar *mcf_nc, NcVar *ccf_nc, int width, int height,
+                     const Date& start, WeatherCode code,
+                     const char *filename)
 {
-    bool allInfected = true;
-    for (int j = 0; j < S_oaks_rast.getHeight(); j++) {
-        for (int k = 0; k < S_oaks_rast.getWidth(); k++) {
-            if (S_oaks_rast(j, k) > 0)
-                allInfected = false;
+    long weeks = std::min(mcf_nc->get_dim(0)->size(),
+                          ccf_nc->get_dim(0)->size());
+    std::vector<double> mcf(width * height);
+    std::vector<double> ccf(width * height);
+    std::vector<float> weather(width * height);
+    double min = 0;
+    double max = 1;
+    if (code != WEATHER_FLOAT32) {
+        min = std::numeric_limits<double>::max();
+        max = std::numeric_limits<double>::lowest();
+        for (long week = 0; week < weeks; week++) {
+            get_spatial_weather(mcf_nc, ccf_nc, mcf.data(), ccf.data(),
+                                weather.data(), width, height, week);
+            for (float value : weather) {
+                min = std::min<double>(min, value);
+                max = std::max<double>(max, value);
+            }
         }
     }
-    return allInfected;
+    WeatherCacheWriter writer(filename, width, height, start.getYear(),
+                              start.getMonth(), start.getDay(),
+                              code, min, max);
+    for (long week = 0; week < weeks; week++) {
+        get_spatial_weather(mcf_nc, ccf_nc, mcf.data(), ccf.data(),
+                            weather.data(), width, height, week);
+        writer.add_week(weather.data());
+    }
+    writer.close();
 }
 
-void get_spatial_weather(NcVar *mcf_nc, NcVar *ccf_nc, double* mcf, double* ccf, double* weather, int width, int height, int step)
+WeatherCode weather_code_from_string(const string& text)
 {
-    // read the weather information
-    if (!mcf_nc->set_cur(step, 0, 0)) {
-        cerr << "Can not read the coefficients from the mcf_nc pointer to mcf array " << step << endl;
-        exit(EXIT_FAILURE);
+    if (text == "float32")
+        return WEATHER_FLOAT32;
+    else if (text == "uint16")
+        return WEATHER_UINT16;
+    else if (text == "uint8")
+        return WEATHER_UINT8;
+    else
+        throw std::invalid_argument("weather_code_from_string: Invalid"
+                                    " value '" + text +"' provided");
+}
+
+// parameters which determine the results of the runs and which must be
+// the same to continue exactly from a checkpoint (the source of weather
+// is not compared, it can be the NetCDF file or the cache)
+string model_parameters(const std::vector<const Option *>& options)
+{
+    std::ostringstream text;
+    for (const Option *option : options)
+        text << option->key << "=" << (option->answer ? option->answer : "")
+             << "\n";
+    return text.str();
+}
+
+// the rasters are read at the same time by the root process
+// and sent to the others
+std::vector<Img> read_rasters(const std::vector<const char *>& names,
+                              unsigned threads, const Distributed& processes)
+{
+    if (processes.size() == 1)
+        return Img::fromGrassRasters(names, threads);
+    std::vector<Img> images;
+    if (processes.root())
+        images = Img::fromGrassRasters(names, threads);
+    else
+        images.resize(names.size());
+    for (Img& image : images) {
+        string data;
+        if (processes.root()) {
+            std::ostringstream stream;
+            write_value(stream, int32_t(image.getWEResolution()));
+            write_value(stream, int32_t(image.getNSResolution()));
+            image.write(stream);
+            data = stream.str();
+        }
+        processes.broadcast(data);
+        if (processes.root())
+            continue;
+        std::istringstream stream(data);
+        int32_t w_e_res, n_s_res, width, height;
+        read_value(stream, w_e_res);
+        read_value(stream, n_s_res);
+        read_value(stream, width);
+        read_value(stream, height);
+        // the image checks the size when it reads it again
+        stream.seekg(2 * sizeof(int32_t));
+        image = Img(width, height, w_e_res, n_s_res);
+        image.read(stream);
     }
-    if (!ccf_nc->set_cur(step, 0, 0)) {
-        cerr << "Can not read the coefficients from the ccf_nc pointer to ccf array "<< step << endl;
-        exit(EXIT_FAILURE);
+    return images;
+}
+
+// each process has its own checkpoint file for its runs
+string process_file(const char *name, const Distributed& processes)
+{
+    if (processes.size() == 1)
+        return name;
+    return string(name) + "." + std::to_string(processes.rank());
+}
+
+/* Weather read from NetCDF by the root process in a background thread
+ *
+ * All weeks of a year are read at once and sent to the other processes,
+ * so the runs of all processes wait for each other at the end of a year.
+ */
+class StreamedWeather : public WeatherInput
+{
+private:
+    WeatherFormat weather_format;
+    // only the root process has the reader
+    WeatherReader *reader;
+    size_t cells;
+    const Distributed& processes;
+    const float *weather;
+    // weather of a year received from the root
+    std::vector<float> received;
+public:
+    StreamedWeather(const WeatherFormat& format, WeatherReader *reader,
+                    size_t cells, const Distributed& processes)
+        :
+          weather_format(format), reader(reader), cells(cells),
+          processes(processes), weather(nullptr)
+    {}
+    const WeatherFormat& format() const
+    {
+        return weather_format;
     }
-    if (!mcf_nc->get(mcf, 1, height, width)) {
-        cerr << "Can not get the record from mcf_nc " << step << endl;
-        exit(EXIT_FAILURE);
+    bool yearly() const
+    {
+        return true;
     }
-    if (!ccf_nc->get(ccf, 1, height, width)) {
-        cerr << "Can not get the record from ccf_nc " << step << endl;
-        exit(EXIT_FAILURE);
+    void will_need(const std::vector<unsigned>& weeks)
+    {
+        if (reader)
+            reader->request(weeks);
     }
-    for (int j = 0; j < height; j++) {
-        for (int k = 0; k < width; k++) {
-            weather[j * width + k] = mcf[j * width + k] * ccf[j * width + k];
+    void prepare(const std::vector<unsigned>& weeks)
+    {
+        if (reader)
+            weather = reader->get(weeks);
+        if (processes.size() > 1) {
+            size_t count = weeks.size() * cells;
+            // root only sends its buffer
+            if (processes.root()) {
+                processes.broadcast(const_cast<float *>(weather), count);
+            }
+            else {
+                received.resize(count);
+                processes.broadcast(received.data(), count);
+                weather = received.data();
+            }
         }
     }
-}
+    const void *coefficients(size_t i) const
+    {
+        return weather + i * cells;
+    }
+    double value(size_t) const
+    {
+        return 0;
+    }
+};
 
 struct SodOptions
 {
     struct Option *umca, *oaks, *lvtree, *ioaks;
-    struct Option *nc_weather, *weather_value, *weather_file;
+    struct Option *nc_weather, *weather_cache, *weather_type;
+    struct Option *weather_value, *weather_file;
     struct Option *start_time, *end_time, *seasonality;
     struct Option *spore_rate, *wind;
     struct Option *radial_type, *scale_1, *scale_2, *kappa, *gamma;
-    struct Option *seed, *runs, *threads;
+    struct Option *kernel_radius;
+    struct Option *seed, *runs, *threads, *tile_size, *state_type;
+    struct Option *batch_runs, *tolerance, *convergence;
+    struct Option *affinity, *backend, *random_engine;
     struct Option *output, *output_series;
     struct Option *stddev, *stddev_series;
+    struct Option *probability, *probability_series;
+    struct Option *output_format, *output_reference, *compression;
+    struct Option *summary, *summary_interval, *zones;
+    struct Option *checkpoint, *restart;
+    struct Option *report;
 };
 
 struct SodFlags
 {
     struct Flag *generate_seed;
+    struct Flag *compact;
+    struct Flag *interleaved;
+    struct Flag *fork;
+    struct Flag *binned;
 };
 
 
 int main(int argc, char *argv[])
 {
+    // each process simulates part of the runs (all are in one by default)
+    Distributed processes(&argc, &argv);
     SodOptions opt;
     SodFlags flg;
 
@@ -230,6 +363,7 @@ int main(int argc, char *argv[])
     opt.ioaks->guisection = _("Input");
 
     opt.output = G_define_standard_option(G_OPT_R_OUTPUT);
+    opt.output->required = NO;
     opt.output->guisection = _("Output");
 
     opt.output_series = G_define_standard_option(G_OPT_R_BASENAME_OUTPUT);
@@ -251,6 +385,126 @@ int main(int argc, char *argv[])
     opt.stddev_series->required = NO;
     opt.stddev_series->guisection = _("Output");
 
+    opt.probability = G_define_standard_option(G_OPT_R_OUTPUT);
+    opt.probability->key = "probability";
+    opt.probability->description =
+        _("Probability of infected oaks (part of runs with infection)");
+    opt.probability->required = NO;
+    opt.probability->guisection = _("Output");
+
+    opt.probability_series = G_define_standard_option(G_OPT_R_BASENAME_OUTPUT);
+    opt.probability_series->key = "probability_series";
+    opt.probability_series->description
+            = _("Basename for output series of probabilities");
+    opt.probability_series->required = NO;
+    opt.probability_series->guisection = _("Output");
+
+    opt.summary = G_define_standard_option(G_OPT_F_OUTPUT);
+    opt.summary->key = "summary";
+    opt.summary->required = NO;
+    opt.summary->label = _("CSV file with summaries of each run");
+    opt.summary->description =
+        _("Infected oaks, bay laurel, cells and area of each run by date"
+          " and zone (zone 0 is the whole region), computed by the threads"
+          " of the runs, without the rasters when output is not used");
+    opt.summary->guisection = _("Output");
+
+    opt.summary_interval = G_define_option();
+    opt.summary_interval->key = "summary_interval";
+    opt.summary_interval->type = TYPE_STRING;
+    opt.summary_interval->required = NO;
+    opt.summary_interval->label = _("When the summaries are computed");
+    opt.summary_interval->description =
+        _("After each simulated week or at the end of each year");
+    opt.summary_interval->options = "week,year";
+    opt.summary_interval->answer = "year";
+    opt.summary_interval->guisection = _("Output");
+
+    opt.zones = G_define_standard_option(G_OPT_R_INPUT);
+    opt.zones->key = "zones";
+    opt.zones->required = NO;
+    opt.zones->label = _("Raster map of zones of the summaries");
+    opt.zones->description =
+        _("Each category greater than zero is summarized separately");
+    opt.zones->guisection = _("Output");
+
+    opt.output_format = G_define_option();
+    opt.output_format->key = "output_format";
+    opt.output_format->type = TYPE_STRING;
+    opt.output_format->required = NO;
+    opt.output_format->label = _("Format of the outputs");
+    opt.output_format->description =
+        _("GRASS rasters or files (the output names with .tif) written"
+          " by GDAL as tiled GeoTIFFs or cloud optimized GeoTIFFs");
+    opt.output_format->options = "grass,gtiff,cog";
+    opt.output_format->answer = "grass";
+    opt.output_format->guisection = _("Output");
+
+    opt.output_reference = G_define_standard_option(G_OPT_F_INPUT);
+    opt.output_reference->key = "output_reference";
+    opt.output_reference->required = NO;
+    opt.output_reference->label =
+        _("Raster file with the georeferencing of GDAL outputs");
+    opt.output_reference->description =
+        _("Geotransform and projection of the output files, the raster"
+          " must have the size of the computational region");
+    opt.output_reference->guisection = _("Output");
+
+    opt.compression = G_define_option();
+    opt.compression->key = "compression";
+    opt.compression->type = TYPE_STRING;
+    opt.compression->required = NO;
+    opt.compression->label = _("Compression of GDAL outputs");
+    opt.compression->description =
+        _("Tiles are compressed in parallel by nprocs threads");
+    opt.compression->options = "deflate,zstd,lzw,none";
+    opt.compression->answer = "deflate";
+    opt.compression->guisection = _("Output");
+
+    opt.checkpoint = G_define_standard_option(G_OPT_F_OUTPUT);
+    opt.checkpoint->key = "checkpoint";
+    opt.checkpoint->required = NO;
+    opt.checkpoint->label = _("File to save the state of all runs");
+    opt.checkpoint->description =
+        _("The state is saved at the end of each year (replacing"
+          " the previous one), so the simulation can be restarted"
+          " or extended with a later end time");
+    opt.checkpoint->guisection = _("Checkpoint");
+
+    opt.restart = G_define_standard_option(G_OPT_F_INPUT);
+    opt.restart->key = "restart";
+    opt.restart->required = NO;
+    opt.restart->label = _("Checkpoint file to continue from");
+    opt.restart->description =
+        _("The simulation continues after the year saved in the checkpoint"
+          " with the same result as without the interruption");
+    opt.restart->guisection = _("Checkpoint");
+
+    flg.fork = G_define_flag();
+    flg.fork->key = 'f';
+    flg.fork->label =
+        _("Continue from the checkpoint with different parameters");
+    flg.fork->description =
+        _("The saved state is used as a starting point of a different"
+          " scenario. Runs continue with new random numbers when"
+          " the random seed differs from the saved one.");
+    flg.fork->guisection = _("Checkpoint");
+
+    // only the instrumented build counts what to report
+#ifdef SOD_INSTRUMENTATION
+    opt.report = G_define_standard_option(G_OPT_F_OUTPUT);
+    opt.report->key = "report";
+    opt.report->required = NO;
+    opt.report->label = _("JSON file with timings and counters");
+    opt.report->description =
+        _("Time of each part of the simulation by year and run"
+          " and numbers of spores, spores outside of the region,"
+          " spores landing without susceptible hosts and infections");
+    opt.report->guisection = _("Output");
+#else
+    opt.report = nullptr;
+#endif
+
     opt.wind = G_define_option();
     opt.wind->type = TYPE_STRING;
     opt.wind->key = "wind";
@@ -266,6 +520,29 @@ int main(int argc, char *argv[])
     opt.nc_weather->required = NO;
     opt.nc_weather->guisection = _("Weather");
 
+    opt.weather_cache = G_define_standard_option(G_OPT_F_BIN_INPUT);
+    opt.weather_cache->key = "weather_cache";
+    opt.weather_cache->label = _("Binary cache of the weather data");
+    opt.weather_cache->description =
+        _("Weather data converted to a file which is read only as needed."
+          " When used with ncdf_weather, the cache is created from it"
+          " first, so the conversion can be done once for next runs.");
+    opt.weather_cache->required = NO;
+    opt.weather_cache->guisection = _("Weather");
+
+    opt.weather_type = G_define_option();
+    opt.weather_type->key = "weather_type";
+    opt.weather_type->type = TYPE_STRING;
+    opt.weather_type->required = NO;
+    opt.weather_type->label =
+        _("Type of values in the created weather cache");
+    opt.weather_type->description =
+        _("Values are stored as 16-bit or 8-bit integers scaled to"
+          " the range of the weather coefficients to save memory");
+    opt.weather_type->options = "float32,uint16,uint8";
+    opt.weather_type->answer = "float32";
+    opt.weather_type->guisection = _("Weather");
+
     opt.weather_file = G_define_standard_option(G_OPT_F_INPUT);
     opt.weather_file->key = "weather_file";
     opt.weather_file->label = _("Text file with weather");
@@ -352,6 +629,31 @@ int main(int argc, char *argv[])
     opt.gamma->options = "0-1";
     opt.gamma->guisection = _("Spores");
 
+    opt.kernel_radius = G_define_option();
+    opt.kernel_radius->type = TYPE_INTEGER;
+    opt.kernel_radius->key = "kernel_radius";
+    opt.kernel_radius->required = NO;
+    opt.kernel_radius->label =
+        _("Radius of precomputed dispersal kernel in cells");
+    opt.kernel_radius->description =
+        _("Spore destinations within the radius are sampled from a table"
+          " computed at the start, longer distances are sampled directly."
+          " Results differ from the direct sampling only by the binning"
+          " of the distances to cells.");
+    opt.kernel_radius->options = "1-";
+    opt.kernel_radius->guisection = _("Spores");
+
+    flg.binned = G_define_flag();
+    flg.binned->key = 'b';
+    flg.binned->label =
+        _("Disperse the spores of a cell together");
+    flg.binned->description =
+        _("Numbers of spores landing in each cell of the kernel"
+          " and infections in each cell are drawn at once instead of"
+          " for each spore (with the same distribution),"
+          " faster with many spores");
+    flg.binned->guisection = _("Spores");
+
     opt.seed = G_define_option();
     opt.seed->key = "random_seed";
     opt.seed->type = TYPE_INTEGER;
@@ -381,6 +683,41 @@ int main(int argc, char *argv[])
           " and will be avaraged for the output");
     opt.runs->guisection = _("Randomness");
 
+    opt.batch_runs = G_define_option();
+    opt.batch_runs->key = "batch_runs";
+    opt.batch_runs->type = TYPE_INTEGER;
+    opt.batch_runs->required = NO;
+    opt.batch_runs->label =
+        _("Number of runs added at once until the result converges");
+    opt.batch_runs->description =
+        _("Batches of runs are simulated until the convergence test"
+          " passes, runs is then the maximum (in whole batches)."
+          " Runs get the same seeds as without batches.");
+    opt.batch_runs->options = "1-";
+    opt.batch_runs->guisection = _("Randomness");
+
+    opt.tolerance = G_define_option();
+    opt.tolerance->key = "tolerance";
+    opt.tolerance->type = TYPE_DOUBLE;
+    opt.tolerance->required = NO;
+    opt.tolerance->label = _("Tolerance of the convergence test");
+    opt.tolerance->description =
+        _("Relative change of the mean or relative half-width of"
+          " the confidence interval (e.g. 0.01)");
+    opt.tolerance->guisection = _("Randomness");
+
+    opt.convergence = G_define_option();
+    opt.convergence->key = "convergence";
+    opt.convergence->type = TYPE_STRING;
+    opt.convergence->required = NO;
+    opt.convergence->label = _("Test whether there are enough runs");
+    opt.convergence->description =
+        _("Change of the mean raster after a batch or 95% confidence"
+          " interval of the mean of the total of infected oaks in a run");
+    opt.convergence->options = "change,interval";
+    opt.convergence->answer = "change";
+    opt.convergence->guisection = _("Randomness");
+
     opt.threads = G_define_option();
     opt.threads->key = "nprocs";
     opt.threads->type = TYPE_INTEGER;
@@ -390,20 +727,139 @@ int main(int argc, char *argv[])
     opt.threads->options = "1-";
     opt.threads->guisection = _("Randomness");
 
+    opt.tile_size = G_define_option();
+    opt.tile_size->key = "tile_size";
+    opt.tile_size->type = TYPE_INTEGER;
+    opt.tile_size->required = NO;
+    opt.tile_size->label =
+        _("Number of rows in a tile for parallel computing within a run");
+    opt.tile_size->description =
+        _("Tiles of one run are computed in parallel instead of computing"
+          " runs in parallel. The result does not depend on"
+          " the number of threads or the tile size.");
+    opt.tile_size->options = "1-";
+    opt.tile_size->guisection = _("Randomness");
+
+    opt.affinity = G_define_option();
+    opt.affinity->key = "affinity";
+    opt.affinity->type = TYPE_STRING;
+    opt.affinity->required = NO;
+    opt.affinity->label = _("Pinning of threads to processors");
+    opt.affinity->description =
+        _("Pinned threads always simulate the same runs and keep their"
+          " state in the memory of their processor"
+          " (close uses processors in order, spread all of them evenly)");
+    opt.affinity->options = "none,close,spread";
+    opt.affinity->answer = "none";
+    opt.affinity->guisection = _("Randomness");
+
+    opt.backend = G_define_option();
+    opt.backend->key = "backend";
+    opt.backend->type = TYPE_STRING;
+    opt.backend->required = NO;
+    opt.backend->label = _("Hardware which simulates the runs");
+    opt.backend->description =
+        _("With cuda, the state of all runs is on the GPU and the runs"
+          " are simulated there all at once (requires compilation with"
+          " CUDA, the random numbers differ from cpu)");
+    opt.backend->options = "cpu,cuda";
+    opt.backend->answer = "cpu";
+    opt.backend->guisection = _("Randomness");
+
+    opt.random_engine = G_define_option();
+    opt.random_engine->key = "random_engine";
+    opt.random_engine->type = TYPE_STRING;
+    opt.random_engine->required = NO;
+    opt.random_engine->label = _("Generator of the random numbers of a run");
+    opt.random_engine->description =
+        _("The engines other than std use faster samplers of the"
+          " distributions (also with tiles), the random numbers differ"
+          " from std");
+    opt.random_engine->options = "std,xoshiro,pcg,philox";
+    opt.random_engine->answer = "std";
+    opt.random_engine->guisection = _("Randomness");
+
+    opt.state_type = G_define_option();
+    opt.state_type->key = "state_type";
+    opt.state_type->type = TYPE_STRING;
+    opt.state_type->required = NO;
+    opt.state_type->label = _("Type of values in the state of each run");
+    opt.state_type->description =
+        _("Smaller types reduce memory needed for the runs,"
+          " the numbers of trees in a cell must fit into the type");
+    opt.state_type->options = "int,uint16,uint8";
+    opt.state_type->answer = "int";
+    opt.state_type->guisection = _("Randomness");
+
+    flg.compact = G_define_flag();
+    flg.compact->key = 'c';
+    flg.compact->label =
+        _("Store only cells with host trees");
+    flg.compact->description =
+        _("Per-run state is stored only for cells with living trees"
+          " which saves memory when large part of the area has no trees");
+    flg.compact->guisection = _("Randomness");
+
+    flg.interleaved = G_define_flag();
+    flg.interleaved->key = 'i';
+    flg.interleaved->label =
+        _("Store all host layers of a cell together");
+    flg.interleaved->description =
+        _("Per-run state is stored as one record for each cell"
+          " which makes access to the hosts where a spore lands faster");
+    flg.interleaved->guisection = _("Randomness");
+
     G_option_exclusive(opt.seed, flg.generate_seed, NULL);
+    G_option_exclusive(flg.compact, flg.interleaved, NULL);
+    G_option_exclusive(opt.weather_cache, opt.weather_file, opt.weather_value,
+                       NULL);
     G_option_required(opt.seed, flg.generate_seed, NULL);
+    G_option_required(opt.output, opt.summary, NULL);
+    G_option_requires(opt.zones, opt.summary, NULL);
+    G_option_requires(opt.stddev, opt.output, NULL);
+    G_option_requires(opt.probability, opt.output, NULL);
+    G_option_requires(flg.fork, opt.restart, NULL);
+    G_option_requires(flg.binned, opt.kernel_radius, NULL);
+    G_option_requires(opt.batch_runs, opt.tolerance, NULL);
+    G_option_requires(opt.tolerance, opt.batch_runs, NULL);
+    // outputs during the simulation and restarts are for a fixed ensemble
+    G_option_excludes(opt.batch_runs, opt.output_series, opt.stddev_series,
+                      opt.probability_series, opt.checkpoint, opt.restart,
+                      NULL);
 
     if (G_parser(argc, argv))
         exit(EXIT_FAILURE);
+    // the report has the runs of one ensemble
+    if (opt.batch_runs->answer && opt.report && opt.report->answer)
+        G_fatal_error(_("Option %s cannot be used with %s"),
+                      opt.report->key, opt.batch_runs->key);
 
     unsigned num_runs = 1;
     if (opt.runs->answer)
         num_runs = std::stoul(opt.runs->answer);
+    // the first batch is simulated as an ensemble with all runs
+    unsigned batch_runs = num_runs;
+    if (opt.batch_runs->answer)
+        batch_runs = std::min(num_runs, unsigned(std::stoul(
+                                                     opt.batch_runs->answer)));
+    if (batch_runs < unsigned(processes.size()))
+        G_fatal_error(_("There are %d processes, but only %u runs"),
+                      processes.size(), batch_runs);
+    unsigned first_run = processes.first_run(batch_runs);
+    unsigned process_runs = processes.local_runs(batch_runs);
+    if (processes.size() > 1)
+        G_verbose_message(_("Process %d of %d simulates runs %u to %u"),
+                          processes.rank() + 1, processes.size(),
+                          first_run + 1, first_run + process_runs);
 
     unsigned threads = 1;
     if (opt.threads->answer)
         threads = std::stoul(opt.threads->answer);
 
+    int tile_size = 0;
+    if (opt.tile_size->answer)
+        tile_size = std::stoi(opt.tile_size->answer);
+
     // Seasonality: Do you want the spread to be limited to certain months?
     bool ss = seasonality_from_string(opt.seasonality->answer);
 
@@ -428,6 +884,9 @@ int main(int argc, char *argv[])
                       opt.radial_type->answer);
     else if (opt.gamma->answer)
         gamma = std::stod(opt.gamma->answer);
+    int kernel_radius = 0;
+    if (opt.kernel_radius->answer)
+        kernel_radius = std::stoi(opt.kernel_radius->answer);
 
     // initialize the start Date and end Date object
     // options for times are required ints
@@ -439,6 +898,8 @@ int main(int argc, char *argv[])
     }
     Date dd_start(start_time, 01, 01);
     Date dd_end(end_time, 12, 31);
+    // weather is always given from the start of the simulation
+    const Date weather_start(dd_start);
 
     unsigned seed_value;
     if (opt.seed->answer) {
@@ -449,44 +910,113 @@ int main(int argc, char *argv[])
         // flag of option is required
         std::random_device rd;
         seed_value = rd();
+        // all processes use the seed of the root
+        processes.broadcast(seed_value);
         G_verbose_message(_("Generated random seed (-%c): %ud"),
                           flg.generate_seed->key, seed_value);
     }
 
-    // read the suspectible UMCA raster image
-    Img umca_rast = Img::fromGrassRaster(opt.umca->answer);
-
-    // read the SOD-affected oaks raster image
-    Img oaks_rast = Img::fromGrassRaster(opt.oaks->answer);
-
-    // read the living trees raster image
-    Img lvtree_rast = Img::fromGrassRaster(opt.lvtree->answer);
-
-    // read the initial infected oaks image
-    Img I_oaks_rast = Img::fromGrassRaster(opt.ioaks->answer);
-
-    // create the initial suspectible oaks image
-    Img S_oaks_rast = oaks_rast - I_oaks_rast;
-
-    // create the initial infected umca image
-    Img I_umca_rast = initialize(umca_rast, I_oaks_rast);
-
-    // create the initial suspectible umca image
-    Img S_umca_rast = umca_rast - I_umca_rast;
+    // the runs continue from the week saved in the checkpoint
+    std::unique_ptr<CompressedInput> restart;
+    CheckpointInfo restart_info;
+    unsigned first_week = 0;
+    if (opt.restart->answer) {
+        try {
+            restart.reset(new CompressedInput(
+                              process_file(opt.restart->answer,
+                                           processes).c_str()));
+            restart_info = read_checkpoint_info(*restart);
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error(_("Cannot read checkpoint: %s"), error.what());
+        }
+        dd_start = Date(restart_info.year, restart_info.month,
+                        restart_info.day);
+        first_week = restart_info.week;
+        G_verbose_message(_("Continuing from %d-%02d-%02d"),
+                          dd_start.getYear(), dd_start.getMonth(),
+                          dd_start.getDay());
+    }
 
-    // SOD-immune trees image
-    //Img SOD_rast = umca_rast + oaks_rast;
-    //Img IMM_rast = lvtree_rast - SOD_rast;
+    SimulationSetup setup;
+    setup.threads = threads;
+    setup.tile_size = tile_size;
+    string affinity = opt.affinity->answer;
+    if (affinity == "close")
+        setup.affinity = AFFINITY_CLOSE;
+    else if (affinity == "spread")
+        setup.affinity = AFFINITY_SPREAD;
+    if (string(opt.backend->answer) == "cuda") {
+#ifndef HAVE_CUDA
+        G_fatal_error(_("Cannot use %s=%s: compiled without CUDA"),
+                      opt.backend->key, opt.backend->answer);
+#endif
+        setup.backend = BACKEND_CUDA;
+    }
+    string random_engine = opt.random_engine->answer;
+    if (random_engine == "xoshiro")
+        setup.engine = ENGINE_XOSHIRO;
+    else if (random_engine == "pcg")
+        setup.engine = ENGINE_PCG;
+    else if (random_engine == "philox")
+        setup.engine = ENGINE_PHILOX;
+    if (flg.compact->answer)
+        setup.layout = HOST_CELLS;
+    else if (flg.interleaved->answer)
+        setup.layout = CELL_RECORDS;
+    string state_type = opt.state_type->answer;
+    if (state_type == "uint8")
+        setup.type = STATE_UINT8;
+    else if (state_type == "uint16")
+        setup.type = STATE_UINT16;
+
+    // the initial state is created from the rasters only once,
+    // the rasters are not needed for the runs
+    std::unique_ptr<Simulation> simulation;
+    std::unique_ptr<SummaryZones> zones;
+    {
+        // the suspectible UMCA, SOD-affected oaks, living trees
+        // and initial infected oaks raster images (and the zones)
+        std::vector<const char *> names = {opt.umca->answer, opt.oaks->answer,
+                                           opt.lvtree->answer,
+                                           opt.ioaks->answer};
+        if (opt.zones->answer)
+            names.push_back(opt.zones->answer);
+        std::vector<Img> inputs = read_rasters(names, threads, processes);
+        const Img& umca_rast = inputs[0];
+        const Img& oaks_rast = inputs[1];
+        const Img& lvtree_rast = inputs[2];
+        const Img& I_oaks_rast = inputs[3];
+        if (opt.zones->answer)
+            zones.reset(new SummaryZones(inputs[4]));
+
+        try {
+            simulation.reset(new Simulation(umca_rast, oaks_rast,
+                                            lvtree_rast, I_oaks_rast,
+                                            setup));
+        }
+        catch (std::invalid_argument& error) {
+            G_fatal_error(_("Cannot use %s=%s: %s"), opt.state_type->key,
+                          opt.state_type->answer, error.what());
+        }
+    }
+    const Img& lvtree_rast = simulation->living_trees();
 
     // retrieve the width and height of the images
-    int width = umca_rast.getWidth();
-    int height = umca_rast.getHeight();
+    int width = lvtree_rast.getWidth();
+    int height = lvtree_rast.getHeight();
+    if (setup.layout == HOST_CELLS)
+        G_verbose_message(_("Host cells: %d of %d"),
+                          simulation->stored_cells(), width * height);
 
     std::shared_ptr<NcFile> weather_coeff = nullptr;
     std::vector<double> weather_values;
     double weather_value = 0;
-    if (opt.nc_weather->answer)
-        weather_coeff = std::make_shared<NcFile>(opt.nc_weather->answer, NcFile::ReadOnly);
+    // only the root reads NetCDF, the others get the weather from it
+    if (opt.nc_weather->answer) {
+        if (processes.root())
+            weather_coeff = std::make_shared<NcFile>(opt.nc_weather->answer, NcFile::ReadOnly);
+    }
     else if (opt.weather_file->answer)
         weather_values = weather_file_to_list(opt.weather_file->answer);
     else if (opt.weather_value->answer)
@@ -515,133 +1045,480 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    // weather can have a coarser grid than the hosts
+    int weather_width = width;
+    int weather_height = height;
+    if (weather_coeff) {
+        weather_height = mcf_nc->get_dim(1)->size();
+        weather_width = mcf_nc->get_dim(2)->size();
+        if (ccf_nc->get_dim(1)->size() != weather_height
+                || ccf_nc->get_dim(2)->size() != weather_width)
+            G_fatal_error(_("Moisture and temperature coefficients"
+                            " have different sizes"));
+    }
+    processes.broadcast(weather_width);
+    processes.broadcast(weather_height);
+
+    // weather cache is used instead of reading the NetCDF file every week
+    std::unique_ptr<WeatherCache> weather_cache;
+    if (opt.weather_cache->answer) {
+        try {
+            if (weather_coeff) {
+                convert_weather(mcf_nc, ccf_nc, weather_width,
+                                weather_height, weather_start,
+                                weather_code_from_string(
+                                    opt.weather_type->answer),
+                                opt.weather_cache->answer);
+                weather_coeff = nullptr;
+                mcf_nc = ccf_nc = nullptr;
+            }
+            // the cache is created once and then mapped by all processes,
+            // so the processes on one node share its pages in memory
+            processes.barrier();
+            weather_cache.reset(new WeatherCache(opt.weather_cache->answer));
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error("%s", error.what());
+        }
+        weather_width = weather_cache->getWidth();
+        weather_height = weather_cache->getHeight();
+        if (weather_cache->start_year() != weather_start.getYear()
+                || weather_cache->start_month() != weather_start.getMonth()
+                || weather_cache->start_day() != weather_start.getDay())
+            G_fatal_error(_("Weather cache starts at %d-%02d-%02d,"
+                            " but the simulation at %d-%02d-%02d"),
+                          weather_cache->start_year(),
+                          weather_cache->start_month(),
+                          weather_cache->start_day(),
+                          weather_start.getYear(), weather_start.getMonth(),
+                          weather_start.getDay());
+        G_verbose_message(_("Weather cache with %u weeks"),
+                          weather_cache->weeks());
+    }
+    WeatherFormat weather_format;
+    if (weather_cache)
+        weather_format = weather_cache->format();
+    else if (opt.nc_weather->answer)
+        weather_format.spatial = true;
+    bool coarse_weather = weather_width != width || weather_height != height;
+    if (weather_format.spatial && coarse_weather) {
+        if (weather_width > width || weather_height > height)
+            G_fatal_error(_("Weather has %d rows and %d columns, more than"
+                            " the computational region (%d and %d)"),
+                          weather_height, weather_width, height, width);
+        G_verbose_message(_("Weather with %d rows and %d columns is used"
+                            " for the extent of the computational region"),
+                          weather_height, weather_width);
+    }
+    // quantized weather is always read through the index
+    if (weather_format.spatial
+            && (coarse_weather || weather_format.code != WEATHER_FLOAT32))
+        weather_format.index = std::make_shared<std::vector<unsigned>>(
+                    weather_index(width, height, weather_width,
+                                  weather_height));
+    size_t weather_cells = size_t(weather_width) * weather_height;
+    bool netcdf_weather = opt.nc_weather->answer && !weather_cache;
+
     const unsigned max_weeks_in_year = 53;
-    double *mcf = nullptr;
-    double *ccf = nullptr;
-    double *weather = nullptr;
+    // NetCDF is read in a separate thread while the previous year
+    // is simulated, the first year is read during the setup
+    std::unique_ptr<WeatherReader> weather_reader;
     if (weather_coeff) {
-        mcf = new double[height * width];
-        ccf = new double[height * width];
-        weather = new double[max_weeks_in_year * height * width];
-    }
-
-    // build the Sporulation object
-    std::vector<Sporulation> sporulations;
-    std::vector<Img> sus_umca_rasts(num_runs, S_umca_rast);
-    std::vector<Img> sus_oaks_rasts(num_runs, S_oaks_rast);
-    std::vector<Img> inf_umca_rasts(num_runs, I_umca_rast);
-    std::vector<Img> inf_oaks_rasts(num_runs, I_oaks_rast);
-    sporulations.reserve(num_runs);
-    for (unsigned i = 0; i < num_runs; ++i)
-        sporulations.emplace_back(seed_value++, I_umca_rast);
-
-    std::vector<unsigned> unresolved_weeks;
-    unresolved_weeks.reserve(max_weeks_in_year);
-
-    // main simulation loop (weekly steps)
-    for (int current_week = 0; ; current_week++, dd_start.increasedByWeek()) {
-        if (dd_start < dd_end)
-            if (!ss || !(dd_start.getMonth() > 9))
-                unresolved_weeks.push_back(current_week);
-
-        // if all the oaks are infected, then exit
-        if (all_infected(S_oaks_rast)) {
-            cerr << "In the " << dd_start << " all suspectible oaks are infected!" << endl;
-            break;
+        std::vector<double> mcf(weather_cells);
+        std::vector<double> ccf(weather_cells);
+        auto read_week = [=](unsigned week, float *values) mutable {
+            get_spatial_weather(mcf_nc, ccf_nc, mcf.data(), ccf.data(),
+                                values, weather_width, weather_height,
+                                week);
+        };
+        weather_reader.reset(new WeatherReader(read_week, weather_cells,
+                                               max_weeks_in_year));
+        weather_reader->request(weeks_until_year_end(first_week, dd_start,
+                                                     dd_end, ss));
+    }
+    std::unique_ptr<WeatherInput> weather;
+    if (weather_cache)
+        weather.reset(new WeatherFromCache(*weather_cache, weather_format));
+    else if (netcdf_weather)
+        weather.reset(new StreamedWeather(weather_format,
+                                          weather_reader.get(),
+                                          weather_cells, processes));
+    else if (!weather_values.empty())
+        weather.reset(new WeatherValues(weather_values));
+    else
+        weather.reset(new WeatherValues(weather_value));
+
+    SpreadParams spread_params;
+    spread_params.spore_rate = spore_rate;
+    spread_params.rtype = rtype;
+    spread_params.scale1 = scale1;
+    spread_params.scale2 = scale2;
+    spread_params.kappa = kappa;
+    spread_params.gamma = gamma;
+    spread_params.wdir = pwdir;
+    spread_params.kernel_radius = kernel_radius;
+    spread_params.binned = flg.binned->answer;
+
+    std::unique_ptr<EnsembleRun> ensemble;
+    // global number of the first run of the ensemble (from zero)
+    unsigned ensemble_first_run = 0;
+    // runs of this process from the given global run (of a batch)
+    auto start_ensemble = [&](unsigned global_first_run) {
+        ensemble_first_run = global_first_run + first_run;
+        try {
+            // seeds of the runs do not depend on the number of processes
+            ensemble = simulation->start(spread_params, weather->format(),
+                                         seed_value + global_first_run
+                                         + first_run, process_runs);
+        }
+        catch (std::invalid_argument& error) {
+            G_fatal_error(_("Cannot set up the dispersal: %s"),
+                          error.what());
+        }
+        catch (std::runtime_error& error) {
+            // the device fails (e.g. there is not enough memory)
+            G_fatal_error(_("Cannot start the runs: %s"), error.what());
+        }
+    };
+    start_ensemble(0);
+    if (auto dispersal_table = ensemble->dispersal_table())
+        G_verbose_message(_("Dispersal kernel: %u cells,"
+                            " probability of longer distance %g"),
+                          (unsigned) dispersal_table->size(),
+                          dispersal_table->escape_probability());
+    // what needs to be the same in a checkpoint used for restart
+    CheckpointInfo checkpoint_info;
+    std::ostringstream structure;
+    structure << "runs=" << num_runs << "\nrows=" << height
+              << "\ncols=" << width << "\nstate_type=" << state_type
+              << "\ncompact=" << bool(flg.compact->answer)
+              << "\ninterleaved=" << bool(flg.interleaved->answer) << "\n";
+    if (processes.size() > 1)
+        structure << "process=" << processes.rank() << "/"
+                  << processes.size() << "\n";
+    if (setup.backend == BACKEND_CUDA)
+        structure << "backend=cuda\n";
+    checkpoint_info.structure = structure.str();
+    checkpoint_info.parameters = model_parameters(
+                {opt.umca, opt.oaks, opt.lvtree, opt.ioaks, opt.start_time,
+                 opt.seasonality, opt.spore_rate, opt.wind, opt.radial_type,
+                 opt.scale_1, opt.scale_2, opt.kappa, opt.gamma,
+                 opt.kernel_radius, opt.tile_size, opt.weather_value,
+                 opt.weather_file});
+    if (flg.binned->answer)
+        checkpoint_info.parameters += "binned=1\n";
+    if (setup.engine != ENGINE_STD)
+        checkpoint_info.parameters += "random_engine="
+                + random_engine + "\n";
+    checkpoint_info.seed = ensemble->first_seed();
+    if (restart) {
+        if (restart_info.structure != checkpoint_info.structure)
+            G_fatal_error(_("Checkpoint has a different number of runs"
+                            " or processes,"
+                            " size of the region or state storage"));
+        if (!flg.fork->answer
+                && (restart_info.parameters != checkpoint_info.parameters
+                    || restart_info.seed != checkpoint_info.seed))
+            G_fatal_error(_("Checkpoint was saved with different parameters"
+                            " (use -%c to continue with the new ones)"),
+                          flg.fork->key);
+        try {
+            ensemble->read(*restart,
+                           restart_info.seed != checkpoint_info.seed);
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error(_("Cannot read checkpoint: %s"), error.what());
+        }
+        restart.reset();
+    }
+    // saves all runs to continue from the given week,
+    // the previous checkpoint is replaced only when the new one is complete
+    auto save_checkpoint = [&](unsigned week, const Date& date) {
+        string checkpoint = process_file(opt.checkpoint->answer, processes);
+        string temporary = checkpoint + ".tmp";
+        CheckpointInfo info = checkpoint_info;
+        info.week = week;
+        info.year = date.getYear();
+        info.month = date.getMonth();
+        info.day = date.getDay();
+        try {
+            CompressedOutput stream(temporary.c_str());
+            write_checkpoint_info(stream, info);
+            ensemble->write(stream);
+            stream.close();
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error(_("Cannot write checkpoint: %s"), error.what());
         }
+        if (std::rename(temporary.c_str(), checkpoint.c_str()))
+            G_fatal_error(_("Cannot replace checkpoint %s"),
+                          checkpoint.c_str());
+    };
 
-        // check whether the spore occurs in the month
-        if (dd_start.isYearEnd() || dd_start >= dd_end) {
-            if (!unresolved_weeks.empty()) {
-
-                unsigned week_in_chunk = 0;
-                // get weather for all the weeks
-                for (auto week : unresolved_weeks) {
-                    double *week_weather = weather + week_in_chunk * width * height;
-                    if (weather_coeff) {
-                        get_spatial_weather(mcf_nc, ccf_nc, mcf, ccf, week_weather, width, height, week);
-                    }
-                    ++week_in_chunk;
-                }
-
-                // stochastic simulation runs
-                #pragma omp parallel for num_threads(threads)
-                for (unsigned run = 0; run < num_runs; run++) {
-                    unsigned week_in_chunk = 0;
-                    // actual runs of the simulation per week
-                    for (auto week : unresolved_weeks) {
-                        double *week_weather = weather + week_in_chunk * width * height;
-                        if (!weather_coeff && !weather_values.empty()) {
-                            weather_value = weather_values[week];
-                        }
-                        sporulations[run].SporeGen(inf_umca_rasts[run], week_weather, weather_value, spore_rate);
-
-                        sporulations[run].SporeSpreadDisp(sus_umca_rasts[run], sus_oaks_rasts[run], inf_umca_rasts[run],
-                                                          inf_oaks_rasts[run], lvtree_rast, rtype, week_weather,
-                                                          weather_value, scale1, kappa, pwdir, scale2,
-                                                          gamma);
-                        ++week_in_chunk;
-                    }
-                }
-                unresolved_weeks.clear();
-            }
-            if (opt.output_series->answer || opt.stddev_series->answer) {
-                // aggregate
-                I_oaks_rast.zero();
-                for (unsigned i = 0; i < num_runs; i++)
-                    I_oaks_rast += inf_oaks_rasts[i];
-                I_oaks_rast /= num_runs;
-                // write result
-                // date is always end of the year, even for seasonal spread
-                if (opt.output_series->answer) {
-                    string name = generate_name(opt.output_series->answer, dd_start);
-                    I_oaks_rast.toGrassRaster(name.c_str());
-                }
+    bool series = opt.output_series->answer || opt.stddev_series->answer
+            || opt.probability_series->answer;
+    // timings and counters are reported by year
+    std::unique_ptr<InstrumentationReport> report;
+    if (opt.report && opt.report->answer)
+        report.reset(new InstrumentationReport(first_run, process_runs,
+                                               threads));
+    InstrumentationReport::Year *year = nullptr;
+    auto add_phase = [&](Phase phase, double start) {
+        if (year)
+            year->phases[phase] += wall_time() - start;
+    };
+
+    // files of one year can wait to be written while the next
+    // year is simulated
+    unsigned series_outputs = bool(opt.output_series->answer)
+            + bool(opt.stddev_series->answer)
+            + bool(opt.probability_series->answer);
+    // georeferencing of the files is read only once
+    std::shared_ptr<const GdalOutput> gdal_output;
+    string output_format = opt.output_format->answer;
+    if (output_format != "grass" && processes.root()) {
+        if (!opt.output_reference->answer)
+            G_fatal_error(_("Option %s is required for %s=%s"),
+                          opt.output_reference->key, opt.output_format->key,
+                          opt.output_format->answer);
+        string compression = opt.compression->answer;
+        std::transform(compression.begin(), compression.end(),
+                       compression.begin(), ::toupper);
+        try {
+            gdal_output = std::make_shared<const GdalOutput>(
+                        opt.output_reference->answer,
+                        output_format == "cog" ? GDAL_COG : GDAL_GTIFF,
+                        compression, threads);
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error("%s", error.what());
+        }
+        if (gdal_output->width() != width || gdal_output->height() != height)
+            G_fatal_error(_("Raster %s has %d rows and %d columns,"
+                            " the computational region %d and %d"),
+                          opt.output_reference->answer,
+                          gdal_output->height(), gdal_output->width(),
+                          height, width);
+    }
+    // names of the outputs are names of files for GDAL
+    auto output_name = [&](const string& name) {
+        return gdal_output ? name + ".tif" : name;
+    };
+    RasterWriter writer(series_outputs, gdal_output);
+    // each process writes the summaries of its runs
+    std::unique_ptr<SummaryTable> summary_table;
+    if (opt.summary->answer) {
+        try {
+            summary_table.reset(new SummaryTable(
+                                    process_file(opt.summary->answer,
+                                                 processes),
+                                    zones.get(),
+                                    int64_t(lvtree_rast.getWEResolution())
+                                    * lvtree_rast.getNSResolution()));
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error("%s", error.what());
+        }
+    }
+    // the summaries computed until now (in the year ends)
+    auto write_summaries = [&]() {
+        if (!summary_table)
+            return;
+        try {
+            for (unsigned run = 0; run < ensemble->runs(); run++)
+                summary_table->write(ensemble_first_run + run + 1,
+                                     ensemble->summary_dates(),
+                                     ensemble->summaries(run));
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error("%s", error.what());
+        }
+        ensemble->clear_summaries();
+    };
+
+    // all runs are simulated to the end of each year when the outputs
+    // or checkpoints are written there
+    SimulationControl control;
+    control.yearly = series || opt.checkpoint->answer || report;
+    control.yearly_statistics = series;
+    // the statistics of the runs are not needed for only the summaries
+    control.final_statistics = opt.output->answer || opt.batch_runs->answer;
+    if (summary_table)
+        control.summaries = string(opt.summary_interval->answer) == "week"
+                ? SUMMARY_WEEKLY : SUMMARY_YEARLY;
+    control.zones = zones.get();
+    control.report = report.get();
+    control.processes = &processes;
+    control.year_end = [&](const Date& date, unsigned week) {
+        if (report)
+            year = report->last_year();
+        double phase_start = wall_time();
+        const EnsembleStatistics *statistics = nullptr;
+        if (series)
+            statistics = &ensemble->statistics(&processes);
+        add_phase(PHASE_STATISTICS, phase_start);
+        phase_start = wall_time();
+        write_summaries();
+        // only the root has the statistics of all processes
+        if (series && processes.root()) {
+            // write result
+            // date is always end of the year, even for seasonal spread
+            if (opt.output_series->answer)
+                writer.write(statistics->mean(),
+                             output_name(generate_name(
+                                             opt.output_series->answer,
+                                             date)));
+            if (opt.stddev_series->answer)
+                writer.write(statistics->stddev(),
+                             output_name(generate_name(
+                                             opt.stddev_series->answer,
+                                             date)));
+            if (opt.probability_series->answer)
+                writer.write(statistics->probability(),
+                             output_name(generate_name(
+                                             opt.probability_series->answer,
+                                             date)));
+        }
+        add_phase(PHASE_OUTPUT, phase_start);
+        phase_start = wall_time();
+        if (opt.checkpoint->answer && date < dd_end) {
+            Date next_week(date);
+            next_week.increasedByWeek();
+            save_checkpoint(week + 1, next_week);
+        }
+        // the last week is after the end, so it is not simulated
+        else if (opt.checkpoint->answer) {
+            save_checkpoint(week, date);
+        }
+        add_phase(PHASE_CHECKPOINT, phase_start);
+    };
+    // only the main thread calls the GRASS library, it writes the queued
+    // rasters while the other threads simulate
+    control.while_simulating = [&]() {
+        writer.write_queued();
+    };
+
+    auto simulate = [&]() {
+        try {
+            ensemble->simulate(first_week, dd_start, dd_end, ss, *weather,
+                               control);
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error("%s", error.what());
+        }
+    };
+    simulate();
+
+    // the final outputs are reported with the last year
+    if (report)
+        year = report->last_year();
+    double phase_start = wall_time();
+    // aggregate (only for the rasters or batches)
+    const EnsembleStatistics *statistics = nullptr;
+    if (control.final_statistics)
+        statistics = &ensemble->statistics(&processes);
+    unsigned simulated_runs = process_runs;
+    unsigned finished_runs = ensemble->finished_runs();
+    // each batch is a new ensemble with the next runs (and seeds), so the
+    // statistics are the same as of one ensemble with all of them
+    EnsembleStatistics batches(threads, lvtree_rast);
+    if (opt.batch_runs->answer) {
+        ConvergenceCriterion criterion = CONVERGENCE_CHANGE;
+        if (string(opt.convergence->answer) == "interval")
+            criterion = CONVERGENCE_INTERVAL;
+        BatchConvergence convergence(criterion,
+                                     std::stod(opt.tolerance->answer));
+        unsigned max_batches = std::max(1u, num_runs / batch_runs);
+        bool enough = false;
+        for (unsigned batch = 1; ; batch++) {
+            // sum and sum of squares of infected oaks in each run
+            std::vector<int64_t> summaries(2, 0);
+            for (unsigned run = 0; run < ensemble->runs(); run++) {
+                int64_t infected = ensemble->totals(run).I_oaks;
+                summaries[0] += infected;
+                summaries[1] += infected * infected;
             }
-            if (opt.stddev_series->answer) {
-                Img stddev(I_oaks_rast.getWidth(), I_oaks_rast.getHeight(),
-                           I_oaks_rast.getWEResolution(), I_oaks_rast.getNSResolution(), 0);
-                for (unsigned i = 0; i < num_runs; i++) {
-                    Img tmp = inf_oaks_rasts[i] - I_oaks_rast;
-                    stddev += tmp * tmp;
-                }
-                stddev /= num_runs;
-                stddev.for_each([](int& a){a = std::sqrt(a);});
-                string name = generate_name(opt.stddev_series->answer, dd_start);
-                stddev.toGrassRaster(name.c_str());
+            processes.sum_to_root(summaries);
+            // only the root has the statistics, it decides for all
+            enough = true;
+            if (processes.root()) {
+                batches.add_sums(*statistics);
+                batches.combine(threads);
+                enough = convergence.add_batch(batches.mean(), batch_runs,
+                                               summaries[0], summaries[1]);
+                G_verbose_message(_("Batch %u, %u runs: convergence %g"),
+                                  batch, convergence.runs(),
+                                  convergence.value());
             }
+            enough = processes.all(enough);
+            if (enough || batch == max_batches)
+                break;
+            ensemble.reset();
+            start_ensemble(batch * batch_runs);
+            simulate();
+            statistics = &ensemble->statistics(&processes);
+            simulated_runs += process_runs;
+            finished_runs += ensemble->finished_runs();
         }
-
-        if (dd_start >= dd_end)
-            break;
+        if (processes.root()) {
+            if (enough)
+                G_message(_("Result converged with %u runs"),
+                          convergence.runs());
+            else
+                G_warning(_("Result did not converge with the maximum"
+                            " of %u runs (convergence %g)"),
+                          convergence.runs(), convergence.value());
+        }
+        statistics = &batches;
     }
-
-    // aggregate
-    I_oaks_rast.zero();
-    for (unsigned i = 0; i < num_runs; i++)
-        I_oaks_rast += inf_oaks_rasts[i];
-    I_oaks_rast /= num_runs;
+    add_phase(PHASE_STATISTICS, phase_start);
+    phase_start = wall_time();
     // write final result
-    I_oaks_rast.toGrassRaster(opt.output->answer);
-
-    if (opt.stddev->answer) {
-        Img stddev(I_oaks_rast.getWidth(), I_oaks_rast.getHeight(),
-                   I_oaks_rast.getWEResolution(), I_oaks_rast.getNSResolution(), 0);
-        for (unsigned i = 0; i < num_runs; i++) {
-            Img tmp = inf_oaks_rasts[i] - I_oaks_rast;
-            stddev += tmp * tmp;
+    if (opt.output->answer && processes.root()) {
+        writer.write(statistics->mean(), output_name(opt.output->answer));
+        if (opt.stddev->answer)
+            writer.write(statistics->stddev(),
+                         output_name(opt.stddev->answer));
+        if (opt.probability->answer)
+            writer.write(statistics->probability(),
+                         output_name(opt.probability->answer));
+    }
+    try {
+        writer.flush();
+        if (summary_table)
+            summary_table->close();
+    }
+    catch (std::runtime_error& error) {
+        G_fatal_error("%s", error.what());
+    }
+    add_phase(PHASE_OUTPUT, phase_start);
+    if (report) {
+        try {
+            report->write(process_file(opt.report->answer, processes).c_str(),
+                          writer.write_time());
+        }
+        catch (std::runtime_error& error) {
+            G_fatal_error("%s", error.what());
         }
-        stddev /= num_runs;
-        stddev.for_each([](int& a){a = std::sqrt(a);});
-        stddev.toGrassRaster(opt.stddev->answer);
     }
 
-    // clean the allocated memory
-    if (weather) {
-        delete[] mcf;
-        delete[] ccf;
-        delete[] weather;
+    G_verbose_message(_("Runs without infected or susceptible hosts"
+                        " at the end: %u of %u"),
+                      finished_runs, simulated_runs);
+    const ThreadUsage& usage = ensemble->usage();
+    for (unsigned i = 0; i < usage.threads(); i++) {
+        double busy = usage.busy(i);
+        double wall = usage.wall_time();
+        G_verbose_message(_("Thread %u: %lu tasks, busy %.3f s of %.3f s"
+                            " (%.1f%%)"), i, usage.tasks(i), busy, wall,
+                          wall > 0 ? 100 * busy / wall : 0.);
     }
 
+    if (weather_reader)
+        G_verbose_message(_("Waited for weather %.3f s"),
+                          weather_reader->waited());
+    G_verbose_message(_("Waited for writing of outputs %.3f s"),
+                      writer.waited());
+
     return 0;
 }